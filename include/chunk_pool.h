@@ -0,0 +1,78 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file chunk_pool.h
+ *
+ * @brief Memory pool for chunk payloads and attributes.
+ *
+ * Chunk payloads are allocated by the chunkisers or by decodeChunk(), and
+ * are freed by the chunk buffer when the chunks are discarded, so the
+ * allocator is used at the chunk rate. The chunk pool caches the freed
+ * memory in size classes (powers of 2), so that in steady state chunks
+ * can be allocated and freed without calling malloc() and free().
+ *
+ * The pool is disabled by default (and chunk_pool_alloc() is equivalent to
+ * malloc()); it is enabled by the "pool_size" parameter of cb_init().
+ * When the pool is enabled, the memory allocated by chunk_pool_alloc()
+ * must be released with chunk_pool_free() (which also accepts memory
+ * allocated by malloc()).
+ */
+
+/**
+ * Statistics about the usage of the chunk pool.
+ */
+struct chunk_pool_stats {
+  uint64_t allocs;	/**< Number of allocations */
+  uint64_t hits;	/**< Number of allocations served by the pool without calling malloc() */
+  uint64_t frees;	/**< Number of blocks returned to the pool */
+  size_t footprint;	/**< Memory allocated by the pool, in bytes */
+  size_t in_use;	/**< Memory used by the allocated blocks, in bytes */
+};
+
+/**
+ * Configure the chunk pool.
+ *
+ * @param size the maximum amount of memory (in bytes) the pool can
+ *        allocate; 0 disables the pool. The memory already allocated by
+ *        the pool is never released.
+ * @return 0 on success, < 0 on error
+ */
+int chunk_pool_init(size_t size);
+
+/**
+ * Allocate memory for a chunk payload or for chunk attributes.
+ *
+ * @param size the number of bytes to be allocated
+ * @return a pointer to the allocated memory, or NULL in case of error
+ */
+void *chunk_pool_alloc(size_t size);
+
+/**
+ * Resize memory allocated by chunk_pool_alloc().
+ *
+ * @param p the memory to be resized (can be NULL)
+ * @param size the new size, in bytes
+ * @return a pointer to the resized memory, or NULL in case of error (in
+ *         this case, p is not freed)
+ */
+void *chunk_pool_realloc(void *p, size_t size);
+
+/**
+ * Release memory allocated by chunk_pool_alloc() (or by malloc()).
+ *
+ * @param p the memory to be released (can be NULL)
+ */
+void chunk_pool_free(void *p);
+
+/**
+ * Get the statistics of the chunk pool.
+ *
+ * @param s the structure where the statistics are stored
+ */
+void chunk_pool_get_stats(struct chunk_pool_stats *s);
+
+#endif	/* CHUNK_POOL_H */
@@ -42,7 +42,17 @@ typedef struct chunk_buffer ChunkBuffer;
  *
  * @param config a text string containing some configuration parameters for
  *        the buffer, such as the playout delay and maybe some additional
- *        parameters (estimated size of the buffer, etc...)
+ *        parameters (estimated size of the buffer, etc...).
+ *        The "size" parameter (mandatory) is the number of chunks that
+ *        can be stored in the buffer; the "type" parameter selects the
+ *        implementation: "array" (default) stores the size most recently
+ *        received chunks, while "ring" stores the chunks whose IDs are in
+ *        the last size IDs and is indexed by chunk ID (constant time
+ *        insertion, lookup and removal). The optional "pool_size"
+ *        parameter enables the chunk pool (see chunk_pool.h), allowing it
+ *        to allocate up to pool_size bytes for chunk payloads; when the
+ *        pool is enabled, the chunks' data and attributes must be freed
+ *        with chunk_pool_free().
  * @return a pointer to the allocated chunk buffer in case of success, NULL
  *         otherwise
  */
@@ -62,6 +72,25 @@ struct chunk_buffer *cb_init(const char *config);
  */
 int cb_add_chunk(struct chunk_buffer *cb, const struct chunk *c);
 
+struct rcbuf;
+
+/**
+ * Add a chunk whose payload is contained in a reference counted buffer.
+ *
+ * Like cb_add_chunk(), but the chunk data and attributes are not owned
+ * by the chunk: they are contained in the reference counted buffer b (for
+ * example, because the chunk has been decoded by decodeChunkRef()). On
+ * success, the chunk buffer acquires a new reference to b and releases it
+ * when the chunk is removed, so the caller can release its own reference.
+ *
+ * @param cb a pointer to the chunk buffer
+ * @param c a pointer to the descriptor of the chunk to be inserted in the
+ *        buffer
+ * @param b the buffer containing the chunk data and attributes
+ * @return >=0 in case of success, < 0 in case of failure
+ */
+int cb_add_chunk_ref(struct chunk_buffer *cb, const struct chunk *c, struct rcbuf *b);
+
 /** 
  * Get the chunks from a buffer.
  *
@@ -35,11 +35,30 @@ typedef struct chunkID_set ChunkIDSet;
   *                   the chunk ID set. For example, the "size" tag indicates
   *                   the expected number of chunk IDs that will be stored
   *                   in the set; 0 or not present if such a number is not
-  *                   known.
+  *                   known. The "type" tag selects the implementation:
+  *                   "priority" (default: IDs are kept in insertion
+  *                   order), "bitmap" (IDs are kept sorted) or "dense"
+  *                   (IDs are stored in a bitmap, with constant time
+  *                   insertion and lookup; intended for windows of
+  *                   consecutive IDs, such as buffer maps). "bitmap" and
+  *                   "dense" sets use the same wire encoding. For these
+  *                   sets, "encoding=compact" selects a more compact wire
+  *                   encoding (delta varints or runs of consecutive IDs,
+  *                   whichever is smaller). A "dense" set used for
+  *                   decoding messages is switched to the "bitmap"
+  *                   implementation when the received IDs span more than
+  *                   CHUNKID_SET_DENSE_RANGE.
   * @return the pointer to the new set on success, NULL on error
   */
 struct chunkID_set *chunkID_set_init(const char *config);
 
+/**
+  * Largest distance between the smallest and the largest ID of a "dense"
+  * set filled from a received message (so that a peer cannot make it
+  * allocate a large bitmap).
+  */
+#define CHUNKID_SET_DENSE_RANGE (1 << 16)
+
  /**
   * @brief Add a chunk ID to the set.
   * 
@@ -101,6 +120,40 @@ int chunkID_set_check(const struct chunkID_set *h, int chunk_id);
   */
 int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a);
 
+ /**
+  * Intersect a chunk ID set with another one
+  *
+  * Remove from a chunk ID set all the chunk IDs that are not in another
+  * one. The order (priority) of the remaining chunk IDs is preserved.
+  *
+  * @param h a pointer to the set to be modified
+  * @param a a pointer to the set to intersect h with
+  * @return the number of chunk IDs remaining in h, < 0 on error
+  */
+int chunkID_set_intersection(struct chunkID_set *h, const struct chunkID_set *a);
+
+ /**
+  * Remove the chunk IDs of a set from another one
+  *
+  * Remove from a chunk ID set all the chunk IDs that are in another
+  * one (for example, to compute the chunks a peer lacks). The order
+  * (priority) of the remaining chunk IDs is preserved.
+  *
+  * @param h a pointer to the set to be modified
+  * @param a a pointer to the set containing the chunk IDs to be removed
+  * @return the number of chunk IDs remaining in h, < 0 on error
+  */
+int chunkID_set_difference(struct chunkID_set *h, const struct chunkID_set *a);
+
+ /**
+  * Count the chunk IDs of a set that are not in another one
+  *
+  * @param h a pointer to a set
+  * @param a a pointer to another set
+  * @return the number of chunk IDs that are in h but not in a
+  */
+int chunkID_set_count_difference(const struct chunkID_set *h, const struct chunkID_set *a);
+
  /**
   * Clear a set
   * 
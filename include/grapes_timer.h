@@ -0,0 +1,70 @@
+#ifndef GRAPES_TIMER_H
+#define GRAPES_TIMER_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/**
+ * @file grapes_timer.h
+ *
+ * @brief Deadlines of the periodic protocols.
+ *
+ * The gossiping protocols (the peer samplers and the topology manager)
+ * send their messages periodically, when their parse function is invoked;
+ * each protocol instance registers a timer, and sets it to the time of its
+ * next transmission. The application can use grapes_timer_next() to know
+ * how long it can wait for incoming data (for example, using wait4data())
+ * before one of the protocols has to be invoked with no data, instead of
+ * polling them.
+ *
+ * The timers of all the protocol instances are kept in a single timer
+ * wheel; as the rest of the library, these functions are not thread safe.
+ */
+
+/**
+ * Structure describing a timer. This is an opaque type.
+ */
+struct grapes_timer;
+
+/**
+ * Get the current time.
+ *
+ * @return the current time (as returned by gettimeofday()), in us
+ */
+uint64_t grapes_timer_now(void);
+
+/**
+ * Register a new timer. The timer is not armed.
+ *
+ * @return a pointer to the new timer in case of success, NULL otherwise
+ */
+struct grapes_timer *grapes_timer_new(void);
+
+/**
+ * Unregister a timer, and free it.
+ *
+ * @param t a pointer to the timer
+ */
+void grapes_timer_free(struct grapes_timer *t);
+
+/**
+ * Set the expiration time of a timer.
+ *
+ * @param t a pointer to the timer
+ * @param deadline the expiration time, in us (as returned by
+ *        grapes_timer_now()); 0 disarms the timer
+ */
+void grapes_timer_set(struct grapes_timer *t, uint64_t deadline);
+
+/**
+ * Get the time until the first expiration of the armed timers.
+ *
+ * @param now the current time (NULL to read it with gettimeofday())
+ * @param tout the time until the first deadline is stored here (0 if a
+ *        deadline already passed)
+ * @return 1 if some timer is armed, 0 if no timer is armed (tout is not
+ *         modified)
+ */
+int grapes_timer_next(const struct timeval *now, struct timeval *tout);
+
+#endif	/* GRAPES_TIMER_H */
@@ -44,4 +44,46 @@ static inline uint16_t int16_rcpy(const uint8_t *p)
   return tmp;
 }
 
+/* Variable length (LEB128) coding of unsigned integers */
+static inline int varint_len(uint32_t v)
+{
+  int len = 1;
+
+  while (v >= 0x80) {
+    v >>= 7;
+    len++;
+  }
+
+  return len;
+}
+
+static inline int varint_cpy(uint8_t *p, uint32_t v)
+{
+  int len = 0;
+
+  while (v >= 0x80) {
+    p[len++] = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  p[len++] = v;
+
+  return len;
+}
+
+/* Returns the number of bytes read, or < 0 if p does not contain a valid varint */
+static inline int varint_rcpy(const uint8_t *p, int max, uint32_t *v)
+{
+  int len = 0;
+
+  *v = 0;
+  while (len < max && len < 5) {
+    *v |= (uint32_t)(p[len] & 0x7F) << (7 * len);
+    if ((p[len++] & 0x80) == 0) {
+      return len;
+    }
+  }
+
+  return -1;
+}
+
 #endif	/* INT_CODING */
@@ -48,6 +48,15 @@ int nodeid_equal(const struct nodeID *s1, const struct nodeID *s2);
 */
 int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2);
 
+/**
+* @brief Compute a hash value for a node.
+* Identical nodes (see #nodeid_equal) have the same hash value, so this
+* can be used for building hash tables indexed by nodeID.
+* @param[in] s The nodeID to be hashed.
+* @return the hash value.
+*/
+uint32_t nodeid_hash(const struct nodeID *s);
+
 /**
 * @brief Create a new nodeID.
 *
@@ -74,6 +83,13 @@ void nodeid_free(struct nodeID *s);
 * @param[in] port The port to be associated to the caller.
 * @param[in] config Additional configuration options.
 * @return A pointer to a nodeID representing the caller, initialized with all the necessary data.
+*
+* The UDP net helper understands the following options, controlling the
+* reassembly of fragmented messages: "reasm_timeout" (maximum time, in ms,
+* to wait for the missing fragments of a message), "reasm_mem" (maximum
+* amount of memory, in bytes, used for messages being reassembled) and
+* "reasm_inflight" (maximum number of messages being reassembled for each
+* sender).
 */
 struct nodeID *net_helper_init(const char *IPaddr, int port,const char *config);
 
@@ -100,10 +116,35 @@ void bind_msg_type(uint8_t msgtype);
 */
 int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size);
 
+/**
+* Maximum number of buffers that can be passed to send_to_peer_iov().
+*/
+#define NH_IOV_MAX 16
+
+struct iovec;
+
+/**
+* @brief Send data from many buffers to a remote peer.
+*
+* Like send_to_peer(), but the message is the concatenation of the
+* buffers described by iov (scatter/gather I/O). The buffers are passed
+* to the kernel without being copied in a temporary buffer, and the
+* remote peer receives the message as if it was sent by send_to_peer().
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to A pointer to the nodeID representing the remote peer.
+* @param[in] iov An array of buffers containing the data to be sent.
+* @param[in] iovcnt The number of entries in iov (at most NH_IOV_MAX).
+* @return The number of bytes sent or -1 if some error occurred.
+*/
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *iov, int iovcnt);
+
 /**
 * @brief Receive data from a remote peer.
 *
 * This function transparently handles the receiving routines.
+* Large messages are sent in more fragments, which can be interleaved with
+* other messages: the fragments are reassembled, and the function returns
+* only when a whole message has been received.
 * @param[in] local A pointer to the nodeID representing the caller.
 * @param[out] remote The address to a pointer that has to be set to a new nodeID representing the sender peer.
 * @param[out] buffer_ptr A pointer to the buffer containing the received data.
@@ -112,6 +153,80 @@ int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8
 */
 int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size);
 
+/**
+* @brief Statistics about the messages received from a peer.
+*/
+struct nh_frag_stats {
+  unsigned int datagrams;	/**< Number of received datagrams (fragments or whole messages) */
+  unsigned int msgs;		/**< Number of received messages */
+  unsigned int reassembled;	/**< Number of received messages composed by more fragments */
+  unsigned int dup_frags;	/**< Number of duplicated fragments */
+  unsigned int lost;		/**< Number of incomplete messages dropped (timeout or memory limits) */
+  unsigned int pending;		/**< Number of messages currently being reassembled */
+};
+
+/**
+* @brief Get the reception statistics of a peer.
+*
+* The statistics of a peer are dropped when nothing is received from it
+* for some time (10 reassembly timeouts).
+*
+* @param[in] remote A pointer to the nodeID representing the remote peer.
+* @param[out] stats The statistics of the messages received from remote.
+* @return 0 on success, -1 if nothing has been received from remote recently.
+*/
+int nh_frag_stats_get(const struct nodeID *remote, struct nh_frag_stats *stats);
+
+/**
+* @brief Descriptor of a message handled by the batched I/O functions.
+*/
+struct nh_msg {
+  struct nodeID *remote;	/**< Sender of the message (allocated by recv_from_peer_batch(), to be freed with nodeid_free()) */
+  uint8_t *buff;		/**< Buffer containing the message */
+  int len;			/**< In: size of buff; out: number of received bytes */
+};
+
+/**
+* @brief Queue data for a remote peer.
+*
+* Similar to send_to_peer(), but the message is copied in an internal
+* queue and transmitted (together with the other queued messages) by
+* send_queue_flush(). The queue is automatically flushed when it is full
+* or when messages from a different local node are queued.
+* The wire format is the same used by send_to_peer().
+* @param[in] from A pointer to the nodeID representing the caller.
+* @param[in] to A pointer to the nodeID representing the remote peer.
+* @param[in] buffer_ptr A pointer to the buffer containing the data to be sent.
+* @param[in] buffer_size The length of the data buffer.
+* @return The number of bytes queued or -1 if some error occurred.
+*/
+int send_to_peer_queued(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size);
+
+/**
+* @brief Send all the queued messages.
+*
+* Transmit the messages queued by send_to_peer_queued() using as few
+* system calls as possible.
+* @param[in] from A pointer to the nodeID representing the caller.
+* @return The number of datagrams sent or -1 if some error occurred.
+*/
+int send_queue_flush(const struct nodeID *from);
+
+/**
+* @brief Receive many messages at once.
+*
+* Wait until at least one message is available, and then receive up to n
+* messages without blocking further. Messages are returned in msgs[0]...
+* msgs[ret - 1]; note that the buffers can be swapped among the
+* entries of msgs, so the caller should not assume msgs[i].buff to be
+* unchanged.
+* @param[in] local A pointer to the nodeID representing the caller.
+* @param[in,out] msgs An array of n message descriptors, with buff and len set to the receive buffers.
+* @param[in] n The number of entries in msgs.
+* @return The number of received messages or -1 if some error occurred (always on Windows).
+*/
+int recv_from_peer_batch(const struct nodeID *local, struct nh_msg *msgs, int n);
+
 
 /**
 * @brief Check for newly arrived data.
@@ -121,9 +236,74 @@ int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *
 * @param[in] tout A pointer to a timer to be used to set the waiting timeout.
 * @param[in] user_fds A "-1 terminated" array of FDs to be monitored.
 * @return 1 if some data has arrived, 0 otherwise.
+*
+* When 2 is returned, the FDs in user_fds which are not ready are
+* replaced by -2. The array can be passed again as it is: the -2 entries
+* stand for the FDs previously stored in the same positions, which are
+* still monitored (and restored in the array if they become ready).
+*
+* This is implemented on top of the nh_poll functions: the set of
+* monitored FDs is rebuilt only when the content of user_fds (ignoring
+* the -2 entries) changes between two calls.
 */
 int wait4data(const struct nodeID *n, struct timeval *tout, int *user_fds);
 
+#define NH_POLL_LEVEL 0	/**< Level-triggered readiness notification */
+#define NH_POLL_EDGE 1	/**< Edge-triggered readiness notification */
+
+/**
+* Opaque set of FDs monitored for readiness.
+*/
+struct nh_poll;
+
+/**
+* @brief Create a set of monitored FDs.
+*
+* Create a persistent set of FDs to be monitored for incoming data
+* (based on epoll, where available).
+* @param[in] n A pointer to the nodeID whose socket has to be monitored (can be NULL).
+* @param[in] mode NH_POLL_LEVEL or NH_POLL_EDGE (edge-triggered mode is not available on all systems, and falls back to level-triggered).
+* @return A pointer to the new set, or NULL on error (always on Windows).
+*/
+struct nh_poll *nh_poll_init(const struct nodeID *n, int mode);
+
+/**
+* @brief Add an FD to a set of monitored FDs.
+*
+* @param[in] p A pointer to the set.
+* @param[in] fd The FD to be added.
+* @return 1 if the FD has been added, 0 if it was already in the set, -1 on error.
+*/
+int nh_poll_add(struct nh_poll *p, int fd);
+
+/**
+* @brief Remove an FD from a set of monitored FDs.
+*
+* @param[in] p A pointer to the set.
+* @param[in] fd The FD to be removed.
+* @return 1 if the FD has been removed, 0 if it was not in the set, -1 on error.
+*/
+int nh_poll_del(struct nh_poll *p, int fd);
+
+/**
+* @brief Wait for some of the monitored FDs to be ready.
+*
+* @param[in] p A pointer to the set.
+* @param[in,out] tout Maximum waiting time (NULL to wait forever); updated with the remaining time.
+* @param[out] node_ready Set to 1 if the nodeID socket is ready, 0 otherwise.
+* @param[out] ready_fds Array where the ready user FDs are stored.
+* @param[in,out] ready_len In: size of ready_fds; out: number of ready user FDs.
+* @return The number of ready FDs (including the nodeID socket), 0 if the timeout expired, -1 on error.
+*/
+int nh_poll_wait(struct nh_poll *p, struct timeval *tout, int *node_ready, int *ready_fds, int *ready_len);
+
+/**
+* @brief Destroy a set of monitored FDs.
+*
+* @param[in] p A pointer to the set.
+*/
+void nh_poll_destroy(struct nh_poll *p);
+
 /**
 * @brief Give a string representation of a nodeID.
 *
@@ -139,12 +319,27 @@ int node_addr(const struct nodeID *s, char *addr, int len);
 * @brief Create a nodeID structure from a serialized object.
 *
 * Read from a properly filled byte array (@see #nodeid_dump) and build a new nodeID from its serialized representation in the buffer.
+* Both the format generated by nodeid_dump() and the one generated by
+* nodeid_dump_compact() are accepted.
 * @param[in] b A pointer to the byte array containing the data to be used.
 * @param[in] len The number of bytes to be read from the buffer to build the new nodeID.
 * @return A pointer to the new nodeID.
 */
 struct nodeID *nodeid_undump(const uint8_t *b, int *len);
 
+/**
+* @brief Create a nodeID structure from a serialized object, reusing an existing nodeID.
+*
+* Like nodeid_undump(), but the nodeID is built in s, if it is not NULL,
+* instead of being allocated (so that a set of nodeIDs can be reused for
+* decoding different messages).
+* @param[in] s The nodeID to be reused (if NULL, a new nodeID is allocated).
+* @param[in] b A pointer to the byte array containing the data to be used.
+* @param[in] len The number of bytes to be read from the buffer to build the new nodeID.
+* @return s (or the new nodeID), or NULL in case of error (s is not modified).
+*/
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len);
+
 /**
 * @brief Serialize a nodeID in a byte array.
 *
@@ -156,6 +351,28 @@ struct nodeID *nodeid_undump(const uint8_t *b, int *len);
 */
 int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size);
 
+/**
+* @brief Serialize a nodeID in a compact, versioned format.
+*
+* Like nodeid_dump(), but only the address family, the address and the
+* port are serialized (7 bytes for IPv4 and 19 bytes for IPv6 nodes).
+* Peers running older versions cannot decode this format, so it should
+* only be sent to peers known to understand it.
+* @param[in] b A pointer to the byte array that will contain the nodeID serialization.
+* @param[in] s A pointer to the nodeID to be serialized.
+* @param[in] max_write_size A number of bytes available in b
+* @return The number of bytes written in the buffer, or -1 if error
+*/
+int nodeid_dump_compact(uint8_t *b, const struct nodeID *s, size_t max_write_size);
+
+/**
+* @brief Check the format of a serialized nodeID.
+*
+* @param[in] b A pointer to a nodeID serialized by nodeid_dump() or nodeid_dump_compact().
+* @return 1 if the nodeID has been serialized by nodeid_dump_compact(), 0 otherwise.
+*/
+int nodeid_is_compact(const uint8_t *b);
+
 /**
 * @brief Give a string representation of the public IP belonging to the nodeID.
 *
@@ -161,6 +161,9 @@ int psample_add_peer(struct psample_context *tc, struct nodeID *neighbour, const
   been received from the network. The Peer Sampler will parse
   such packet and run the protocol, adding or removing peers to the
   cache, and sending peer sampling messages to other peers.
+  The function must also be invoked with len = 0 when no packets are
+  received, so that messages can be sent periodically; grapes_timer_next()
+  returns the time of the next transmission.
   @param tc the pointer to the current topology manager instance context
   @param buff a memory buffer containing the received message.
   @param len the size of such a memory buffer.
@@ -0,0 +1,65 @@
+#ifndef RCBUF_H
+#define RCBUF_H
+
+#include <stdint.h>
+
+/**
+ * @file rcbuf.h
+ *
+ * @brief Reference counted buffers.
+ *
+ * A reference counted buffer can be shared by different modules without
+ * copying its content: for example, a message can be received in such a
+ * buffer, and the chunk decoded from it (see decodeChunkRef()) can be
+ * stored in the chunk buffer (see cb_add_chunk_ref()) without copying the
+ * chunk payload. The buffer is freed when the last reference is released.
+ */
+
+/**
+ * Structure describing a reference counted buffer. This is an opaque type.
+ */
+struct rcbuf;
+
+/**
+ * Allocate a reference counted buffer.
+ *
+ * @param size the size of the buffer, in bytes
+ * @return a pointer to the new buffer (with one reference, owned by the
+ *         caller) in case of success, NULL otherwise
+ */
+struct rcbuf *rcbuf_new(int size);
+
+/**
+ * Get the content of a reference counted buffer.
+ *
+ * @param b a pointer to the buffer
+ * @return a pointer to the first byte of the buffer
+ */
+uint8_t *rcbuf_data(struct rcbuf *b);
+
+/**
+ * Get the size of a reference counted buffer.
+ *
+ * @param b a pointer to the buffer
+ * @return the size of the buffer, in bytes
+ */
+int rcbuf_size(const struct rcbuf *b);
+
+/**
+ * Acquire a new reference to a buffer.
+ *
+ * @param b a pointer to the buffer
+ * @return b
+ */
+struct rcbuf *rcbuf_ref(struct rcbuf *b);
+
+/**
+ * Release a reference to a buffer.
+ *
+ * The buffer is freed when its last reference is released.
+ *
+ * @param b a pointer to the buffer
+ */
+void rcbuf_unref(struct rcbuf *b);
+
+#endif	/* RCBUF_H */
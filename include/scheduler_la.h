@@ -15,6 +15,7 @@
 	-# ordering method: two kinds of ordering methods are supported:
 		-# Best: strict ordering accorging to the given evaluator functions
 		-# Weighted: Weighted random selection accorging to the given weight functions
+		   (SCHED_WEIGHTED_TREE gives the same selection as SCHED_WEIGHTED, in O(n + s log n) time for selecting s of n items)
 	-# filter functions: selections are typically filtered by functions such as whether a given peer (according to local knowledge) needs a given chunk.
 		The abstraction of the filter concept allows for easy modification of these filter conditions.
 */
@@ -22,7 +23,7 @@
 /**
   * Scheduler ordering methods
   */
-typedef enum {SCHED_BEST,SCHED_WEIGHTED} SchedOrdering;
+typedef enum {SCHED_BEST,SCHED_WEIGHTED,SCHED_WEIGHTED_TREE} SchedOrdering;
 
 /**
   * @brief Prototype for filter functions that select useful peer-chunk combinations
@@ -53,6 +54,31 @@ typedef double (*pairEvaluateFunction)(struct PeerChunk*);
   */
 typedef double (*double2op)(double,double);
 
+/**
+  * @brief Filter function receiving user data (see the *Ctx() scheduler functions)
+  */
+typedef int (*filterUserFunction)(schedPeerID, schedChunkID, void *user);
+
+/**
+  * @brief Peer evaluator function receiving user data
+  */
+typedef double (*peerEvaluateUserFunction)(schedPeerID*, void *user);
+
+/**
+  * @brief Chunk evaluator function receiving user data
+  */
+typedef double (*chunkEvaluateUserFunction)(schedChunkID*, void *user);
+
+/**
+  * @brief Peer-chunk pair evaluator function receiving user data
+  */
+typedef double (*pairEvaluateUserFunction)(struct PeerChunk*, void *user);
+
+/**
+  * @brief Generic evaluator function receiving user data
+  */
+typedef double (*evaluateUserFunction)(void*, void *user);
+
 
 
 /**
@@ -140,6 +166,14 @@ void schedSelectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_
                      filterFunction filter,
                      peerEvaluateFunction evaluate);
 
+/**
+  * @brief Select at most selected_len chunks, among those where filter is true with at least one of the peers.
+  */
+void schedSelectChunksForPeers(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
+                     schedChunkID *selected, size_t *selected_len,       //out, inout
+                     filterFunction filter,
+                     chunkEvaluateFunction evaluate);
+
 /*---Hybrid----------------*/
 
 /**
@@ -154,6 +188,87 @@ void schedSelectHybrid(SchedOrdering ordering, schedPeerID  *peers, size_t peers
                      pairEvaluateFunction pairevaluate);
 
 
+/*---Contexts----------------*/
+
+/**
+  * Opaque data type representing a scheduler context
+  */
+struct sched_ctx;
+
+/**
+  * @brief Allocate a scheduler context.
+
+  A context owns the scratch memory used by the selection functions (the
+  lists of candidates and their weights), which is allocated on the heap
+  and reused by all the invocations using the context. The *Ctx() variants
+  of the scheduler functions take a context as first argument (NULL to
+  use a temporary one), and evaluator and filter functions receiving the
+  user pointer passed as last argument, so that no global state is needed.
+  A context must not be used by two threads at the same time, but
+  different threads can use different contexts.
+  @param [in] config configuration string: "size" is the amount of memory
+         (in bytes) to preallocate, and "max_size" the maximum amount of
+         memory to use (if more memory is needed, nothing is selected).
+         If "seed" is present, the random choices use a generator private
+         to the context, initialized with the given seed, instead of
+         rand().
+  @return the context, or NULL on error
+  */
+struct sched_ctx *schedCtxInit(const char *config);
+
+/**
+  * @brief Free a scheduler context and its scratch memory.
+  */
+void schedCtxFree(struct sched_ctx *ctx);
+
+/**
+  * @brief Same as schedSelectPeerFirst(), using the given context.
+  */
+void schedSelectPeerFirstCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID  *peers, size_t peers_len, schedChunkID  *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, void *user);
+
+/**
+  * @brief Same as schedSelectChunkFirst(), using the given context.
+  */
+void schedSelectChunkFirstCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID  *peers, size_t peers_len, schedChunkID  *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, void *user);
+
+/**
+  * @brief Same as schedSelectComposed(), using the given context.
+  */
+void schedSelectComposedCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID  *peers, size_t peers_len, schedChunkID  *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, double2op weightcombine, void *user);
+
+/**
+  * @brief Same as schedSelectPeersForChunks(), using the given context.
+  */
+void schedSelectPeersForChunksCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
+                     schedPeerID *selected, size_t *selected_len,       //out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction evaluate, void *user);
+
+/**
+  * @brief Same as schedSelectChunksForPeers(), using the given context.
+  */
+void schedSelectChunksForPeersCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
+                     schedChunkID *selected, size_t *selected_len,       //out, inout
+                     filterUserFunction filter,
+                     chunkEvaluateUserFunction evaluate, void *user);
+
+/**
+  * @brief Same as schedSelectHybrid(), using the given context.
+  */
+void schedSelectHybridCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID  *peers, size_t peers_len, schedChunkID  *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     pairEvaluateUserFunction pairevaluate, void *user);
+
 /*---selector function----------------*/
 /**
   * casted evaluator for generic use in generic selector functions
@@ -165,4 +280,9 @@ typedef double (*evaluateFunction)(void*);
   */
 void selectWithOrdering(SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, double(*evaluate)(void *), unsigned char *selected,size_t *selected_len);
 
+/**
+  * Select best N of K with the given ordering method, using the given context
+  */
+void selectWithOrderingCtx(struct sched_ctx *ctx, SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, evaluateUserFunction evaluate, unsigned char *selected,size_t *selected_len, void *user);
+
 #endif /* SCHEDULER_LA_H */
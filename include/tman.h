@@ -22,6 +22,20 @@
 */
 typedef int (*tmanRankingFunction)(const void *target, const void *p1, const void *p2);
 
+/**
+  @brief Compute the distance of a neighbor from a target.
+
+  The functions implementing this prototype may be used instead of a
+  tmanRankingFunction when the rank of a neighbor only depends on its own
+  features: each neighbor is scored once, and the neighbors are ordered by
+  increasing score.
+
+  @param target pointer to data that describe the target against which the ranking has to be made.
+  @param p pointer to data that describe the neighbor.
+  @return the distance of the neighbor from the target (the nearest neighbors are ranked first).
+*/
+typedef double (*tmanScoringFunction)(const void *target, const void *p);
+
 /**
   @brief Initialise the Topology Manager.
 
@@ -36,6 +50,19 @@ typedef int (*tmanRankingFunction)(const void *target, const void *p1, const voi
 */
 int tmanInit(struct nodeID *myID, void *metadata, int metadata_size, tmanRankingFunction rfun, const char *config); 
 
+/**
+  @brief Set a scoring function.
+
+  This function sets the scoring function used to rank the peers in the
+  Topology Manager cache; the ranking function passed to tmanInit() is
+  still used when a single peer is added, and for all the rankings if
+  no scoring function is set.
+
+  @param sfun Scoring function (NULL to rank the peers with the ranking function only).
+  @return 0 in case of success; -1 in case of error.
+*/
+int tmanSetScoringFunction(tmanScoringFunction sfun);
+
 
 /**
   @brief Insert a peer in the neighbourhood.
@@ -56,6 +83,9 @@ int tmanAddNeighbour(struct nodeID *neighbour, void *metadata, int metadata_size
   been received from the network. The Topology Manager will parse
   such packet and run the protocol, adding or removing peers to the
   neighbourhood, and sending overlay management messages to other peers.
+  The function must also be invoked with len = 0 when no packets are
+  received, so that messages can be sent periodically; grapes_timer_next()
+  returns the time of the next transmission.
   @param buff a memory buffer containing the received message.
   @param len the size of such a memory buffer.
   @param peers Array of nodeID pointers to be added in Topology Manager cache.
@@ -28,6 +28,20 @@
  */
 int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid);
 
+/**
+ * @brief Parse an incoming chunk message without copying the chunk payload.
+ *
+ * Like parseChunkMsg(), but the chunk is decoded with decodeChunkRef(), so
+ * its data and attributes point inside buff.
+ *
+ * @param[in] buff containing the incoming message.
+ * @param[in] buff_len length of the buffer.
+ * @param[out] c the chunk filled with data (an already allocated chunk structure must be passed!).
+ * @param[out] transid the transaction ID.
+ * @return 1 on success, <0 on error.
+ */
+int parseChunkMsgRef(uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid);
+
 /**
   * @brief Send a Chunk to a target Peer
   *
@@ -32,6 +32,21 @@
   */
 int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len);
 
+/**
+  * @brief Encode the header of a chunk.
+  *
+  * Encode only the first CHUNK_HEADER_SIZE bytes of the bit stream generated
+  * by encodeChunk(): the encoded chunk is composed by this header, followed
+  * by the chunk data and attributes. This allows to send a chunk without
+  * copying its payload (see sendChunk()).
+  *
+  * @param[in] c Chunk to send
+  * @param[in] buff Buffer that will be filled with the encoded header
+  * @param[in] buff_len length of the buffer (at least CHUNK_HEADER_SIZE bytes)
+  * @return the lenght of the encoded header (in bytes) on success, <0 on error
+  */
+int encodeChunkHeader(const struct chunk *c, uint8_t *buff, int buff_len);
+
 /**
   * @brief Decode the bit stream.
   *
@@ -43,3 +58,19 @@ int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len);
   * @return 0 on success, <0 on error
   */
 int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len);
+
+/**
+  * @brief Decode the bit stream without copying the chunk payload.
+  *
+  * Like decodeChunk(), but the data and attributes of the chunk point
+  * inside buff instead of being allocated: the chunk is valid only as long
+  * as buff is, and its data and attributes must not be freed. If buff is
+  * the content of a reference counted buffer (see rcbuf.h), the chunk can
+  * be inserted in a chunk buffer with cb_add_chunk_ref().
+  *
+  * @param[in] c Chunks that has been transmitted
+  * @param[in] buff Buffer which contain the bit stream to decode, filling the above parameters
+  * @param[in] buff_len length of the buffer that contain the bit stream
+  * @return the length of the decoded bitstream (in bytes) on success, <0 on error
+  */
+int decodeChunkRef(struct chunk *c, uint8_t *buff, int buff_len);
@@ -32,6 +32,18 @@ enum signaling_type {
  */
 int chunkSignalingInit(struct nodeID *myID);
 
+/**
+ * @brief Select the encoding of the nodeIDs sent in signaling messages.
+ *
+ * By default, the owner nodeID is serialized with nodeid_dump(); if the
+ * compact encoding is enabled, nodeid_dump_compact() is used instead.
+ * Received messages are always accepted in both formats, so the compact
+ * encoding can be enabled as soon as all the peers are able to decode it.
+ *
+ * @param[in] enable 1 to use the compact encoding, 0 to use the legacy one.
+ */
+void chunkSignalingCompactIDs(int enable);
+
 /**
  * @brief Parse an incoming signaling message, providing the signal type and the information of the signaling message.
  *
@@ -50,6 +62,26 @@ int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
                    struct chunkID_set **cset, int *max_deliver, uint16_t *trans_id,
                    enum signaling_type *sig_type);
 
+/**
+ * @brief Parse an incoming signaling message into an existing chunk ID set.
+ *
+ * Like parseSignaling(), but the chunk IDs are stored in a set provided
+ * by the caller (see decodeChunkSignalingInto()), so that no memory is
+ * allocated (apart from the owner ID, if requested).
+ *
+ * @param[in] buff containing the incoming message.
+ * @param[in] buff_len length of the buffer.
+ * @param[out] owner_id identifier of the node on which refer the message just received (can be NULL if not needed).
+ * @param[out] cset set where the received chunk IDs are stored (emptied if the message does not contain chunk IDs).
+ * @param[out] max_deliver deliver at most this number of Chunks.
+ * @param[out] trans_id transaction number associated with this message.
+ * @param[out] sig_type Type of signaling message.
+ * @return 1 on success, <0 on error.
+ */
+int parseSignalingInto(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
+                       struct chunkID_set *cset, int *max_deliver, uint16_t *trans_id,
+                       enum signaling_type *sig_type);
+
 /**
  * @brief Request a set of chunks from a Peer.
  *
@@ -91,6 +123,22 @@ int deliverChunks(const struct nodeID *localID, const struct nodeID *to, struct
  */
 int offerChunks(const struct nodeID *localID, const struct nodeID *to, struct chunkID_set *cset, int max_deliver, uint16_t trans_id);
 
+/**
+ * @brief Offer a (sub)set of chunks to many Peers.
+ *
+ * Like offerChunks(), but the same offer is sent to n peers. The message
+ * is encoded only once, and the messages are sent together (see
+ * send_to_peer_queued()).
+ *
+ * @param[in] to array of n target peers.
+ * @param[in] n number of target peers.
+ * @param[in] cset array of ChunkIDs.
+ * @param[in] max_deliver deliver at most this number of Chunks.
+ * @param[in] trans_id array of n transaction numbers (one for each target peer).
+ * @return the number of peers the offer has been sent to, <0 on error.
+ */
+int offerChunksMulti(const struct nodeID *localID, struct nodeID **to, int n, struct chunkID_set *cset, int max_deliver, const uint16_t *trans_id);
+
 /**
  * @brief Accept a (sub)set of chunks from a Peer.
  *
@@ -118,6 +166,55 @@ int acceptChunks(const struct nodeID *localID, const struct nodeID *to, struct c
  */
 int sendBufferMap(const struct nodeID *localID, const struct nodeID *to, const struct nodeID *owner, struct chunkID_set *bmap, int cb_size, uint16_t trans_id);
 
+/**
+ * @brief Send a BufferMap to many Peers.
+ *
+ * Like sendBufferMap(), but the same BufferMap is sent to n peers. The
+ * message is encoded only once, and the messages are sent together (see
+ * send_to_peer_queued()).
+ *
+ * @param[in] to array of n PeerIDs.
+ * @param[in] n number of PeerIDs.
+ * @param[in] owner Owner of the BufferMap to send.
+ * @param[in] bmap the BufferMap to send.
+ * @param[in] cb_size the size of the chunk buffer (not the size of the buffer map sent, but that of the chunk buffer).
+ * @param[in] trans_id array of n transaction numbers (one for each PeerID).
+ * @return the number of peers the BufferMap has been sent to, <0 on error.
+ */
+int sendBufferMapMulti(const struct nodeID *localID, struct nodeID **to, int n, const struct nodeID *owner, struct chunkID_set *bmap, int cb_size, const uint16_t *trans_id);
+
+/**
+ * @brief Send our own BufferMap to a Peer, as a difference from the previous one.
+ *
+ * Like sendBufferMap() (with owner = localID), but only the chunks added
+ * since the last BufferMap sent to the same peer are transmitted, together
+ * with the smallest chunk ID in the map (the chunks below it are removed).
+ * A full BufferMap is sent when the map cannot be represented in this way,
+ * periodically, and when the peer requests it (this happens automatically
+ * when the peer misses a BufferMap, if it called chunkSignalingInit() with
+ * its ID). The receiver's parseSignaling() rebuilds the full BufferMap, and
+ * reports it as sig_send_buffermap; it keeps the BufferMaps of a limited
+ * number of peers, and ignores the differences until it receives a full
+ * BufferMap from a peer.
+ *
+ * @param[in] to PeerID.
+ * @param[in] bmap the BufferMap to send.
+ * @param[in] cb_size the size of the chunk buffer (not the size of the buffer map sent, but that of the chunk buffer).
+ * @param[in] trans_id transaction number associated with this send.
+ * @return 1 Success, <0 on error.
+ */
+int sendBufferMapDelta(const struct nodeID *localID, const struct nodeID *to, struct chunkID_set *bmap, int cb_size, uint16_t trans_id);
+
+/**
+ * @brief Forget the BufferMaps exchanged with a Peer.
+ *
+ * Release the state used by sendBufferMapDelta() for a peer (for example,
+ * when it leaves the neighbourhood).
+ *
+ * @param[in] peer PeerID.
+ */
+void forgetBufferMaps(const struct nodeID *peer);
+
 /**
  * @brief Request a BufferMap to a Peer.
  *
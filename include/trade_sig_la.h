@@ -38,5 +38,26 @@ int encodeChunkSignaling(const struct chunkID_set *h, const void *meta, int meta
   */
 struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8_t *buff, int buff_len);
 
+/**
+  * @brief Decode the bit stream into an existing chunk ID set.
+  *
+  * Like decodeChunkSignaling(), but without allocating memory: the chunk
+  * IDs are stored in a set provided by the caller (which is emptied, and
+  * can be reused for decoding many messages), and the metadata are not
+  * copied.
+  *
+  * @param[in] h the chunk ID set where the decoded chunk IDs are stored;
+  *              if the received set is not sorted, or h is not, h is
+  *              switched to the implementation of the received set
+  * @param[out] meta pointer to the metadata, inside buff (NULL if there
+  *                  are no metadata)
+  * @param[out] meta_len length of the metadata
+  * @param[in] buff Buffer which contain the bit stream to decode
+  * @param[in] buff_len length of the buffer that contain the bit stream
+  * @return 1 if a chunk ID set has been decoded, 0 if the bit stream does
+  *         not contain a chunk ID set (h is emptied), < 0 on error
+  */
+int decodeChunkSignalingInto(struct chunkID_set *h, const uint8_t **meta, int *meta_len, const uint8_t *buff, int buff_len);
+
 
 #endif /* TRADE_SIG_LA_H */
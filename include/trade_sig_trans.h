@@ -0,0 +1,157 @@
+/** @file trade_sig_trans.h
+ *
+ * @brief Chunk Signaling Transactions.
+ *
+ * A transaction table keeps track of the signaling messages which are
+ * waiting for a reply (offers, requests and buffer map requests), indexed
+ * by peer and transaction ID. Incoming replies (accepts, deliveries and
+ * buffer maps) are matched with the pending transactions, so that stale
+ * replies can be recognised, and the round trip times and timeouts of
+ * each peer are measured. The table also knows which chunks have been
+ * offered or requested and are still waiting for a reply, so that they
+ * are not requested again.
+ *
+ */
+
+#ifndef TRADE_SIG_TRANS_H
+#define TRADE_SIG_TRANS_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "chunkidset.h"
+#include "trade_sig_ha.h"
+
+/**
+ * Opaque data type representing a transaction table.
+ */
+struct sig_trans_table;
+
+/**
+ * Per-peer transaction statistics.
+ */
+struct sig_trans_stats {
+  int outstanding;		/**< Number of transactions waiting for a reply */
+  unsigned int completed;	/**< Number of transactions matched with a reply */
+  unsigned int timeouts;	/**< Number of expired transactions */
+  unsigned int chunks_sent;	/**< Chunk IDs in the offers and requests sent to the peer */
+  unsigned int chunks_replied;	/**< Chunk IDs in the replies (accepted or delivered chunks) */
+  int last_rtt;			/**< Last RTT sample (in us), -1 if no samples are available */
+  int srtt;			/**< Smoothed RTT (in us) */
+  int rttvar;			/**< RTT variation (in us) */
+};
+
+/**
+ * Descriptor of an expired transaction.
+ */
+struct sig_trans_timeout {
+  const struct nodeID *peer;	/**< Peer the message was sent to (valid until sig_trans_forget() or sig_trans_destroy() are invoked) */
+  uint16_t trans_id;		/**< Transaction ID */
+  enum signaling_type type;	/**< Type of the message (sig_offer, sig_request or sig_request_buffermap) */
+};
+
+/**
+ * @brief Allocate a transaction table.
+ *
+ * @param config a configuration string containing tags which describe the
+ *               table: "timeout" is the time (in ms) after which a
+ *               transaction expires (default 1000), "tick" the resolution
+ *               (in ms) of the expiration timer (default 10), and "size"
+ *               the expected number of pending transactions.
+ * @return the pointer to the new table on success, NULL on error.
+ */
+struct sig_trans_table *sig_trans_init(const char *config);
+
+/**
+ * @brief Free a transaction table and all the associated memory.
+ *
+ * @param t the table.
+ */
+void sig_trans_destroy(struct sig_trans_table *t);
+
+/**
+ * @brief Record a message waiting for a reply.
+ *
+ * If a transaction with the same peer and ID is already pending, it is
+ * replaced.
+ *
+ * @param t the table.
+ * @param peer the peer the message has been sent to.
+ * @param trans_id the transaction ID of the message.
+ * @param type the type of the message: sig_offer, sig_request or sig_request_buffermap.
+ * @param cset the chunk IDs offered or requested (can be NULL).
+ * @param now the current time (NULL to read it with gettimeofday()).
+ * @return 1 on success, < 0 on error.
+ */
+int sig_trans_open(struct sig_trans_table *t, const struct nodeID *peer, uint16_t trans_id,
+                   enum signaling_type type, const struct chunkID_set *cset, const struct timeval *now);
+
+/**
+ * @brief Match a reply with a pending transaction.
+ *
+ * An accept matches an offer, a deliver matches a request, and a buffer
+ * map matches a buffer map request. The matched transaction is closed,
+ * and the RTT of the peer is updated.
+ *
+ * @param t the table.
+ * @param peer the peer the reply has been received from.
+ * @param trans_id the transaction ID of the reply.
+ * @param type the type of the reply.
+ * @param cset the chunk IDs in the reply (can be NULL).
+ * @param now the current time (NULL to read it with gettimeofday()).
+ * @param rtt if not NULL, the RTT sample (in us) is stored here.
+ * @return 1 if the reply matches a pending transaction, 0 if the reply is
+ *         stale (the transaction expired, or never existed), < 0 on error.
+ */
+int sig_trans_match(struct sig_trans_table *t, const struct nodeID *peer, uint16_t trans_id,
+                    enum signaling_type type, const struct chunkID_set *cset, const struct timeval *now,
+                    int *rtt);
+
+/**
+ * @brief Expire the transactions whose timeout elapsed.
+ *
+ * The expired transactions are closed, and returned in expired[]; if more
+ * than n transactions expired, the remaining ones are returned by the
+ * next invocation.
+ *
+ * @param t the table.
+ * @param now the current time (NULL to read it with gettimeofday()).
+ * @param expired array where the expired transactions are stored.
+ * @param n size of expired.
+ * @return the number of expired transactions stored in expired, < 0 on error.
+ */
+int sig_trans_expire(struct sig_trans_table *t, const struct timeval *now,
+                     struct sig_trans_timeout *expired, int n);
+
+/**
+ * @brief Check if a chunk has been offered or requested.
+ *
+ * @param t the table.
+ * @param chunk_id the chunk ID.
+ * @return the number of pending transactions containing chunk_id.
+ */
+int sig_trans_in_flight(const struct sig_trans_table *t, int chunk_id);
+
+/**
+ * @brief Get the transaction statistics of a peer.
+ *
+ * @param t the table.
+ * @param peer the peer.
+ * @param stats the structure where the statistics are stored.
+ * @return 0 on success, -1 if no transactions have been opened with the peer.
+ */
+int sig_trans_peer_stats(const struct sig_trans_table *t, const struct nodeID *peer,
+                         struct sig_trans_stats *stats);
+
+/**
+ * @brief Forget a peer.
+ *
+ * Close all the pending transactions with a peer, and drop its statistics.
+ *
+ * @param t the table.
+ * @param peer the peer.
+ */
+void sig_trans_forget(struct sig_trans_table *t, const struct nodeID *peer);
+
+#endif	/* TRADE_SIG_TRANS_H */
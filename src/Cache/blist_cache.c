@@ -421,6 +421,74 @@ struct peer_cache *blist_cache_rank (const struct peer_cache *c, ranking_functio
 	return res;
 }
 
+struct rank_item {
+	double score;
+	int i;
+};
+
+/* By increasing score, and by position for equal scores */
+static int rank_item_cmp(const void *p1, const void *p2)
+{
+	const struct rank_item *r1 = p1, *r2 = p2;
+
+	if (r1->score != r2->score) {
+		return r1->score < r2->score ? -1 : 1;
+	}
+
+	return r1->i - r2->i;
+}
+
+/* As blist_cache_rank(), computing the score of each entry only once */
+struct peer_cache *blist_cache_rank_scored(const struct peer_cache *c, scoring_function score, ranking_function rank, const struct nodeID *target, const void *target_meta)
+{
+	struct peer_cache *res;
+	struct rank_item *items;
+	int i, n;
+
+	if (score == NULL) {
+		return blist_cache_rank(c, rank, target, target_meta);
+	}
+
+	res = blist_cache_init(c->cache_size, c->metadata_size, c->max_timestamp);
+	if (res == NULL) {
+		return res;
+	}
+	items = malloc(sizeof(struct rank_item) * (c->current_size ? c->current_size : 1));
+	if (items == NULL) {
+		blist_cache_free(res);
+
+		return NULL;
+	}
+
+	for (i = 0, n = 0; i < c->current_size; i++) {
+		if (!target || !nodeid_equal(c->entries[i].id,target)) {
+			items[n].score = score(target_meta, c->metadata + (c->metadata_size * i));
+			items[n++].i = i;
+		}
+	}
+	qsort(items, n, sizeof(struct rank_item), rank_item_cmp);
+
+	for (res->current_size = 0; res->current_size < n; res->current_size++) {
+		int pos = res->current_size;
+
+		i = items[pos].i;
+		if (c->metadata_size) {
+			memcpy(res->metadata + pos * res->metadata_size, c->metadata + (c->metadata_size * i), res->metadata_size);
+		}
+		res->entries[pos].id = nodeid_dup(c->entries[i].id);
+		res->entries[pos].timestamp = c->entries[i].timestamp;
+		res->entries[pos].flags = c->entries[i].flags;
+	}
+	free(items);
+
+	for (i = 0; i < c->blist_size; i++) {
+		res->blist[i] = nodeid_dup(c->blist[i]);
+	}
+	res->blist_size = c->blist_size;
+
+	return res;
+}
+
 // It MUST always be called with c1 = current local_cache to ensure black_list continuity
 struct peer_cache *blist_cache_union(struct peer_cache *c1, struct peer_cache *c2, int *size) {
 	int n,pos;
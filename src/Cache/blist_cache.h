@@ -4,6 +4,7 @@
 struct peer_cache;
 struct cache_entry;
 typedef int (*ranking_function)(const void *target, const void *p1, const void *p2);	// FIXME!
+typedef double (*scoring_function)(const void *target, const void *p);	/* distance from the target */
 
 struct peer_cache *blist_cache_init(int n, int metadata_size, int max_timestamp);
 void blist_cache_free(struct peer_cache *c);
@@ -25,6 +26,7 @@ int blist_entry_dump(uint8_t *b, struct peer_cache *e, int i, size_t max_write_s
 
 struct peer_cache *blist_merge_caches(struct peer_cache *c1, struct peer_cache *c2, int newsize, int *source);
 struct peer_cache *blist_cache_rank (const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta);
+struct peer_cache *blist_cache_rank_scored(const struct peer_cache *c, scoring_function score, ranking_function rank, const struct nodeID *target, const void *target_meta);
 struct peer_cache *blist_cache_union(struct peer_cache *c1, struct peer_cache *c2, int *size);
 int blist_cache_resize (struct peer_cache *c, int size);
 
@@ -115,13 +115,13 @@ int cloudcast_payload_fill(struct cloudcast_proto_context *context, uint8_t *pay
   if (!max_peers) max_peers = MAX_MSG_SIZE; // FIXME: we should use topo_proto for this
   p += cache_header_dump(p, c, include_me);
   if (include_me) {
-    p += entry_dump(p, context->myEntry, 0, size - (p - payload));
+    p += entry_dump(p, context->myEntry, 0, size - (p - payload), 0);
     max_peers--;
   }
   for (i = 0; nodeid(c, i) && max_peers; i++) {
     if (!is_cloud_node(context->cloud_context, nodeid(c, i))) {
       int res;
-      res = entry_dump(p, c, i, size - (p - payload));
+      res = entry_dump(p, c, i, size - (p - payload), 0);
       if (res < 0) {
         fprintf(stderr, "too many entries!\n");
         return -1;
@@ -172,6 +172,11 @@ time_t cloudcast_timestamp_cloud(struct cloudcast_proto_context *context)
   return timestamp_cloud(context->cloud_context);
 }
 
+void cloudcast_proto_compact_ids(struct cloudcast_proto_context *context, int enable)
+{
+  topo_proto_compact_ids(context->topo_context, enable);
+}
+
 int cloudcast_proto_change_metadata(struct cloudcast_proto_context *context, const void *metadata, int metadata_size)
 {
   if (topo_proto_metadata_update(context->topo_context, metadata, metadata_size) <= 0) {
@@ -19,6 +19,7 @@ struct peer_cache * cloudcast_cloud_default_reply(struct peer_cache *template, s
 int cloudcast_query_cloud(struct cloudcast_proto_context *context);
 time_t cloudcast_timestamp_cloud(struct cloudcast_proto_context *context);
 
+void cloudcast_proto_compact_ids(struct cloudcast_proto_context *context, int enable);
 int cloudcast_proto_change_metadata(struct cloudcast_proto_context *context, const void *metadata, int metadata_size);
 
 struct nodeID** cloudcast_get_cloud_nodes(struct cloudcast_proto_context *context, uint8_t number);
@@ -45,6 +45,11 @@ int cyclon_query(struct cyclon_proto_context *context, const struct peer_cache *
   return topo_query_peer(context->context, sent_cache, dst, MSG_TYPE_TOPOLOGY, CYCLON_QUERY, 0);
 }
 
+void cyclon_proto_compact_ids(struct cyclon_proto_context *context, int enable)
+{
+  topo_proto_compact_ids(context->context, enable);
+}
+
 int cyclon_proto_change_metadata(struct cyclon_proto_context *context, const void *metadata, int metadata_size)
 {
   if (topo_proto_metadata_update(context->context, metadata, metadata_size) <= 0) {
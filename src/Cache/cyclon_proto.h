@@ -9,5 +9,6 @@ struct cyclon_proto_context* cyclon_proto_init(struct nodeID *s, const void *met
 int cyclon_reply(struct cyclon_proto_context *context, const struct peer_cache *c, const struct peer_cache *local_cache);
 int cyclon_query(struct cyclon_proto_context *context, const struct peer_cache *local_cache, struct nodeID *dst);
 
+void cyclon_proto_compact_ids(struct cyclon_proto_context *context, int enable);
 int cyclon_proto_change_metadata(struct cyclon_proto_context *context, const void *metadata, int metadata_size);
 #endif	/* CYCLON_PROTO */
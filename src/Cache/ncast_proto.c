@@ -37,15 +37,8 @@ struct ncast_proto_context* ncast_proto_init(struct nodeID *s, const void *meta,
 
 int ncast_reply(struct ncast_proto_context *context, const struct peer_cache *c, const struct peer_cache *local_cache)
 {
-  int ret;
-  struct peer_cache *send_cache;
-
-  send_cache = cache_copy(local_cache);
-  cache_update(send_cache);
-  ret = topo_reply(context->context, c, send_cache, MSG_TYPE_TOPOLOGY, NCAST_REPLY, 0, 1);
-  cache_free(send_cache);
-
-  return ret;
+  /* The entries are sent as if cache_update() was called on the local cache */
+  return topo_reply_delay(context->context, c, local_cache, MSG_TYPE_TOPOLOGY, NCAST_REPLY, 0, 1, 1);
 }
 
 int ncast_query_peer(struct ncast_proto_context *context, const struct peer_cache *local_cache, struct nodeID *dst)
@@ -65,6 +58,11 @@ int ncast_query(struct ncast_proto_context *context, const struct peer_cache *lo
   return topo_query_peer(context->context, local_cache, dst, MSG_TYPE_TOPOLOGY, NCAST_QUERY, 0);
 }
 
+void ncast_proto_compact_ids(struct ncast_proto_context *context, int enable)
+{
+  topo_proto_compact_ids(context->context, enable);
+}
+
 int ncast_proto_metadata_update(struct ncast_proto_context *context, const void *meta, int meta_size){
   return topo_proto_metadata_update(context->context, meta, meta_size);
 }
@@ -9,6 +9,7 @@ void ncast_proto_destroy(struct ncast_proto_context **);
 int ncast_reply(struct ncast_proto_context *context, const struct peer_cache *c, const struct peer_cache *local_cache);
 int ncast_query(struct ncast_proto_context *context, const struct peer_cache *local_cache);
 int ncast_query_peer(struct ncast_proto_context *context, const struct peer_cache *local_cache, struct nodeID *dst);
+void ncast_proto_compact_ids(struct ncast_proto_context *context, int enable);
 int ncast_proto_metadata_update(struct ncast_proto_context *context, const void *meta, int meta_size);
 int ncast_proto_myentry_update(struct ncast_proto_context *context, struct nodeID *s, int dts, const void *meta, int meta_size);
 
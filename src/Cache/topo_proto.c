@@ -18,9 +18,11 @@ struct topo_context{
  struct peer_cache *myEntry;
  uint8_t *pkt;
  int pkt_size;
+ int compact_ids;
 };
 
-static int topo_payload_fill(struct topo_context *context, uint8_t *payload, int size, const struct peer_cache *c, const struct nodeID *snot, int max_peers, int include_me)
+/* The timestamps of the entries of c are increased by dts */
+static int topo_payload_fill(struct topo_context *context, uint8_t *payload, int size, const struct peer_cache *c, const struct nodeID *snot, int max_peers, int include_me, int compact_ids, int dts)
 {
   int i;
   uint8_t *p = payload;
@@ -28,27 +30,29 @@ static int topo_payload_fill(struct topo_context *context, uint8_t *payload, int
   if (!max_peers) max_peers = 1000; // FIXME: just to be sure to dump the whole cache...
   p += cache_header_dump(p, c, include_me);
   if (include_me) {
-    p += entry_dump(p, context->myEntry, 0, size - (p - payload));
+    p += entry_dump(p, context->myEntry, 0, size - (p - payload), compact_ids);
     max_peers--;
   }
   for (i = 0; nodeid(c, i) && max_peers; i++) {
     if (!nodeid_equal(nodeid(c, i), snot)) {
       int res;
-      res = entry_dump(p, c, i, size - (p - payload));
+      res = entry_dump_delay(p, c, i, size - (p - payload), compact_ids, dts);
       if (res < 0) {
         fprintf(stderr, "too many entries!\n");
         return -1;
       }
-      p += res;
-      --max_peers;
+      if (res > 0) {
+        p += res;
+        --max_peers;
+      }
     }
   }
 
   return p - payload;
 }
 
-int topo_reply_header(struct topo_context *context, const struct peer_cache *c, const struct peer_cache *local_cache, int protocol,
-                      int type, uint8_t *header, int header_len, int max_peers, int include_me)
+static int topo_reply_send(struct topo_context *context, const struct peer_cache *c, const struct peer_cache *local_cache, int protocol,
+                           int type, uint8_t *header, int header_len, int max_peers, int include_me, int dts)
 {
   struct topo_header *h = (struct topo_header *)context->pkt;
   int len, res, shift;
@@ -72,18 +76,30 @@ int topo_reply_header(struct topo_context *context, const struct peer_cache *c,
   dst = nodeid(c, 0);
   h->protocol = protocol;
   h->type = type;
-  len = topo_payload_fill(context, context->pkt + shift, context->pkt_size - shift, local_cache, dst, max_peers, include_me);
+  /* Use the compact nodeID format only if the querying peer used it */
+  len = topo_payload_fill(context, context->pkt + shift, context->pkt_size - shift, local_cache, dst, max_peers, include_me, cache_compact_ids(c), dts);
 
   res = len > 0 ? send_to_peer(nodeid(context->myEntry, 0), dst, context->pkt, shift + len) : len;
 
   return res;
 }
 
+int topo_reply_header(struct topo_context *context, const struct peer_cache *c, const struct peer_cache *local_cache, int protocol,
+                      int type, uint8_t *header, int header_len, int max_peers, int include_me)
+{
+  return topo_reply_send(context, c, local_cache, protocol, type, header, header_len, max_peers, include_me, 0);
+}
+
 int topo_reply(struct topo_context *context, const struct peer_cache *c, const struct peer_cache *local_cache, int protocol, int type, int max_peers, int include_me)
 {
   return topo_reply_header(context, c, local_cache, protocol, type, NULL, 0, max_peers, include_me);
 }
 
+int topo_reply_delay(struct topo_context *context, const struct peer_cache *c, const struct peer_cache *local_cache, int protocol, int type, int max_peers, int include_me, int dts)
+{
+  return topo_reply_send(context, c, local_cache, protocol, type, NULL, 0, max_peers, include_me, dts);
+}
+
 int topo_query_peer_header(struct topo_context *context, const struct peer_cache *local_cache, struct nodeID *dst, int protocol, int type,
                            uint8_t *header, int header_len, int max_peers)
 {
@@ -100,7 +116,7 @@ int topo_query_peer_header(struct topo_context *context, const struct peer_cache
 
   h->protocol = protocol;
   h->type = type;
-  len = topo_payload_fill(context, context->pkt + shift, context->pkt_size - shift, local_cache, dst, max_peers, 1);
+  len = topo_payload_fill(context, context->pkt + shift, context->pkt_size - shift, local_cache, dst, max_peers, 1, context->compact_ids, 0);
   //fprintf(stderr,"[DEBUG] sending TOPO to peer \n");
   return len > 0  ? send_to_peer(nodeid(context->myEntry, 0), dst, context->pkt, shift + len) : len;
 }
@@ -132,6 +148,11 @@ int topo_proto_myentry_update(struct topo_context *context, struct nodeID *s, in
   return ret;
 }
 
+void topo_proto_compact_ids(struct topo_context *context, int enable)
+{
+  context->compact_ids = enable;
+}
+
 int topo_proto_metadata_update(struct topo_context *context, const void *meta, int meta_size)
 {
   return topo_proto_myentry_update(context, nodeid(context->myEntry, 0), 0 , meta, meta_size);
@@ -151,6 +172,7 @@ struct topo_context* topo_proto_init(struct nodeID *s, const void *meta, int met
     return NULL;
   }
 
+  con->compact_ids = 0;
   con->myEntry = cache_init(1, meta_size, 0);
   cache_add(con->myEntry, s, meta, meta_size);
 
@@ -16,72 +16,265 @@
 #include "topocache.h"
 #include "int_coding.h"
 
-struct cache_entry {
-  struct nodeID *id;
-  uint32_t timestamp;
-};
-
+/*
+ * The entries are ordered by timestamp, and stored as separate arrays
+ * (IDs, timestamps, hashes of the IDs and metadata) allocated in a single
+ * block starting with the IDs. hash_index maps nodeIDs to their position
+ * in the arrays (open addressing with linear probing, -1 for empty slots),
+ * and is kept at least half empty.
+ * spare is a block for spare_size entries, where cache_merge() builds the
+ * merged cache before swapping it with the current arrays.
+ * free_ids contains up to free_size (the cache_size at the time it was
+ * allocated) unused nodeIDs, which are reused by cache_undump() instead of
+ * allocating new ones.
+ */
 struct peer_cache {
-  struct cache_entry *entries;
+  struct nodeID **ids;
+  uint32_t *timestamps;
+  uint32_t *hashes;
+  uint8_t *metadata;
   int cache_size;
   int current_size;
   int metadata_size;
-  uint8_t *metadata;
   int max_timestamp;
+  int compact_ids;
+  int *hash_index;
+  uint32_t hash_mask;
+  struct nodeID **spare;
+  int spare_size;
+  struct nodeID **free_ids;
+  int free_size;
+  int free_count;
 };
 
-static int cache_insert(struct peer_cache *c, struct cache_entry *e, const void *meta)
+static void *storage_alloc(int n, int metadata_size)
 {
-  int i, position;
+  size_t size;
 
-  if (c->current_size == c->cache_size) {
-    return -2;
+  size = (sizeof(struct nodeID *) + 2 * sizeof(uint32_t) + metadata_size) * n;
+
+  return malloc(size ? size : 1);
+}
+
+static void storage_use(struct peer_cache *c, void *block, int n)
+{
+  c->ids = block;
+  c->timestamps = (uint32_t *)(c->ids + n);
+  c->hashes = c->timestamps + n;
+  c->metadata = c->metadata_size ? (uint8_t *)(c->hashes + n) : NULL;
+}
+
+/* Move n entries from position from to position to */
+static void entries_move(struct peer_cache *c, int to, int from, int n)
+{
+  memmove(c->ids + to, c->ids + from, sizeof(struct nodeID *) * n);
+  memmove(c->timestamps + to, c->timestamps + from, sizeof(uint32_t) * n);
+  memmove(c->hashes + to, c->hashes + from, sizeof(uint32_t) * n);
+  if (c->metadata_size) {
+    memmove(c->metadata + to * c->metadata_size, c->metadata + from * c->metadata_size, n * c->metadata_size);
   }
-  position = 0;
-  for (i = 0; i < c->current_size; i++) {
-    assert(e->id);
-    assert(c->entries[i].id);
+}
 
-    if (nodeid_equal(e->id, c->entries[i].id)) {
-      if (c->entries[i].timestamp > e->timestamp) {
-        assert(i >= position);
-        nodeid_free(c->entries[i].id);
+static struct nodeID *id_get(struct peer_cache *c)
+{
+  return c->free_count ? c->free_ids[--c->free_count] : NULL;
+}
 
-        if (position != i) {
-          memmove(c->entries + position + 1, c->entries + position, sizeof(struct cache_entry) * (i - position));
-          memmove(c->metadata + (position + 1) * c->metadata_size, c->metadata + position * c->metadata_size, (i -position) * c->metadata_size);
-        }
+static void id_put(struct peer_cache *c, struct nodeID *id)
+{
+  if (c->free_ids == NULL && c->cache_size) {
+    c->free_ids = malloc(sizeof(struct nodeID *) * c->cache_size);
+    c->free_size = c->free_ids ? c->cache_size : 0;
+  }
+  if (c->free_ids && c->free_count < c->free_size) {
+    c->free_ids[c->free_count++] = id;
+  } else {
+    nodeid_free(id);
+  }
+}
 
-        c->entries[position] = *e;
-        memcpy(c->metadata + position * c->metadata_size, meta, c->metadata_size);
+static void ids_release(struct peer_cache *c)
+{
+  while (c->free_count) {
+    nodeid_free(c->free_ids[--c->free_count]);
+  }
+  free(c->free_ids);
+  c->free_ids = NULL;
+  c->free_size = 0;
+}
 
-        return position;
-      }
+static uint32_t hash_index_size(int n)
+{
+  uint32_t size = 16;
 
-      return -1;
+  while (size < 2 * (uint32_t)n) {
+    size *= 2;
+  }
+
+  return size;
+}
+
+/* Index slot of the entry with ID id (whose hash is h), or -1 */
+static int hash_find(const struct peer_cache *c, const struct nodeID *id, uint32_t h)
+{
+  uint32_t s;
+
+  for (s = h & c->hash_mask; c->hash_index[s] >= 0; s = (s + 1) & c->hash_mask) {
+    int i = c->hash_index[s];
+
+    if (c->hashes[i] == h && nodeid_equal(c->ids[i], id)) {
+      return s;
+    }
+  }
+
+  return -1;
+}
+
+/* Index slot pointing to position pos */
+static uint32_t hash_slot(const struct peer_cache *c, int pos, uint32_t h)
+{
+  uint32_t s;
+
+  for (s = h & c->hash_mask; c->hash_index[s] != pos; s = (s + 1) & c->hash_mask) {
+    assert(c->hash_index[s] >= 0);
+  }
+
+  return s;
+}
+
+static void hash_add(struct peer_cache *c, int pos)
+{
+  uint32_t s;
+
+  for (s = c->hashes[pos] & c->hash_mask; c->hash_index[s] >= 0; s = (s + 1) & c->hash_mask);
+  c->hash_index[s] = pos;
+}
+
+static void hash_del(struct peer_cache *c, int pos)
+{
+  uint32_t s, next;
+
+  s = hash_slot(c, pos, c->hashes[pos]);
+  /* Backward shift, so that no probe sequence is broken */
+  for (next = (s + 1) & c->hash_mask; c->hash_index[next] >= 0; next = (next + 1) & c->hash_mask) {
+    uint32_t home = c->hashes[c->hash_index[next]] & c->hash_mask;
+
+    if (((next - home) & c->hash_mask) >= ((next - s) & c->hash_mask)) {
+      c->hash_index[s] = c->hash_index[next];
+      s = next;
     }
+  }
+  c->hash_index[s] = -1;
+}
+
+/*
+ * Entries from first to last - 1 are going to be moved by delta (1 or -1)
+ * positions: the destination of the first moved entry must not be indexed.
+ * Must be called before moving them.
+ */
+static void hash_shift(struct peer_cache *c, int first, int last, int delta)
+{
+  int i;
 
-    if (c->entries[i].timestamp <= e->timestamp) {
-      position = i + 1;
+  if (delta > 0) {
+    for (i = last - 1; i >= first; i--) {
+      c->hash_index[hash_slot(c, i, c->hashes[i])] = i + delta;
+    }
+  } else {
+    for (i = first; i < last; i++) {
+      c->hash_index[hash_slot(c, i, c->hashes[i])] = i + delta;
     }
   }
+}
+
+/* Size the index for cache_size entries, and empty it */
+static int hash_reset(struct peer_cache *c)
+{
+  uint32_t size = hash_index_size(c->cache_size);
 
-  if (position != c->current_size) {
-    memmove(c->entries + position + 1, c->entries + position, sizeof(struct cache_entry) * (c->current_size - position));
-    memmove(c->metadata + (position + 1) * c->metadata_size, c->metadata + position * c->metadata_size, (c->current_size - position) * c->metadata_size);
+  if (size != c->hash_mask + 1 || c->hash_index == NULL) {
+    int *index = realloc(c->hash_index, sizeof(int) * size);
+
+    if (index == NULL) {
+      return -1;
+    }
+    c->hash_index = index;
+    c->hash_mask = size - 1;
   }
-  c->current_size++;
-  c->entries[position] = *e;
+  memset(c->hash_index, 0xff, sizeof(int) * size);
+
+  return 0;
+}
+
+static int hash_build(struct peer_cache *c)
+{
+  int i;
+
+  if (hash_reset(c) < 0) {
+    return -1;
+  }
+  for (i = 0; i < c->current_size; i++) {
+    hash_add(c, i);
+  }
+
+  return 0;
+}
+
+static int cache_insert(struct peer_cache *c, struct nodeID *id, uint32_t timestamp, const void *meta)
+{
+  int i, j, position, slot;
+  uint32_t h;
+
+  if (c->current_size == c->cache_size) {
+    return -2;
+  }
+  assert(id);
+  h = nodeid_hash(id);
+  position = 0;
+  slot = hash_find(c, id, h);
+  if (slot >= 0) {
+    i = c->hash_index[slot];
+    if (c->timestamps[i] <= timestamp) {
+      return -1;
+    }
+    for (j = 0; j < i; j++) {
+      if (c->timestamps[j] <= timestamp) {
+        position = j + 1;
+      }
+    }
+    hash_del(c, i);
+    nodeid_free(c->ids[i]);
+    if (position != i) {
+      hash_shift(c, position, i, 1);
+      entries_move(c, position + 1, position, i - position);
+    }
+  } else {
+    /* After the last entry with a timestamp smaller or equal to the new one */
+    for (i = 0; i < c->current_size; i++) {
+      if (c->timestamps[i] <= timestamp) {
+        position = i + 1;
+      }
+    }
+
+    if (position != c->current_size) {
+      hash_shift(c, position, c->current_size, 1);
+      entries_move(c, position + 1, position, c->current_size - position);
+    }
+    c->current_size++;
+  }
+  c->ids[position] = id;
+  c->timestamps[position] = timestamp;
+  c->hashes[position] = h;
   memcpy(c->metadata + position * c->metadata_size, meta, c->metadata_size);
+  hash_add(c, position);
 
   return position;
 }
 
 int cache_add_cache(struct peer_cache *dst, const struct peer_cache *src)
 {
-  struct cache_entry *e_orig;
+  struct nodeID *id;
   int count, j;
-  struct cache_entry e_dup;
 cache_check(dst);
 cache_check(src);
 
@@ -90,13 +283,9 @@ cache_check(src);
   while(dst->current_size < dst->cache_size && src->current_size > count) {
     count++;
 
-    e_orig = src->entries + j;
-
-    e_dup.id = nodeid_dup(e_orig->id);
-    e_dup.timestamp = e_orig->timestamp;
-
-    if (cache_insert(dst, &e_dup, src->metadata + src->metadata_size * j) < 0) {
-      nodeid_free(e_dup.id);
+    id = nodeid_dup(src->ids[j]);
+    if (cache_insert(dst, id, src->timestamps[j], src->metadata + src->metadata_size * j) < 0) {
+      nodeid_free(id);
     }
     j++;
   }
@@ -106,10 +295,43 @@ cache_check(src);
   return dst->current_size;
 }
 
+/* Compact the entries whose ID has been moved to another cache */
+static void cache_compact(struct peer_cache *c)
+{
+  int i, n;
+
+  for (i = 0, n = 0; i < c->current_size; i++) {
+    if (c->ids[i]) {
+      entries_move(c, n++, i, 1);
+    }
+  }
+  for (i = n; i < c->current_size; i++) {
+    c->ids[i] = NULL;
+  }
+  c->current_size = n;
+  hash_build(c);
+}
+
+int cache_take_cache(struct peer_cache *dst, struct peer_cache *src)
+{
+  int j;
+cache_check(dst);
+
+  for (j = 0; j < src->current_size && dst->current_size < dst->cache_size; j++) {
+    if (cache_insert(dst, src->ids[j], src->timestamps[j], src->metadata + src->metadata_size * j) >= 0) {
+      src->ids[j] = NULL;
+    }
+  }
+  cache_compact(src);
+cache_check(dst);
+
+  return dst->current_size;
+}
+
 struct nodeID *nodeid(const struct peer_cache *c, int i)
 {
   if (i < c->current_size) {
-    return c->entries[i].id;
+    return c->ids[i];
   }
 
   return NULL;
@@ -128,14 +350,13 @@ int cache_metadata_update(struct peer_cache *c, const struct nodeID *p, const vo
   if (!meta_size || meta_size != c->metadata_size) {
     return -3;
   }
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, p)) {
-      memcpy(c->metadata + i * meta_size, meta, meta_size);
-      return 1;
-    }
+  i = cache_pos(c, p);
+  if (i < 0) {
+    return 0;
   }
+  memcpy(c->metadata + i * meta_size, meta, meta_size);
 
-  return 0;
+  return 1;
 }
 
 int cache_add_ranked(struct peer_cache *c, struct nodeID *neighbour, const void *meta, int meta_size, ranking_function f, const void *tmeta)
@@ -145,37 +366,35 @@ int cache_add_ranked(struct peer_cache *c, struct nodeID *neighbour, const void
   if (meta_size && meta_size != c->metadata_size) {
     return -3;
   }
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, neighbour)) {
-      if (f != NULL) {
-        cache_del(c,neighbour);
-        if (i == c->current_size) break;
-      } else {
-          cache_metadata_update(c,neighbour,meta,meta_size);
-          return -1;
-      }
+  if (cache_pos(c, neighbour) >= 0) {
+    if (f == NULL) {
+      cache_metadata_update(c,neighbour,meta,meta_size);
+      return -1;
     }
-    if ((f != NULL) && f(tmeta, meta, c->metadata+(c->metadata_size * i)) == 2) {
+    cache_del(c,neighbour);
+  }
+  for (i = 0; (f != NULL) && i < c->current_size; i++) {
+    if (f(tmeta, meta, c->metadata+(c->metadata_size * i)) == 2) {
       pos++;
     }
   }
   if (c->current_size == c->cache_size) {
     return -2;
   }
+  hash_shift(c, pos, c->current_size, 1);
+  entries_move(c, pos + 1, pos, c->current_size - pos);
   if (c->metadata_size) {
-    memmove(c->metadata + (pos + 1) * c->metadata_size, c->metadata + pos * c->metadata_size, (c->current_size - pos) * c->metadata_size);
     if (meta_size) {
       memcpy(c->metadata + pos * c->metadata_size, meta, meta_size);
     } else {
       memset(c->metadata + pos * c->metadata_size, 0, c->metadata_size);
     }
   }
-  for (i = c->current_size; i > pos; i--) {
-    c->entries[i] = c->entries[i - 1];
-  }
-  c->entries[pos].id = nodeid_dup(neighbour);
-  c->entries[pos].timestamp = 1;
+  c->ids[pos] = nodeid_dup(neighbour);
+  c->timestamps[pos] = 1;
+  c->hashes[pos] = nodeid_hash(neighbour);
   c->current_size++;
+  hash_add(c, pos);
 
   return c->current_size;
 }
@@ -185,25 +404,24 @@ int cache_add(struct peer_cache *c, struct nodeID *neighbour, const void *meta,
   return cache_add_ranked(c, neighbour, meta, meta_size, NULL, NULL);
 }
 
+/* Remove the entry in position i, without freeing its ID */
+static void cache_remove(struct peer_cache *c, int i)
+{
+  hash_del(c, i);
+  hash_shift(c, i + 1, c->current_size, -1);
+  c->current_size--;
+  entries_move(c, i, i + 1, c->current_size - i);
+  c->ids[c->current_size] = NULL;
+}
+
 int cache_del(struct peer_cache *c, const struct nodeID *neighbour)
 {
   int i;
-  int found = 0;
 
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, neighbour)) {
-      nodeid_free(c->entries[i].id);
-      c->current_size--;
-      found = 1;
-      if (c->metadata_size && (i < c->current_size)) {
-        memmove(c->metadata + c->metadata_size * i,
-                c->metadata + c->metadata_size * (i + 1),
-                c->metadata_size * (c->current_size - i));
-      }
-    }
-    if (found && (i < c->current_size)) {
-      c->entries[i] = c->entries[i + 1];
-    }
+  i = cache_pos(c, neighbour);
+  if (i >= 0) {
+    nodeid_free(c->ids[i]);
+    cache_remove(c, i);
   }
 
   return c->current_size;
@@ -212,21 +430,22 @@ int cache_del(struct peer_cache *c, const struct nodeID *neighbour)
 void cache_delay(struct peer_cache *c, int dts)
 {
   int i;
-  
+
   for (i = 0; i < c->current_size; i++) {
-    if (c->max_timestamp && (c->entries[i].timestamp + dts > c->max_timestamp)) {
+    if (c->max_timestamp && (c->timestamps[i] + dts > c->max_timestamp)) {
       int j = i;
 
-      while(j < c->current_size && c->entries[j].id) {
-        nodeid_free(c->entries[j].id);
-        c->entries[j++].id = NULL;
+      while(j < c->current_size && c->ids[j]) {
+        hash_del(c, j);
+        nodeid_free(c->ids[j]);
+        c->ids[j++] = NULL;
       }
       c->current_size = i;	/* The cache is ordered by timestamp...
 				   all the other entries wiil be older than
 				   this one, so remove all of them
 				*/
     } else {
-      c->entries[i].timestamp = c->entries[i].timestamp + dts > 0 ? c->entries[i].timestamp + dts : 0;
+      c->timestamps[i] = c->timestamps[i] + dts > 0 ? c->timestamps[i] + dts : 0;
     }
   }
 }
@@ -240,6 +459,7 @@ void cache_update(struct peer_cache *c)
 struct peer_cache *cache_init(int n, int metadata_size, int max_timestamp)
 {
   struct peer_cache *res;
+  void *block;
 
   res = malloc(sizeof(struct peer_cache));
   if (res == NULL) {
@@ -248,25 +468,25 @@ struct peer_cache *cache_init(int n, int metadata_size, int max_timestamp)
   res->max_timestamp = max_timestamp;
   res->cache_size = n;
   res->current_size = 0;
-  res->entries = malloc(sizeof(struct cache_entry) * n);
-  if (res->entries == NULL) {
+  res->compact_ids = 0;
+  res->metadata_size = metadata_size;
+  res->hash_index = NULL;
+  res->spare = NULL;
+  res->spare_size = 0;
+  res->free_ids = NULL;
+  res->free_size = 0;
+  res->free_count = 0;
+  block = storage_alloc(n, metadata_size);
+  if (block == NULL || hash_reset(res) < 0) {
+    free(block);
     free(res);
 
     return NULL;
   }
-  
-  memset(res->entries, 0, sizeof(struct cache_entry) * n);
-  if (metadata_size) {
-    res->metadata = malloc(metadata_size * n);
-  } else {
-    res->metadata = NULL;
-  }
-
+  storage_use(res, block, n);
+  memset(res->ids, 0, sizeof(struct nodeID *) * n);
   if (res->metadata) {
-    res->metadata_size = metadata_size;
     memset(res->metadata, 0, metadata_size * n);
-  } else {
-    res->metadata_size = 0;
   }
 
   return res;
@@ -283,12 +503,15 @@ struct peer_cache *cache_copy(const struct peer_cache *c1)
   }
 
   for (n = 0; n < c1->current_size; n++) {
-    new_cache->entries[new_cache->current_size].id = nodeid_dup(c1->entries[n].id);
-    new_cache->entries[new_cache->current_size++].timestamp = c1->entries[n].timestamp;
+    new_cache->ids[n] = nodeid_dup(c1->ids[n]);
   }
+  memcpy(new_cache->timestamps, c1->timestamps, sizeof(uint32_t) * c1->current_size);
+  memcpy(new_cache->hashes, c1->hashes, sizeof(uint32_t) * c1->current_size);
   if (new_cache->metadata_size) {
     memcpy(new_cache->metadata, c1->metadata, c1->metadata_size * c1->current_size);
   }
+  new_cache->current_size = c1->current_size;
+  hash_build(new_cache);
 
   return new_cache;
 }
@@ -298,31 +521,53 @@ void cache_free(struct peer_cache *c)
   int i;
 
   for (i = 0; i < c->current_size; i++) {
-    if(c->entries[i].id) {
-      nodeid_free(c->entries[i].id);
+    if(c->ids[i]) {
+      nodeid_free(c->ids[i]);
     }
   }
-  free(c->entries);
-  free(c->metadata);
+  ids_release(c);
+  free(c->ids);
+  free(c->spare);
+  free(c->hash_index);
   free(c);
 }
 
 int cache_pos(const struct peer_cache *c, const struct nodeID *n)
 {
-  int i;
+  int slot;
 
-  for (i = 0; i < c->current_size; i++) {
-    if (nodeid_equal(c->entries[i].id, n)) {
-      return i;
-    }
-  }
+  slot = hash_find(c, n, nodeid_hash(n));
 
-  return -1;
+  return slot >= 0 ? c->hash_index[slot] : -1;
+}
+
+/* Position in c of the entry in position i of src, or -1 */
+static int in_cache(const struct peer_cache *c, const struct peer_cache *src, int i)
+{
+  int slot;
+
+  slot = hash_find(c, src->ids[i], src->hashes[i]);
+
+  return slot >= 0 ? c->hash_index[slot] : -1;
 }
 
-static int in_cache(const struct peer_cache *c, const struct cache_entry *elem)
+/*
+ * Move the entry in position i of src (which must not be in c) after the
+ * last entry of c; the ID is now owned by c
+ */
+static void cache_append(struct peer_cache *c, const struct peer_cache *src, int i)
 {
-  return cache_pos(c, elem->id);
+  int pos = c->current_size++;
+  int meta_size = c->metadata_size < src->metadata_size ? c->metadata_size : src->metadata_size;
+
+  c->ids[pos] = src->ids[i];
+  c->timestamps[pos] = src->timestamps[i];
+  c->hashes[pos] = src->hashes[i];
+  if (meta_size) {
+    memcpy(c->metadata + pos * c->metadata_size, src->metadata + i * src->metadata_size, meta_size);
+  }
+  hash_add(c, pos);
+  src->ids[i] = NULL;
 }
 
 struct nodeID *rand_peer(const struct peer_cache *c, void **meta, int max)
@@ -342,7 +587,7 @@ struct nodeID *rand_peer(const struct peer_cache *c, void **meta, int max)
     *meta = c->metadata + (j * c->metadata_size);
   }
 
-  return c->entries[j].id;
+  return c->ids[j];
 }
 
 struct nodeID *last_peer(const struct peer_cache *c)
@@ -351,13 +596,13 @@ struct nodeID *last_peer(const struct peer_cache *c)
     return NULL;
   }
 
-  return c->entries[c->current_size - 1].id;
+  return c->ids[c->current_size - 1];
 }
 
 
 int cache_fill_ordered(struct peer_cache *dst, const struct peer_cache *src, int target_size)
 {
-  struct cache_entry *e_orig, e_dup;
+  struct nodeID *id;
   int count, j, err;
 cache_check(dst);
 cache_check(src);
@@ -372,14 +617,11 @@ cache_check(src);
   while(dst->current_size < target_size && src->current_size > count) {
     count++;
 
-    e_orig = src->entries + j;
-    e_dup.id = nodeid_dup(e_orig->id);
-    e_dup.timestamp = e_orig->timestamp;
-
-    err = cache_insert(dst, &e_dup, src->metadata + src->metadata_size * j);
+    id = nodeid_dup(src->ids[j]);
+    err = cache_insert(dst, id, src->timestamps[j], src->metadata + src->metadata_size * j);
     if (err == -1) {
       /* Cache entry is fresher */
-      nodeid_free(e_dup.id);
+      nodeid_free(id);
     }
 
     j++;
@@ -392,7 +634,7 @@ cache_check(src);
 int cache_fill_rand(struct peer_cache *dst, const struct peer_cache *src, int target_size)
 {
   int added[src->current_size];
-  struct cache_entry *e_orig, e_dup;
+  struct nodeID *id;
   int count, j, err;
 cache_check(dst);
 cache_check(src);
@@ -410,15 +652,11 @@ cache_check(src);
     added[j] = 1;
     count++;
 
-    e_orig = src->entries + j;
-
-    e_dup.id = nodeid_dup(e_orig->id);
-    e_dup.timestamp = e_orig->timestamp;
-
-    err = cache_insert(dst, &e_dup, src->metadata + src->metadata_size * j);
+    id = nodeid_dup(src->ids[j]);
+    err = cache_insert(dst, id, src->timestamps[j], src->metadata + src->metadata_size * j);
     if (err == -1) {
       /* Cache entry is fresher */
-      nodeid_free(e_dup.id);
+      nodeid_free(id);
     }
   }
 cache_check(dst);
@@ -431,7 +669,6 @@ struct peer_cache *rand_cache_except(struct peer_cache *c, int n,
                                      struct nodeID *except[], int len)
 {
   struct peer_cache *res;
-  struct cache_entry *e;
   int present[len];
   int count = 0;
 
@@ -447,11 +684,10 @@ cache_check(c);
     int j,i,flag;
 
     j = ((double)rand() / (double)RAND_MAX) * c->current_size;
-    e = c->entries +j;
 
     flag = 0;
     for (i=0; i<len; i++) {
-      if (nodeid_equal(e->id, except[i])) {
+      if (nodeid_equal(c->ids[j], except[i])) {
         if (present[i] == 0) {
           count++;
           present[i] = 1;
@@ -462,11 +698,8 @@ cache_check(c);
     }
     if (flag) continue;
 
-    cache_insert(res, c->entries + j, c->metadata + c->metadata_size * j);
-    c->current_size--;
-    memmove(c->entries + j, c->entries + j + 1, sizeof(struct cache_entry) * (c->current_size - j));
-    memmove(c->metadata + c->metadata_size * j, c->metadata + c->metadata_size * (j + 1), c->metadata_size * (c->current_size - j));
-    c->entries[c->current_size].id = NULL;
+    cache_insert(res, c->ids[j], c->timestamps[j], c->metadata + c->metadata_size * j);
+    cache_remove(c, j);
 cache_check(c);
   }
 
@@ -487,46 +720,103 @@ cache_check(c);
     int j;
 
     j = ((double)rand() / (double)RAND_MAX) * c->current_size;
-    cache_insert(res, c->entries + j, c->metadata + c->metadata_size * j);
-    c->current_size--;
-    memmove(c->entries + j, c->entries + j + 1, sizeof(struct cache_entry) * (c->current_size - j));
-    memmove(c->metadata + c->metadata_size * j, c->metadata + c->metadata_size * (j + 1), c->metadata_size * (c->current_size - j));
-    c->entries[c->current_size].id = NULL;
+    cache_insert(res, c->ids[j], c->timestamps[j], c->metadata + c->metadata_size * j);
+    cache_remove(c, j);
 cache_check(c);
   }
 
   return res;
 }
 
-struct peer_cache *entries_undump(const uint8_t *buff, int size)
+int cache_undump(struct peer_cache *c, const uint8_t *buff, int size)
 {
-  struct peer_cache *res;
   int i = 0;
-  const uint8_t *p = buff;
-  uint8_t *meta;
+  const uint8_t *p;
   int cache_size, metadata_size;
 
   cache_size = int_rcpy(buff);
   metadata_size = int_rcpy(buff + 4);
   p = buff + 8;
-  res = cache_init(cache_size, metadata_size, 0);
-  meta = res->metadata;
+
+  /* The IDs of the current entries are reused for the new ones */
+  for (i = c->current_size - 1; i >= 0; i--) {
+    id_put(c, c->ids[i]);
+    c->ids[i] = NULL;
+  }
+  c->current_size = 0;
+  c->compact_ids = 0;
+  if (cache_size != c->cache_size || metadata_size != c->metadata_size) {
+    void *block = storage_alloc(cache_size, metadata_size);
+
+    if (block == NULL) {
+      return -1;
+    }
+    ids_release(c);
+    free(c->ids);
+    free(c->spare);
+    c->spare = NULL;
+    c->spare_size = 0;
+    c->cache_size = cache_size;
+    c->metadata_size = metadata_size;
+    storage_use(c, block, cache_size);
+    memset(c->ids, 0, sizeof(struct nodeID *) * cache_size);
+  }
+  if (hash_reset(c) < 0) {
+    return -1;
+  }
+
+  i = 0;
   while (p - buff < size) {
+    struct nodeID *id;
     int len;
 
-    res->entries[i].timestamp = int_rcpy(p);
+    if (i == c->cache_size) {
+      fprintf(stderr, "cache_undump: too many entries\n");
+      c->current_size = i;
+
+      return i;
+    }
+    c->timestamps[i] = int_rcpy(p);
     p += sizeof(uint32_t);
-    res->entries[i++].id = nodeid_undump(p, &len);
+    if (nodeid_is_compact(p)) {
+      c->compact_ids = 1;
+    }
+    id = id_get(c);
+    c->ids[i] = nodeid_undump_reuse(id, p, &len);
+    if (c->ids[i] == NULL) {
+      if (id) {
+        id_put(c, id);
+      }
+      fprintf(stderr, "cache_undump: cannot decode entry %d\n", i);
+      c->current_size = i;
+
+      return i;
+    }
+    c->hashes[i] = nodeid_hash(c->ids[i]);
+    hash_add(c, i);
     p += len;
     if (metadata_size) {
-      memcpy(meta, p, metadata_size);
+      memcpy(c->metadata + i * metadata_size, p, metadata_size);
       p += metadata_size;
-      meta += metadata_size;
     }
+    i++;
   }
-  res->current_size = i;
+  c->current_size = i;
   assert(p - buff == size);
 
+  return i;
+}
+
+struct peer_cache *entries_undump(const uint8_t *buff, int size)
+{
+  struct peer_cache *res;
+
+  res = cache_init(int_rcpy(buff), int_rcpy(buff + 4), 0);
+  if (res == NULL) {
+    return NULL;
+  }
+  cache_undump(res, buff, size);
+
   return res;
 }
 
@@ -538,17 +828,30 @@ int cache_header_dump(uint8_t *b, const struct peer_cache *c, int include_me)
   return 8;
 }
 
-int entry_dump(uint8_t *b, const struct peer_cache *c, int i, size_t max_write_size)
+int cache_compact_ids(const struct peer_cache *c)
+{
+  return c->compact_ids;
+}
+
+int entry_dump_delay(uint8_t *b, const struct peer_cache *c, int i, size_t max_write_size, int compact_ids, int dts)
 {
   int res;
   int size = 0;
- 
+
   if (i && (i >= c->cache_size - 1)) {
     return 0;
   }
-  int_cpy(b, c->entries[i].timestamp);
+  /* As if cache_delay(c, dts) was called before dumping */
+  if (dts && c->max_timestamp && (c->timestamps[i] + dts > c->max_timestamp)) {
+    return 0;
+  }
+  int_cpy(b, c->timestamps[i] + dts > 0 ? c->timestamps[i] + dts : 0);
   size = +4;
-  res = nodeid_dump(b + size, c->entries[i].id, max_write_size - size);
+  if (compact_ids) {
+    res = nodeid_dump_compact(b + size, c->ids[i], max_write_size - size);
+  } else {
+    res = nodeid_dump(b + size, c->ids[i], max_write_size - size);
+  }
   if (res < 0 ) {
     return -1;
   }
@@ -564,6 +867,11 @@ int entry_dump(uint8_t *b, const struct peer_cache *c, int i, size_t max_write_s
   return size;
 }
 
+int entry_dump(uint8_t *b, const struct peer_cache *c, int i, size_t max_write_size, int compact_ids)
+{
+  return entry_dump_delay(b, c, i, max_write_size, compact_ids, 0);
+}
+
 struct peer_cache *cache_rank (const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta)
 {
   struct peer_cache *res;
@@ -575,26 +883,94 @@ struct peer_cache *cache_rank (const struct peer_cache *c, ranking_function rank
   }
 
   for (i = 0; i < c->current_size; i++) {
-    if (!target || !nodeid_equal(c->entries[i].id,target)) {
+    if (!target || !nodeid_equal(c->ids[i],target)) {
       pos = 0;
       for (j=0; j<res->current_size;j++) {
         if (((rank != NULL) && rank(target_meta, c->metadata+(c->metadata_size * i), res->metadata+(res->metadata_size * j)) == 2) ||
-            ((rank == NULL) && res->entries[j].timestamp < c->entries[i].timestamp)) {
+            ((rank == NULL) && res->timestamps[j] < c->timestamps[i])) {
           pos++;
         }
       }
+      hash_shift(res, pos, res->current_size, 1);
+      entries_move(res, pos + 1, pos, res->current_size - pos);
       if (c->metadata_size) {
-        memmove(res->metadata + (pos + 1) * res->metadata_size, res->metadata + pos * res->metadata_size, (res->current_size - pos) * res->metadata_size);
         memcpy(res->metadata + pos * res->metadata_size, c->metadata+(c->metadata_size * i), res->metadata_size);
       }
-      for (j = res->current_size; j > pos; j--) {
-        res->entries[j] = res->entries[j - 1];
-      }
-      res->entries[pos].id = nodeid_dup(c->entries[i].id);
-      res->entries[pos].timestamp = c->entries[i].timestamp;
+      res->ids[pos] = nodeid_dup(c->ids[i]);
+      res->timestamps[pos] = c->timestamps[i];
+      res->hashes[pos] = c->hashes[i];
       res->current_size++;
+      hash_add(res, pos);
+    }
+  }
+
+  return res;
+}
+
+struct rank_item {
+  double score;
+  int i;
+};
+
+/* By increasing score, and by position for equal scores */
+static int rank_item_cmp(const void *p1, const void *p2)
+{
+  const struct rank_item *r1 = p1, *r2 = p2;
+
+  if (r1->score != r2->score) {
+    return r1->score < r2->score ? -1 : 1;
+  }
+
+  return r1->i - r2->i;
+}
+
+/*
+ * Rank the entries by their score (computed once per entry), so that the
+ * entries nearer to the target come first; without a scoring function,
+ * the pairwise comparisons of cache_rank() are used
+ */
+struct peer_cache *cache_rank_scored(const struct peer_cache *c, scoring_function score, ranking_function rank, const struct nodeID *target, const void *target_meta)
+{
+  struct peer_cache *res;
+  struct rank_item *items;
+  int i, n;
+
+  if (score == NULL) {
+    return cache_rank(c, rank, target, target_meta);
+  }
+
+  res = cache_init(c->cache_size, c->metadata_size, c->max_timestamp);
+  if (res == NULL) {
+    return res;
+  }
+  items = malloc(sizeof(struct rank_item) * (c->current_size ? c->current_size : 1));
+  if (items == NULL) {
+    cache_free(res);
+
+    return NULL;
+  }
+
+  for (i = 0, n = 0; i < c->current_size; i++) {
+    if (!target || !nodeid_equal(c->ids[i],target)) {
+      items[n].score = score(target_meta, c->metadata + (c->metadata_size * i));
+      items[n++].i = i;
+    }
+  }
+  qsort(items, n, sizeof(struct rank_item), rank_item_cmp);
+
+  for (res->current_size = 0; res->current_size < n; res->current_size++) {
+    int pos = res->current_size;
+
+    i = items[pos].i;
+    res->ids[pos] = nodeid_dup(c->ids[i]);
+    res->timestamps[pos] = c->timestamps[i];
+    res->hashes[pos] = c->hashes[i];
+    if (c->metadata_size) {
+      memcpy(res->metadata + pos * res->metadata_size, c->metadata + (c->metadata_size * i), res->metadata_size);
     }
+    hash_add(res, pos);
   }
+  free(items);
 
   return res;
 }
@@ -603,7 +979,6 @@ struct peer_cache *cache_union(const struct peer_cache *c1, const struct peer_ca
 {
   int n, pos;
   struct peer_cache *new_cache;
-  uint8_t *meta;
 
   if (c1->metadata_size != c2->metadata_size) {
     return NULL;
@@ -614,30 +989,18 @@ struct peer_cache *cache_union(const struct peer_cache *c1, const struct peer_ca
     return NULL;
   }
 
-  meta = new_cache->metadata;
-
   for (n = 0; n < c1->current_size; n++) {
-    if (new_cache->metadata_size) {
-      memcpy(meta, c1->metadata + n * c1->metadata_size, c1->metadata_size);
-      meta += new_cache->metadata_size;
-    }
-    new_cache->entries[new_cache->current_size++] = c1->entries[n];
-    c1->entries[n].id = NULL;
+    cache_append(new_cache, c1, n);
   }
-  
+
   for (n = 0; n < c2->current_size; n++) {
-    pos = in_cache(new_cache, &c2->entries[n]);
-    if (pos >= 0 && new_cache->entries[pos].timestamp > c2->entries[n].timestamp) {
-      cache_metadata_update(new_cache, c2->entries[n].id, c2->metadata + n * c2->metadata_size, c2->metadata_size);
-      new_cache->entries[pos].timestamp = c2->entries[n].timestamp;
+    pos = in_cache(new_cache, c2, n);
+    if (pos >= 0 && new_cache->timestamps[pos] > c2->timestamps[n]) {
+      memcpy(new_cache->metadata + pos * new_cache->metadata_size, c2->metadata + n * c2->metadata_size, c2->metadata_size);
+      new_cache->timestamps[pos] = c2->timestamps[n];
     }
     if (pos < 0) {
-      if (new_cache->metadata_size) {
-        memcpy(meta, c2->metadata + n * c2->metadata_size, c2->metadata_size);
-        meta += new_cache->metadata_size;
-      }
-      new_cache->entries[new_cache->current_size++] = c2->entries[n];
-      c2->entries[n].id = NULL;
+      cache_append(new_cache, c2, n);
     }
   }
   *size = new_cache->current_size;
@@ -658,104 +1021,140 @@ int cache_current_size(const struct peer_cache *c)
 
 int cache_resize (struct peer_cache *c, int size)
 {
-  int dif = size - c->cache_size;
+  struct peer_cache old = *c;
+  void *block;
+  int n;
 
-  if (!dif) {
+  if (size == c->cache_size) {
     return c->current_size;
   }
 
-  c->entries = realloc(c->entries, sizeof(struct cache_entry) * size);
-  if (dif > 0) {
-    memset(c->entries + c->cache_size, 0, sizeof(struct cache_entry) * dif);
-  } else if (c->current_size > size) {
-    c->current_size = size;
+  block = storage_alloc(size, c->metadata_size);
+  if (block == NULL) {
+    return -1;
   }
-
+  storage_use(c, block, size);
+  memset(c->ids, 0, sizeof(struct nodeID *) * size);
+  if (c->metadata) {
+    memset(c->metadata, 0, c->metadata_size * size);
+  }
+  n = old.current_size < size ? old.current_size : size;
+  memcpy(c->ids, old.ids, sizeof(struct nodeID *) * n);
+  memcpy(c->timestamps, old.timestamps, sizeof(uint32_t) * n);
+  memcpy(c->hashes, old.hashes, sizeof(uint32_t) * n);
   if (c->metadata_size) {
-    c->metadata = realloc(c->metadata, c->metadata_size * size);
-    if (dif > 0) {
-      memset(c->metadata + c->metadata_size * c->cache_size, 0, c->metadata_size * dif);
-    }
+    memcpy(c->metadata, old.metadata, c->metadata_size * n);
   }
+  for (; n < old.current_size; n++) {
+    nodeid_free(old.ids[n]);
+  }
+  free(old.ids);
+  ids_release(c);
+  free(c->spare);
+  c->spare = NULL;
+  c->spare_size = 0;
 
   c->cache_size = size;
+  if (c->current_size > size) {
+    c->current_size = size;
+  }
+  if (hash_build(c) < 0) {
+    return -1;
+  }
 
   return c->current_size;
 }
-  
-struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_cache *c2, int newsize, int *source)
+
+/*
+ * Move the entries of c1 and c2 (by increasing timestamp, skipping the
+ * duplicates) to the empty cache res, until it is full
+ */
+static void merge_into(struct peer_cache *res, const struct peer_cache *c1, const struct peer_cache *c2, int *source)
 {
   int n1, n2;
-  struct peer_cache *new_cache;
-  uint8_t *meta;
 
-  new_cache = cache_init(newsize, c1->metadata_size, c1->max_timestamp);
-  if (new_cache == NULL) {
-    return NULL;
-  }
-
-  meta = new_cache->metadata;
   *source = 0;
-  for (n1 = 0, n2 = 0; new_cache->current_size < new_cache->cache_size;) {
+  for (n1 = 0, n2 = 0; res->current_size < res->cache_size;) {
     if ((n1 == c1->current_size) && (n2 == c2->current_size)) {
-      return new_cache;
+      return;
     }
-    if (n1 == c1->current_size) {
-      if (in_cache(new_cache, &c2->entries[n2]) < 0) {
-        if (new_cache->metadata_size) {
-          memcpy(meta, c2->metadata + n2 * c2->metadata_size, c2->metadata_size);
-          meta += new_cache->metadata_size;
-        }
-        new_cache->entries[new_cache->current_size++] = c2->entries[n2];
-        c2->entries[n2].id = NULL;
+    if ((n1 == c1->current_size) ||
+        ((n2 < c2->current_size) && (c2->timestamps[n2] <= c1->timestamps[n1]))) {
+      if (in_cache(res, c2, n2) < 0) {
+        cache_append(res, c2, n2);
         *source |= 0x02;
       }
       n2++;
-    } else if (n2 == c2->current_size) {
-      if (in_cache(new_cache, &c1->entries[n1]) < 0) {
-        if (new_cache->metadata_size) {
-          memcpy(meta, c1->metadata + n1 * c1->metadata_size, c1->metadata_size);
-          meta += new_cache->metadata_size;
-        }
-        new_cache->entries[new_cache->current_size++] = c1->entries[n1];
-        c1->entries[n1].id = NULL;
+    } else {
+      if (in_cache(res, c1, n1) < 0) {
+        cache_append(res, c1, n1);
         *source |= 0x01;
       }
       n1++;
-    } else {
-      if (c2->entries[n2].timestamp > c1->entries[n1].timestamp) {
-        if (in_cache(new_cache, &c1->entries[n1]) < 0) {
-          if (new_cache->metadata_size) {
-            memcpy(meta, c1->metadata + n1 * c1->metadata_size, c1->metadata_size);
-            meta += new_cache->metadata_size;
-          }
-          new_cache->entries[new_cache->current_size++] = c1->entries[n1];
-          c1->entries[n1].id = NULL;
-          *source |= 0x01;
-        }
-        n1++;
-      } else {
-        if (in_cache(new_cache, &c2->entries[n2]) < 0) {
-          if (new_cache->metadata_size) {
-            memcpy(meta, c2->metadata + n2 * c2->metadata_size, c2->metadata_size);
-            meta += new_cache->metadata_size;
-          }
-          new_cache->entries[new_cache->current_size++] = c2->entries[n2];
-          c2->entries[n2].id = NULL;
-          *source |= 0x02;
-        }
-        n2++;
-      }
     }
   }
+}
+
+struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_cache *c2, int newsize, int *source)
+{
+  struct peer_cache *new_cache;
+
+  new_cache = cache_init(newsize, c1->metadata_size, c1->max_timestamp);
+  if (new_cache == NULL) {
+    return NULL;
+  }
+  merge_into(new_cache, c1, c2, source);
 
   return new_cache;
 }
 
+int cache_merge(struct peer_cache *c, struct peer_cache *remote, int newsize, int *source)
+{
+  struct peer_cache old = *c;
+  int i;
+
+  if (c->spare == NULL || c->spare_size != newsize) {
+    void *block = storage_alloc(newsize, c->metadata_size);
+
+    if (block == NULL) {
+      return -1;
+    }
+    free(c->spare);
+    c->spare = block;
+    c->spare_size = newsize;
+  }
+  c->cache_size = newsize;
+  if (hash_reset(c) < 0) {
+    c->cache_size = old.cache_size;
+
+    return -1;
+  }
+  storage_use(c, c->spare, newsize);
+  c->current_size = 0;
+  merge_into(c, &old, remote, source);
+
+  /*
+   * The old arrays become the spare ones, and the IDs which have been
+   * dropped can be reused by remote
+   */
+  for (i = 0; i < old.current_size; i++) {
+    if (old.ids[i]) {
+      id_put(remote, old.ids[i]);
+    }
+  }
+  c->spare = old.ids;
+  c->spare_size = old.cache_size;
+  cache_compact(remote);
+
+  return c->current_size;
+}
+
 static int swap_entries(const struct peer_cache *c, int i, int j)
 {
-  struct cache_entry t;
+  struct nodeID *id;
+  uint32_t t;
   uint8_t *metadata;
+  uint32_t si, sj;
 
   if (i == j) {
     return 1;
@@ -774,9 +1173,19 @@ static int swap_entries(const struct peer_cache *c, int i, int j)
     free(metadata);
   }
 
-  t = c->entries[i];
-  c->entries[i] = c->entries[j];
-  c->entries[j] = t;
+  si = hash_slot(c, i, c->hashes[i]);
+  sj = hash_slot(c, j, c->hashes[j]);
+  c->hash_index[si] = j;
+  c->hash_index[sj] = i;
+  id = c->ids[i];
+  c->ids[i] = c->ids[j];
+  c->ids[j] = id;
+  t = c->timestamps[i];
+  c->timestamps[i] = c->timestamps[j];
+  c->timestamps[j] = t;
+  t = c->hashes[i];
+  c->hashes[i] = c->hashes[j];
+  c->hashes[j] = t;
 
   return 1;
 }
@@ -787,10 +1196,10 @@ void cache_randomize(const struct peer_cache *c)
 
   for (i = 0; i < c->current_size - 1; i++) {
     int j, k;
-    uint32_t ts = c->entries[i].timestamp;
+    uint32_t ts = c->timestamps[i];
 
     for (j = i + 1; j < c->current_size; j++) {
-      if (c->entries[j].timestamp != ts) {
+      if (c->timestamps[j] != ts) {
         break;
       }
     }
@@ -811,19 +1220,18 @@ void cache_randomize(const struct peer_cache *c)
 
 void cache_check(const struct peer_cache *c)
 {
-  int i, j;
+  int i;
   int ts = 0;
 
   for (i = 0; i < c->current_size; i++) {
-    if (c->entries[i].timestamp < ts) {
+    if (c->timestamps[i] < ts) {
       fprintf(stderr, "WTF!!!! %d.ts=%d > %d.ts=%d!!!\n",
-              i-1, ts, i, c->entries[i].timestamp);
+              i-1, ts, i, c->timestamps[i]);
       *((char *)0) = 1;
     }
-    ts = c->entries[i].timestamp;
-    for (j = i + 1; j < c->current_size; j++) {
-      assert(!nodeid_equal(c->entries[i].id, c->entries[j].id));
-    }
+    ts = c->timestamps[i];
+    /* Duplicates would be found at a different position */
+    assert(cache_pos(c, c->ids[i]) == i);
   }
 }
 
@@ -840,8 +1248,8 @@ void cache_log(const struct peer_cache *c, const char *name){
   fprintf(stderr, "### dumping cache (%s)\n", actual_name);
   fprintf(stderr, "\tcache_size=%d, current_size=%d\n", c->cache_size, c->current_size);
   for (i = 0; i < c->current_size; i++) {
-    node_addr(c->entries[i].id, addr, 256);
-    fprintf(stderr, "\t%d: %s[%d]\n", i, addr, c->entries[i].timestamp);
+    node_addr(c->ids[i], addr, 256);
+    fprintf(stderr, "\t%d: %s[%d]\n", i, addr, c->timestamps[i]);
   }
   fprintf(stderr, "\n-----------------------------\n");
 }
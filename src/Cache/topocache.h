@@ -4,6 +4,7 @@
 struct peer_cache;
 struct cache_entry;
 typedef int (*ranking_function)(const void *target, const void *p1, const void *p2);    // FIXME!
+typedef double (*scoring_function)(const void *target, const void *p);	/* distance from the target */
 
 struct peer_cache *cache_init(int n, int metadata_size, int max_timestamp);
 struct peer_cache *cache_copy(const struct peer_cache *c);
@@ -26,11 +27,22 @@ struct peer_cache *rand_cache_except(struct peer_cache *c, int n, struct nodeID
 void cache_randomize(const struct peer_cache *c);
 
 struct peer_cache *entries_undump(const uint8_t *buff, int size);
+/* Replace the entries of c with the ones in buff, reusing the storage of c */
+int cache_undump(struct peer_cache *c, const uint8_t *buff, int size);
 int cache_header_dump(uint8_t *b, const struct peer_cache *c, int include_me);
-int entry_dump(uint8_t *b, const struct peer_cache *e, int i, size_t max_write_size);
+int entry_dump(uint8_t *b, const struct peer_cache *e, int i, size_t max_write_size, int compact_ids);
+int entry_dump_delay(uint8_t *b, const struct peer_cache *e, int i, size_t max_write_size, int compact_ids, int dts);
+int cache_compact_ids(const struct peer_cache *c);
 
 struct peer_cache *merge_caches(const struct peer_cache *c1, const struct peer_cache *c2, int newsize, int *source);
+/*
+ * Merge remote into c, which keeps at most newsize entries: the IDs moved
+ * from remote are owned by c, and remote is left with the other ones.
+ * The storage of c is reused across merges.
+ */
+int cache_merge(struct peer_cache *c, struct peer_cache *remote, int newsize, int *source);
 struct peer_cache *cache_rank (const struct peer_cache *c, ranking_function rank, const struct nodeID *target, const void *target_meta);
+struct peer_cache *cache_rank_scored(const struct peer_cache *c, scoring_function score, ranking_function rank, const struct nodeID *target, const void *target_meta);
 struct peer_cache *cache_union(const struct peer_cache *c1, const struct peer_cache *c2, int *size);
 int cache_resize (struct peer_cache *c, int size);
 
@@ -45,5 +57,7 @@ void cache_check(const struct peer_cache *c);
 void cache_log(const struct peer_cache *c, const char *name);
 
 int cache_add_cache(struct peer_cache *dst, const struct peer_cache *src);
+/* As cache_add_cache(), but the IDs added to dst are moved from src */
+int cache_take_cache(struct peer_cache *dst, struct peer_cache *src);
 
 #endif  /* TOPOCACHE */
@@ -0,0 +1,176 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Chunk buffer indexed by chunk ID: the chunk with ID id is stored in
+ *  buffer[id % size], and the buffer contains the chunks with IDs in
+ *  [max_id - size + 1, max_id] (the most recent chunk has ID max_id).
+ *  Insertion, duplicate detection, lookup and eviction are O(1)
+ *  (amortised); reading the ordered list of chunks does not need sorting.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "chunkbuffer.h"
+#include "rcbuf.h"
+#include "buffer_private.h"
+#include "buffer_iface.h"
+
+struct cb_ring {
+  int max_id;
+  struct chunk *sorted;		/* ordered copy of the chunk descriptors */
+  int sorted_valid;
+};
+
+static inline int ring_slot(const struct chunk_buffer *cb, int id)
+{
+  return (unsigned int)id % cb->size;
+}
+
+static int ring_init(struct chunk_buffer *cb)
+{
+  cb->ring = malloc(sizeof(struct cb_ring));
+  if (cb->ring == NULL) {
+    return -1;
+  }
+  cb->ring->sorted = malloc(sizeof(struct chunk) * cb->size);
+  if (cb->ring->sorted == NULL) {
+    free(cb->ring);
+    cb->ring = NULL;
+
+    return -1;
+  }
+  cb->ring->max_id = -1;
+  cb->ring->sorted_valid = 0;
+
+  return 0;
+}
+
+static void ring_destroy(struct chunk_buffer *cb)
+{
+  free(cb->ring->sorted);
+  free(cb->ring);
+  cb->ring = NULL;
+}
+
+static int ring_clear(struct chunk_buffer *cb)
+{
+  int i;
+
+  for (i = 0; cb->num_chunks && i < cb->size; i++) {
+    if (cb->buffer[i].id >= 0) {
+      cb_chunk_free(cb, i);
+      cb->num_chunks--;
+    }
+  }
+  cb->ring->sorted_valid = 0;
+
+  return 0;
+}
+
+/* Move the window forward, so that its last chunk is id */
+static void ring_advance(struct chunk_buffer *cb, int id)
+{
+  int first, n, i;
+
+  first = cb->ring->max_id - cb->size + 1;
+  n = id - cb->ring->max_id;
+  if (n > cb->size) {
+    n = cb->size;
+  }
+  for (i = 0; cb->num_chunks && i < n; i++) {
+    int s = ring_slot(cb, first + i);
+
+    if (cb->buffer[s].id >= 0 && cb->buffer[s].id <= id - cb->size) {
+      cb_chunk_free(cb, s);
+      cb->num_chunks--;
+    }
+  }
+  cb->ring->max_id = id;
+}
+
+static int ring_add_chunk(struct chunk_buffer *cb, const struct chunk *c, struct rcbuf *ref)
+{
+  int i;
+
+  if (c->id < 0) {
+    return E_CB_OLD;
+  }
+  if (cb->num_chunks == 0) {
+    cb->ring->max_id = c->id;
+  } else if (c->id > cb->ring->max_id) {
+    ring_advance(cb, c->id);
+  } else if (c->id <= cb->ring->max_id - cb->size) {
+    // check for ID looparound and other anomalies
+    if (cb->buffer[ring_slot(cb, cb->ring->max_id)].timestamp < c->timestamp) {
+      ring_clear(cb);
+      cb->ring->max_id = c->id;
+    } else {
+      return E_CB_OLD;
+    }
+  }
+
+  i = ring_slot(cb, c->id);
+  if (cb->buffer[i].id == c->id) {
+    return E_CB_DUPLICATE;
+  }
+  cb->buffer[i] = *c;
+  cb->refs[i] = ref ? rcbuf_ref(ref) : NULL;
+  cb->num_chunks++;
+  cb->ring->sorted_valid = 0;
+
+  return 0;
+}
+
+static struct chunk *ring_get_chunks(const struct chunk_buffer *cb, int *n)
+{
+  struct cb_ring *r = cb->ring;
+  int id;
+
+  *n = cb->num_chunks;
+  if (*n == 0) {
+    return NULL;
+  }
+
+  if (!r->sorted_valid) {
+    int j = 0;
+
+    id = r->max_id - cb->size + 1;
+    if (id < 0) {
+      id = 0;
+    }
+    for (; id <= r->max_id; id++) {
+      const struct chunk *c = &cb->buffer[ring_slot(cb, id)];
+
+      if (c->id == id) {
+        r->sorted[j++] = *c;
+      }
+    }
+    r->sorted_valid = 1;
+  }
+
+  return r->sorted;
+}
+
+static const struct chunk *ring_get_chunk(const struct chunk_buffer *cb, int id)
+{
+  const struct chunk *c;
+
+  if (id < 0) {
+    return NULL;
+  }
+  c = &cb->buffer[ring_slot(cb, id)];
+
+  return c->id == id ? c : NULL;
+}
+
+struct cb_ops_iface ring_ops = {
+  .init = ring_init,
+  .add_chunk = ring_add_chunk,
+  .get_chunks = ring_get_chunks,
+  .get_chunk = ring_get_chunk,
+  .clear = ring_clear,
+  .destroy = ring_destroy,
+};
@@ -11,37 +11,48 @@
 
 #include "chunk.h"
 #include "chunkbuffer.h"
+#include "rcbuf.h"
+#include "chunk_pool.h"
 #include "grapes_config.h"
+#include "buffer_private.h"
+#include "buffer_iface.h"
 
-struct chunk_buffer {
-  int size;
-  int num_chunks;
-  struct chunk *buffer;
-};
+extern struct cb_ops_iface ring_ops;
 
-static void insert_sort(struct chunk *b, int size)
+static void insert_sort(struct chunk *b, struct rcbuf **refs, int size)
 {
   int i, j;
   struct chunk tmp;
+  struct rcbuf *tmp_ref;
 
   for(i = 1; i < size; i++) {
     tmp = b[i];
+    tmp_ref = refs[i];
     j = i - 1;
     while(j >= 0 && tmp.id < b[j].id) {
       b[j + 1] = b[j];
+      refs[j + 1] = refs[j];
       j = j - 1;
     }
     b[j + 1] = tmp;
+    refs[j + 1] = tmp_ref;
   }
 }
 
-static void chunk_free(struct chunk *c)
+void cb_chunk_free(struct chunk_buffer *cb, int i)
 {
-    free(c->data);
-    c->data = NULL;
-    free(c->attributes);
-    c->attributes = NULL;
-    c->id = -1;
+  struct chunk *c = &cb->buffer[i];
+
+  if (cb->refs[i]) {
+    rcbuf_unref(cb->refs[i]);
+    cb->refs[i] = NULL;
+  } else {
+    chunk_pool_free(c->data);
+    chunk_pool_free(c->attributes);
+  }
+  c->data = NULL;
+  c->attributes = NULL;
+  c->id = -1;
 }
 
 static int remove_oldest_chunk(struct chunk_buffer *cb, int id, uint64_t ts)
@@ -62,24 +73,104 @@ static int remove_oldest_chunk(struct chunk_buffer *cb, int id, uint64_t ts)
     }
   }
   if (min < id) {
-    chunk_free(&cb->buffer[pos_min]);
+    cb_chunk_free(cb, pos_min);
     cb->num_chunks--;
 
     return pos_min;
   }
   // check for ID looparound and other anomalies
   if (cb->buffer[pos_min].timestamp < ts) {
-    cb_clear(cb);
+    cb->ops->clear(cb);
     return 0;
   }
   return E_CB_OLD;
 }
 
+static int array_add_chunk(struct chunk_buffer *cb, const struct chunk *c, struct rcbuf *ref)
+{
+  int i;
+
+  if (cb->num_chunks == cb->size) {
+    i = remove_oldest_chunk(cb, c->id, c->timestamp);
+  } else {
+    i = 0;
+  }
+
+  if (i < 0) {
+    return i;
+  }
+  
+  while(1) {
+    if (cb->buffer[i].id == c->id) {
+      return E_CB_DUPLICATE;
+    }
+    if (cb->buffer[i].id < 0) {
+      cb->buffer[i] = *c;
+      cb->refs[i] = ref ? rcbuf_ref(ref) : NULL;
+      cb->num_chunks++;
+
+      return 0; 
+    }
+    i++;
+  }
+}
+
+static struct chunk *array_get_chunks(const struct chunk_buffer *cb, int *n)
+{
+  *n = cb->num_chunks;
+  if (*n == 0) {
+    return NULL;
+  }
+
+  insert_sort(cb->buffer, cb->refs, cb->num_chunks);
+
+  return cb->buffer;
+}
+
+static const struct chunk *array_get_chunk(const struct chunk_buffer *cb, int id)
+{
+  int i, n;
+  const struct chunk *buffer;
+
+  buffer = array_get_chunks(cb, &n);
+  if (buffer == NULL) {
+    return NULL;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (buffer[i].id == id) {
+      return &buffer[i];
+    }
+  }
+
+  return NULL;
+}
+
+static int array_clear(struct chunk_buffer *cb)
+{
+  int i;
+
+  for (i = 0; i < cb->num_chunks; i++) {
+    cb_chunk_free(cb, i);
+  }
+  cb->num_chunks = 0;
+
+  return 0;
+}
+
+struct cb_ops_iface array_ops = {
+  .add_chunk = array_add_chunk,
+  .get_chunks = array_get_chunks,
+  .get_chunk = array_get_chunk,
+  .clear = array_clear,
+};
+
 struct chunk_buffer *cb_init(const char *config)
 {
   struct tag *cfg_tags;
   struct chunk_buffer *cb;
-  int res, i;
+  const char *type;
+  int res, i, pool_size;
 
   cb = malloc(sizeof(struct chunk_buffer));
   if (cb == NULL) {
@@ -93,12 +184,27 @@ struct chunk_buffer *cb_init(const char *config)
     return NULL;
   }
   res = grapes_config_value_int(cfg_tags, "size", &cb->size);
-  if (!res) {
+  if (!res || cb->size <= 0) {
     free(cb);
     free(cfg_tags);
 
     return NULL;
   }
+  cb->ops = &array_ops;
+  type = grapes_config_value_str(cfg_tags, "type");
+  if (type) {
+    if (!strcmp(type, "ring")) {
+      cb->ops = &ring_ops;
+    } else if (strcmp(type, "array")) {
+      free(cb);
+      free(cfg_tags);
+
+      return NULL;
+    }
+  }
+  if (grapes_config_value_int(cfg_tags, "pool_size", &pool_size)) {
+    chunk_pool_init(pool_size > 0 ? pool_size : 0);
+  }
   free(cfg_tags);
 
   cb->buffer = malloc(sizeof(struct chunk) * cb->size);
@@ -107,68 +213,52 @@ struct chunk_buffer *cb_init(const char *config)
     return NULL;
   }
   memset(cb->buffer, 0, sizeof(struct chunk) * cb->size);
+  cb->refs = calloc(cb->size, sizeof(struct rcbuf *));
+  if (cb->refs == NULL) {
+    free(cb->buffer);
+    free(cb);
+    return NULL;
+  }
   for (i = 0; i < cb->size; i++) {
     cb->buffer[i].id = -1;
   }
+  if (cb->ops->init && cb->ops->init(cb) < 0) {
+    free(cb->refs);
+    free(cb->buffer);
+    free(cb);
+    return NULL;
+  }
 
   return cb;
 }
 
 int cb_add_chunk(struct chunk_buffer *cb, const struct chunk *c)
 {
-  int i;
-
-  if (cb->num_chunks == cb->size) {
-    i = remove_oldest_chunk(cb, c->id, c->timestamp);
-  } else {
-    i = 0;
-  }
-
-  if (i < 0) {
-    return i;
-  }
-  
-  while(1) {
-    if (cb->buffer[i].id == c->id) {
-      return E_CB_DUPLICATE;
-    }
-    if (cb->buffer[i].id < 0) {
-      cb->buffer[i] = *c;
-      cb->num_chunks++;
+  return cb->ops->add_chunk(cb, c, NULL);
+}
 
-      return 0; 
-    }
-    i++;
-  }
+int cb_add_chunk_ref(struct chunk_buffer *cb, const struct chunk *c, struct rcbuf *b)
+{
+  return cb->ops->add_chunk(cb, c, b);
 }
 
 struct chunk *cb_get_chunks(const struct chunk_buffer *cb, int *n)
 {
-  *n = cb->num_chunks;
-  if (*n == 0) {
-    return NULL;
-  }
-
-  insert_sort(cb->buffer, cb->num_chunks);
-
-  return cb->buffer;
+  return cb->ops->get_chunks(cb, n);
 }
 
 int cb_clear(struct chunk_buffer *cb)
 {
-  int i;
-
-  for (i = 0; i < cb->num_chunks; i++) {
-    chunk_free(&cb->buffer[i]);
-  }
-  cb->num_chunks = 0;
-
-  return 0;
+  return cb->ops->clear(cb);
 }
 
 void cb_destroy(struct chunk_buffer *cb)
 {
   cb_clear(cb);
+  if (cb->ops->destroy) {
+    cb->ops->destroy(cb);
+  }
+  free(cb->refs);
   free(cb->buffer);
   free(cb);
 }
@@ -0,0 +1,16 @@
+#ifndef CHUNK_BUFFER_IFACE
+#define CHUNK_BUFFER_IFACE
+
+struct chunk_buffer;
+struct rcbuf;
+
+struct cb_ops_iface {
+  int (*init)(struct chunk_buffer *cb);
+  int (*add_chunk)(struct chunk_buffer *cb, const struct chunk *c, struct rcbuf *ref);
+  struct chunk *(*get_chunks)(const struct chunk_buffer *cb, int *n);
+  const struct chunk *(*get_chunk)(const struct chunk_buffer *cb, int id);
+  int (*clear)(struct chunk_buffer *cb);
+  void (*destroy)(struct chunk_buffer *cb);
+};
+
+#endif	/* CHUNK_BUFFER_IFACE */
@@ -0,0 +1,18 @@
+#ifndef CHUNK_BUFFER_PRIVATE
+#define CHUNK_BUFFER_PRIVATE
+
+struct rcbuf;
+struct cb_ring;
+
+struct chunk_buffer {
+  int size;
+  int num_chunks;
+  struct chunk *buffer;
+  struct rcbuf **refs;	/* buffer containing the payload of buffer[i], or NULL if owned */
+  struct cb_ops_iface *ops;
+  struct cb_ring *ring;
+};
+
+void cb_chunk_free(struct chunk_buffer *cb, int i);
+
+#endif	/* CHUNK_BUFFER_PRIVATE */
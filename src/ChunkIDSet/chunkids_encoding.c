@@ -15,17 +15,6 @@
 #include "trade_sig_la.h"
 #include "int_coding.h"
 
-static const char *type_name(uint32_t type)
-{
-  if (type == CIST_PRIORITY) {
-    return "priority";
-  } else if (type == CIST_BITMAP) {
-    return "bitmap";
-  }
-
-  return "Unknown";
-}
-
 int encodeChunkSignaling(const struct chunkID_set *h, const void *meta, int meta_len, uint8_t *buff, int buff_len)
 {
   uint8_t *meta_p;
@@ -51,32 +40,73 @@ int encodeChunkSignaling(const struct chunkID_set *h, const void *meta, int meta
   return meta_p + meta_len - buff;
 }
 
-struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8_t *buff, int buff_len)
+int decodeChunkSignalingInto(struct chunkID_set *h, const uint8_t **meta, int *meta_len, const uint8_t *buff, int buff_len)
 {
-  uint32_t size;
   uint32_t type;
-  struct chunkID_set *h;
   const uint8_t *meta_p;
+  int res;
 
-  size = int_rcpy(buff);
+  *meta = NULL;
+  *meta_len = 0;
+  if (buff_len < 12) {
+    return -1;
+  }
   type = int_rcpy(buff + 4);
   *meta_len = int_rcpy(buff + 8);
+  if (*meta_len < 0 || *meta_len > buff_len - 12) {
+    *meta_len = 0;
 
-  if (type != -1) {
-    char cfg[32];
+    return -1;
+  }
 
-    memset(cfg, 0, sizeof(cfg));
-    sprintf(cfg, "size=%d,type=%s", size, type_name(type));
-    h = chunkID_set_init(cfg);
-    if (h == NULL) {
-      fprintf(stderr, "Error in decoding chunkid set - not enough memory to create a chunkID set.\n");
+  if (type != -1) {
+    if (chunkID_set_reset(h, type) < 0) {
+      fprintf(stderr, "Error in decoding chunkid set - unknown type %u.\n", type);
+      *meta_len = 0;
 
-      return NULL;
+      return -1;
     }
     meta_p = h->enc->decode(h, buff, buff_len, meta_len);
+    if (meta_p == NULL) {
+      chunkID_set_trim(h, 0);
+      *meta_len = 0;
+
+      return -1;
+    }
+    res = 1;
   } else {
-    h = NULL;
+    chunkID_set_trim(h, 0);
     meta_p = buff + 12;
+    res = 0;
+  }
+  if (*meta_len) {
+    *meta = meta_p;
+  }
+
+  return res;
+}
+
+struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8_t *buff, int buff_len)
+{
+  struct chunkID_set *h;
+  const uint8_t *meta_p;
+  int res;
+
+  *meta = NULL;
+  h = chunkID_set_alloc();
+  if (h == NULL) {
+    fprintf(stderr, "Error in decoding chunkid set - not enough memory to create a chunkID set.\n");
+    *meta_len = 0;
+
+    return NULL;
+  }
+  res = decodeChunkSignalingInto(h, &meta_p, meta_len, buff, buff_len);
+  if (res <= 0) {
+    chunkID_set_free(h);
+    h = NULL;
+    if (res < 0) {
+      return NULL;
+    }
   }
 
   if (*meta_len) {
@@ -86,8 +116,6 @@ struct chunkID_set *decodeChunkSignaling(void **meta, int *meta_len, const uint8
     } else {
       *meta_len = 0;
     }
-  } else {
-    *meta = NULL;
   }
 
   return h;
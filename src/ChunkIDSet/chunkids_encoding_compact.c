@@ -0,0 +1,191 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Compact encoding of sorted chunk ID sets. The IDs are encoded either
+ *  as deltas between consecutive IDs, or as runs of consecutive IDs
+ *  (gap from the previous run and length); all the numbers are varints,
+ *  and the smallest of the two representations is chosen for each set.
+ *
+ *  Format: n_elements (4 bytes), type, meta_len (4 bytes each), mode
+ *  (1 byte), then
+ *  - COMPACT_DELTA: first ID, (ID - previous ID - 1) for the other IDs
+ *  - COMPACT_RUNS: number of runs, then (start - previous end - 1,
+ *    length - 1) for each run (the first gap is the first ID)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
+#include "int_coding.h"
+#include "chunkidset.h"
+
+#define COMPACT_DELTA 0
+#define COMPACT_RUNS 1
+/* Runs do not need space in the message: limit the size of decoded sets */
+#define COMPACT_MAX_ELEMENTS (1 << 16)
+
+static uint8_t *compact_encode(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len)
+{
+  int i, n, runs, delta_len, runs_len, start;
+  uint32_t prev;
+  uint8_t *p;
+
+  n = chunkID_set_size(h);
+  int_cpy(buff, n);
+
+  /* Compute the size of both the representations */
+  delta_len = runs_len = runs = 0;
+  prev = 0;
+  start = 0;
+  for (i = 0; i < n; i++) {
+    uint32_t id = chunkID_set_get_chunk(h, i);
+
+    if (i == 0) {
+      delta_len += varint_len(id);
+    } else {
+      delta_len += varint_len(id - prev - 1);
+      if (id != prev + 1) {
+        runs_len += varint_len(i - start - 1);
+        start = i;
+      }
+    }
+    if (i == start) {
+      runs_len += varint_len(runs ? id - prev - 1 : id);
+      runs++;
+    }
+    prev = id;
+  }
+  if (n) {
+    runs_len += varint_len(n - start - 1);
+  }
+  runs_len += varint_len(runs);
+
+  if (buff_len < 12 + 1 + (delta_len < runs_len ? delta_len : runs_len) + meta_len) {
+    return NULL;
+  }
+
+  p = buff + 12;
+  if (delta_len <= runs_len) {
+    *p++ = COMPACT_DELTA;
+    for (i = 0; i < n; i++) {
+      uint32_t id = chunkID_set_get_chunk(h, i);
+
+      p += varint_cpy(p, i ? id - prev - 1 : id);
+      prev = id;
+    }
+  } else {
+    *p++ = COMPACT_RUNS;
+    p += varint_cpy(p, runs);
+    for (i = 0; i < n; i = start) {
+      uint32_t first = chunkID_set_get_chunk(h, i), last = first;
+
+      for (start = i + 1; start < n && chunkID_set_get_chunk(h, start) == last + 1; start++) {
+        last++;
+      }
+      p += varint_cpy(p, i ? first - prev - 1 : first);
+      p += varint_cpy(p, start - i - 1);
+      prev = last;
+    }
+  }
+
+  return p;
+}
+
+static const uint8_t *compact_decode(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len)
+{
+  const uint8_t *p = buff + 12, *end = buff + buff_len - *meta_len;
+  uint32_t n, count, v, id = 0, first = 0;
+  uint64_t next;
+  int len, mode;
+
+  n = int_rcpy(buff);
+  if (end < p + 1 || n > COMPACT_MAX_ELEMENTS) {
+    goto error;
+  }
+  mode = *p++;
+  count = 0;
+  /* Each ID needs at least one byte, unless it is in a run */
+  if (chunkID_set_reserve(h, mode == COMPACT_DELTA && n <= end - p ? n : 0) < 0) {
+    goto error;
+  }
+  if (mode == COMPACT_DELTA) {
+    while (count < n) {
+      len = varint_rcpy(p, end - p, &v);
+      if (len < 0) {
+        goto error;
+      }
+      p += len;
+      next = count ? (uint64_t)id + v + 1 : v;
+      if (next > INT_MAX) {
+        goto error;
+      }
+      id = next;
+      if (count == 0) {
+        first = id;
+      }
+      if (chunkID_set_fit_range(h, first, id) < 0 || h->ops->add_chunk(h, id) < 0) {
+        goto error;
+      }
+      count++;
+    }
+  } else if (mode == COMPACT_RUNS) {
+    uint32_t runs, r, run_len;
+
+    len = varint_rcpy(p, end - p, &runs);
+    if (len < 0) {
+      goto error;
+    }
+    p += len;
+    for (r = 0; r < runs; r++) {
+      len = varint_rcpy(p, end - p, &v);
+      if (len < 0) {
+        goto error;
+      }
+      p += len;
+      len = varint_rcpy(p, end - p, &run_len);
+      if (len < 0 || run_len >= n - count) {
+        goto error;
+      }
+      p += len;
+      next = count ? (uint64_t)id + v + 1 : v;
+      if (next + run_len > INT_MAX) {
+        goto error;
+      }
+      id = next;
+      if (count == 0) {
+        first = id;
+      }
+      if (chunkID_set_fit_range(h, first, id + run_len) < 0) {
+        goto error;
+      }
+      for (run_len++; run_len; run_len--) {
+        if (h->ops->add_chunk(h, id) < 0) {
+          goto error;
+        }
+        count++;
+        id++;
+      }
+      id--;
+    }
+  }
+  if (count != n) {
+    goto error;
+  }
+
+  return p;
+
+error:
+  fprintf(stderr, "Error in decoding chunkid set - wrong length\n");
+
+  return NULL;
+}
+
+struct cids_encoding_iface compact_encoding = {
+  .encode = compact_encode,
+  .decode = compact_decode,
+};
@@ -0,0 +1,86 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Encoding of dense chunk ID sets: the wire format is the one used by
+ *  bmap_encoding, so the sets can be decoded by any peer; the bitmap is
+ *  copied 64 bits at a time, and the smallest and largest IDs are already
+ *  known, so the IDs do not need to be scanned.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
+#include "int_coding.h"
+#include "chunkidset.h"
+
+static uint8_t *dense_encode(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len)
+{
+  const struct cids_bitmap *b = h->bitmap;
+  int i, j, elements, bytes, off;
+
+  elements = h->n_elements ? b->max - b->min + 1 : 0;
+  int_cpy(buff, elements);
+  bytes = elements / 8 + (elements % 8 ? 1 : 0);
+  if (buff_len < bytes + 16 + meta_len) {
+    return NULL;
+  }
+  int_cpy(buff + 12, h->n_elements ? b->min : 0);
+
+  off = h->n_elements ? b->min - b->base : 0;
+  for (i = 0; i < bytes; i += 8) {
+    int w = (off + i * 8) / 64, s = (off + i * 8) % 64;
+    uint64_t v = b->words[w] >> s;
+
+    if (s && w + 1 < b->n_words) {
+      v |= b->words[w + 1] << (64 - s);
+    }
+    for (j = 0; j < 8 && i + j < bytes; j++) {
+      buff[16 + i + j] = v >> (j * 8);
+    }
+  }
+
+  return buff + 16 + bytes;
+}
+
+static const uint8_t *dense_decode(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len)
+{
+  int i, base, elements, byte_cnt;
+
+  elements = int_rcpy(buff);
+  byte_cnt = elements / 8 + (elements % 8 ? 1 : 0);
+  if (elements < 0 || buff_len < 16 + byte_cnt + *meta_len) {
+    fprintf(stderr, "Error in decoding chunkid set - wrong length\n");
+
+    return NULL;
+  }
+  base = int_rcpy(buff + 12);
+  if (elements && ((int64_t)base + elements - 1 > INT_MAX ||
+                   chunkID_set_fit_range(h, base, base + elements - 1) < 0)) {
+    return NULL;
+  }
+  for (i = 0; i < byte_cnt; i++) {
+    uint8_t v = buff[16 + i];
+
+    if (i == byte_cnt - 1 && elements % 8) {
+      v &= (1 << (elements % 8)) - 1;
+    }
+    while (v) {
+      if (h->ops->add_chunk(h, base + i * 8 + __builtin_ctz(v)) < 0) {
+        return NULL;
+      }
+      v &= v - 1;
+    }
+  }
+
+  return buff + 16 + byte_cnt;
+}
+
+struct cids_encoding_iface dense_encoding = {
+  .encode = dense_encode,
+  .decode = dense_decode,
+};
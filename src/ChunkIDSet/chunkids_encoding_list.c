@@ -25,20 +25,23 @@ static uint8_t *prio_encode(const struct chunkID_set *h, uint8_t *buff, int buff
 
 static const uint8_t *prio_decode(struct chunkID_set *h, const uint8_t *buff, int buff_len, int *meta_len)
 {
-  int i;
+  int i, n;
 
-  if (buff_len != h->size * 4 + 12 + *meta_len) {
+  n = int_rcpy(buff);
+  if (n < 0 || n > buff_len / 4 || buff_len != n * 4 + 12 + *meta_len) {
     fprintf(stderr, "Error in decoding chunkid set - wrong length.\n");
-    chunkID_set_free(h);
 
     return NULL;
   }
-  for (i = 0; i < h->size; i++) {
+  if (chunkID_set_reserve(h, n) < 0) {
+    return NULL;
+  }
+  for (i = 0; i < n; i++) {
     h->elements[i] = int_rcpy(buff + 12 + i * 4);
   }
-  h->n_elements = h->size;
+  h->n_elements = n;
 
-  return buff + 12 + h->size * 4;
+  return buff + 12 + n * 4;
 }
 
 struct cids_encoding_iface prio_encoding = {
@@ -39,19 +39,22 @@ static const uint8_t *bmap_decode(struct chunkID_set *h, const uint8_t *buff, in
 {
   int i;
   int base;
-  int byte_cnt;
+  int byte_cnt, bits;
 
-  byte_cnt = h->size / 8 + (h->size % 8 ? 1 : 0);
-  if (buff_len < 16 + byte_cnt + *meta_len) {
+  bits = int_rcpy(buff);
+  byte_cnt = bits / 8 + (bits % 8 ? 1 : 0);
+  if (bits < 0 || buff_len < 16 + byte_cnt + *meta_len) {
     fprintf(stderr, "Error in decoding chunkid set - wrong length\n");
-    chunkID_set_free(h);
 
     return NULL;
   }
+  if (chunkID_set_reserve(h, bits) < 0) {
+    return NULL;
+  }
   base = int_rcpy(buff + 12);
-  for (i = h->size - 1; i >= 0; i--) {
-  if (buff[16 + (i / 8)] & 1 << (i % 8))
-    h->elements[h->n_elements++] = base + i;
+  for (i = 0; i < bits; i++) {
+    if (buff[16 + (i / 8)] & 1 << (i % 8))
+      h->elements[h->n_elements++] = base + i;
   }
 
   return buff + 16 + byte_cnt;
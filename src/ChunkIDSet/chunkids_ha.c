@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <assert.h>
 
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
 #include "chunkidset.h"
 
 uint32_t chunkID_set_get_earliest(const struct chunkID_set *h)
@@ -50,6 +52,9 @@ int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a)
 {
   int i;
 
+  if (h->ops == a->ops && h->ops->set_op) {
+    return h->ops->set_op(h, a, CIDS_UNION);
+  }
   for (i = 0; i < chunkID_set_size(a); i++) {
     int ret = chunkID_set_add_chunk(h, chunkID_set_get_chunk(a, i));
     if (ret < 0) return ret;
@@ -57,3 +62,81 @@ int chunkID_set_union(struct chunkID_set *h, struct chunkID_set *a)
 
   return chunkID_set_size(h);
 }
+
+/*
+ * Generic implementation of intersection and difference: keep the chunk
+ * IDs of h that are (keep = 1) or are not (keep = 0) in a, preserving
+ * their order.
+ */
+static int chunkID_set_filter(struct chunkID_set *h, const struct chunkID_set *a, int keep)
+{
+  int i, n;
+
+  if (h->ops->get_chunk == NULL) {
+    for (i = 0, n = 0; i < h->n_elements; i++) {
+      if ((chunkID_set_check(a, h->elements[i]) >= 0) == keep) {
+        h->elements[n++] = h->elements[i];
+      }
+    }
+    h->n_elements = n;
+  } else {
+    int *ids, size = chunkID_set_size(h);
+
+    ids = malloc(size * sizeof(int) + 1);
+    if (ids == NULL) {
+      return -1;
+    }
+    for (i = 0, n = 0; i < size; i++) {
+      int id = chunkID_set_get_chunk(h, i);
+
+      if ((chunkID_set_check(a, id) >= 0) == keep) {
+        ids[n++] = id;
+      }
+    }
+    chunkID_set_clear(h, n);
+    for (i = 0; i < n; i++) {
+      if (chunkID_set_add_chunk(h, ids[i]) < 0) {
+        free(ids);
+
+        return -1;
+      }
+    }
+    free(ids);
+  }
+
+  return chunkID_set_size(h);
+}
+
+int chunkID_set_intersection(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  if (h->ops == a->ops && h->ops->set_op) {
+    return h->ops->set_op(h, a, CIDS_INTERSECTION);
+  }
+
+  return chunkID_set_filter(h, a, 1);
+}
+
+int chunkID_set_difference(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  if (h->ops == a->ops && h->ops->set_op) {
+    return h->ops->set_op(h, a, CIDS_DIFFERENCE);
+  }
+
+  return chunkID_set_filter(h, a, 0);
+}
+
+int chunkID_set_count_difference(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i, n;
+
+  if (h->ops == a->ops && h->ops->count_difference) {
+    return h->ops->count_difference(h, a);
+  }
+  for (i = 0, n = 0; i < chunkID_set_size(h); i++) {
+    if (chunkID_set_check(a, chunkID_set_get_chunk(h, i)) < 0) {
+      n++;
+    }
+  }
+
+  return n;
+}
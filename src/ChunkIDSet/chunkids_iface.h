@@ -3,9 +3,22 @@
 
 struct chunkID_set;
 
+enum cids_set_op {
+  CIDS_UNION,
+  CIDS_INTERSECTION,
+  CIDS_DIFFERENCE,
+};
+
 struct cids_ops_iface {
   int (*add_chunk)(struct chunkID_set *h, int chunk_id);
   int (*check)(const struct chunkID_set *h, int chunk_id);
+  /* Optional: if NULL, the IDs are stored in h->elements */
+  int (*get_chunk)(const struct chunkID_set *h, int i);
+  void (*clear)(struct chunkID_set *h, int size);
+  void (*trim)(struct chunkID_set *h, int size);
+  /* Optional: bulk operations between two sets with the same ops */
+  int (*set_op)(struct chunkID_set *h, const struct chunkID_set *a, enum cids_set_op op);
+  int (*count_difference)(const struct chunkID_set *h, const struct chunkID_set *a);
 };
 struct cids_encoding_iface {
   uint8_t *(*encode)(const struct chunkID_set *h, uint8_t *buff, int buff_len, int meta_len);
@@ -21,6 +21,9 @@ extern struct cids_encoding_iface prio_encoding;
 extern struct cids_encoding_iface bmap_encoding;
 extern struct cids_ops_iface list_ops;
 extern struct cids_ops_iface set_ops;
+extern struct cids_encoding_iface dense_encoding;
+extern struct cids_ops_iface dense_ops;
+extern struct cids_encoding_iface compact_encoding;
 
 struct chunkID_set *chunkID_set_init(const char *config)
 {
@@ -29,11 +32,10 @@ struct chunkID_set *chunkID_set_init(const char *config)
   int res;
   const char *type;
 
-  p = malloc(sizeof(struct chunkID_set));
+  p = chunkID_set_alloc();
   if (p == NULL) {
     return NULL;
   }
-  p->n_elements = 0;
   cfg_tags = grapes_config_parse(config);
   if (!cfg_tags) {
     free(p);
@@ -43,17 +45,6 @@ struct chunkID_set *chunkID_set_init(const char *config)
   if (!res) {
     p->size = 0;
   }
-  if (p->size) {
-    p->elements = malloc(p->size * sizeof(int));
-    if (p->elements == NULL) {
-      p->size = 0;
-    }
-  } else {
-    p->elements = NULL;
-  }
-  p->enc = &prio_encoding;
-  p->ops = &list_ops;
-  p->type = CIST_PRIORITY;
   type = grapes_config_value_str(cfg_tags, "type");
   if (type) {
     if (!memcmp(type, "priority", strlen(type) - 1)) {
@@ -64,6 +55,10 @@ struct chunkID_set *chunkID_set_init(const char *config)
       p->enc = &bmap_encoding;
       p->ops = &set_ops;
       p->type = CIST_BITMAP;
+    } else if (!memcmp(type, "dense", strlen(type) - 1)) {
+      p->enc = &dense_encoding;
+      p->ops = &dense_ops;
+      p->type = CIST_BITMAP;
     } else {
       chunkID_set_free(p);
       free(cfg_tags);
@@ -71,12 +66,151 @@ struct chunkID_set *chunkID_set_init(const char *config)
       return NULL; 
     }
   }
+  type = grapes_config_value_str(cfg_tags, "encoding");
+  if (type) {
+    /* The compact encoding needs the IDs to be sorted */
+    if (memcmp(type, "compact", strlen(type) - 1) || p->ops == &list_ops) {
+      chunkID_set_free(p);
+      free(cfg_tags);
+
+      return NULL;
+    }
+    p->enc = &compact_encoding;
+    p->type = CIST_COMPACT;
+  }
   free(cfg_tags);
-  assert(p->type == CIST_PRIORITY || p->type == CIST_BITMAP);
+  if (p->ops->clear) {
+    p->ops->clear(p, p->size);
+  } else if (p->size) {
+    p->elements = malloc(p->size * sizeof(int));
+    if (p->elements == NULL) {
+      p->size = 0;
+    }
+  }
+  assert(p->type == CIST_PRIORITY || p->type == CIST_BITMAP || p->type == CIST_COMPACT);
 
   return p;
 }
 
+/* Allocate an empty "priority" set, without parsing any configuration */
+struct chunkID_set *chunkID_set_alloc(void)
+{
+  struct chunkID_set *p;
+
+  p = malloc(sizeof(struct chunkID_set));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->n_elements = 0;
+  p->size = 0;
+  p->elements = NULL;
+  p->bitmap = NULL;
+  p->enc = &prio_encoding;
+  p->ops = &list_ops;
+  p->type = CIST_PRIORITY;
+
+  return p;
+}
+
+/*
+ * Empty a set and prepare it for decoding a set with the given wire type,
+ * reusing its memory. Sorted ("bitmap" or "dense") sets keep their
+ * implementation if the received set is sorted too; otherwise, the
+ * implementation is selected by the wire type.
+ */
+int chunkID_set_reset(struct chunkID_set *h, uint32_t type)
+{
+  int sorted = h->ops == &set_ops || h->ops == &dense_ops;
+
+  switch (type) {
+    case CIST_PRIORITY:
+      if (h->ops->clear) {
+        h->ops->clear(h, 0);
+      }
+      h->ops = &list_ops;
+      h->enc = &prio_encoding;
+      break;
+    case CIST_BITMAP:
+      if (!sorted) {
+        h->ops = &set_ops;
+      }
+      h->enc = h->ops == &dense_ops ? &dense_encoding : &bmap_encoding;
+      break;
+    case CIST_COMPACT:
+      if (!sorted) {
+        h->ops = &set_ops;
+      }
+      h->enc = &compact_encoding;
+      break;
+    default:
+      return -1;
+  }
+  h->type = type;
+  if (h->ops->trim) {
+    h->ops->trim(h, 0);
+  }
+  h->n_elements = 0;
+
+  return 0;
+}
+
+/* Make sure that size IDs can be stored in h->elements */
+int chunkID_set_reserve(struct chunkID_set *h, int size)
+{
+  int *res;
+
+  if (h->ops->get_chunk || size <= h->size) {
+    return 0;
+  }
+  res = realloc(h->elements, size * sizeof(int));
+  if (res == NULL) {
+    return -1;
+  }
+  h->elements = res;
+  h->size = size;
+
+  return 0;
+}
+
+/* Switch a "dense" set to the "bitmap" implementation, keeping its IDs */
+static int chunkID_set_sparse(struct chunkID_set *h)
+{
+  int *elements;
+  int i, n = h->n_elements;
+
+  elements = malloc((n ? n : 1) * sizeof(int));
+  if (elements == NULL) {
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    elements[i] = h->ops->get_chunk(h, i);
+  }
+  h->ops->clear(h, 0);
+  free(h->elements);
+  h->elements = elements;
+  h->size = n;
+  h->n_elements = n;
+  h->ops = &set_ops;
+  if (h->enc == &dense_encoding) {
+    h->enc = &bmap_encoding;
+  }
+
+  return 0;
+}
+
+/*
+ * Called by the decoders before storing IDs in [min, max]: a "dense" set
+ * is switched to the "bitmap" implementation if the range is too large.
+ */
+int chunkID_set_fit_range(struct chunkID_set *h, int min, int max)
+{
+  if (h->ops != &dense_ops || (int64_t)max - min <= CHUNKID_SET_DENSE_RANGE) {
+    return 0;
+  }
+
+  return chunkID_set_sparse(h);
+}
+
 int chunkID_set_add_chunk(struct chunkID_set *h, int chunk_id)
 {
   return h->ops->add_chunk(h, chunk_id);
@@ -90,6 +224,9 @@ int chunkID_set_size(const struct chunkID_set *h)
 
 int chunkID_set_get_chunk(const struct chunkID_set *h, int i)
 {
+  if (h->ops->get_chunk) {
+    return h->ops->get_chunk(h, i);
+  }
   if (i < h->n_elements) {
     return h->elements[i];
   }
@@ -104,6 +241,11 @@ int chunkID_set_check(const struct chunkID_set *h, int chunk_id)
 
 void chunkID_set_clear(struct chunkID_set *h, int size)
 {
+  if (h->ops->clear) {
+    h->ops->clear(h, size);
+
+    return;
+  }
   h->n_elements = 0;
   h->size = size;
   h->elements = realloc(h->elements, size * sizeof(int));
@@ -121,6 +263,11 @@ void chunkID_set_free(struct chunkID_set *h)
 
 void chunkID_set_trim(struct chunkID_set *h, int size)
 {
+  if (h->ops->trim) {
+    h->ops->trim(h, size);
+
+    return;
+  }
   if (h->n_elements > size) {
     memmove(h->elements, h->elements + h->n_elements - size, sizeof(h->elements[0]) * size);
     h->n_elements = size;
@@ -0,0 +1,404 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Dense chunk ID sets: the IDs are stored as a bitmap starting from a
+ *  base ID, so that insertion and lookup are O(1). Memory usage is
+ *  proportional to the distance between the smallest and the largest ID,
+ *  so these sets are intended for windows of consecutive chunks (such as
+ *  buffer maps).
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "chunkids_private.h"
+#include "chunkids_iface.h"
+
+#define WORD_BITS 64
+#define WORD_BASE(id) ((id) & ~(WORD_BITS - 1))
+
+static struct cids_bitmap *bitmap_alloc(int base, int n_words)
+{
+  struct cids_bitmap *b;
+
+  b = malloc(sizeof(struct cids_bitmap) + n_words * sizeof(uint64_t));
+  if (b == NULL) {
+    return NULL;
+  }
+  memset(b, 0, sizeof(struct cids_bitmap) + n_words * sizeof(uint64_t));
+  b->base = base;
+  b->n_words = n_words;
+
+  return b;
+}
+
+/*
+ * Make room for chunk_id: the bitmap is moved so that it starts at the
+ * word containing the smallest ID, and is enlarged if needed.
+ */
+static int bitmap_extend(struct chunkID_set *h, int chunk_id)
+{
+  struct cids_bitmap *b = h->bitmap;
+  int64_t lo, hi;
+  int n_words, need, shift;
+
+  lo = WORD_BASE(chunk_id);
+  hi = chunk_id;
+  if (h->n_elements) {
+    if (WORD_BASE(b->min) < lo) {
+      lo = WORD_BASE(b->min);
+    }
+    if (b->max > hi) {
+      hi = b->max;
+    }
+  }
+  need = (hi - lo) / WORD_BITS + 1;
+
+  if (need > b->n_words) {
+    struct cids_bitmap *nb;
+
+    for (n_words = b->n_words ? b->n_words : 1; n_words < need; n_words *= 2);
+    nb = bitmap_alloc(lo, n_words);
+    if (nb == NULL) {
+      return -1;
+    }
+    if (h->n_elements) {
+      shift = (WORD_BASE(b->min) - lo) / WORD_BITS;
+      memcpy(nb->words + shift, b->words + (WORD_BASE(b->min) - b->base) / WORD_BITS,
+             ((b->max - WORD_BASE(b->min)) / WORD_BITS + 1) * sizeof(uint64_t));
+      nb->min = b->min;
+      nb->max = b->max;
+    }
+    free(b);
+    h->bitmap = nb;
+
+    return 0;
+  }
+
+  if (h->n_elements) {
+    int first = (WORD_BASE(b->min) - b->base) / WORD_BITS;
+    int used = (b->max - WORD_BASE(b->min)) / WORD_BITS + 1;
+
+    shift = (WORD_BASE(b->min) - lo) / WORD_BITS;
+    memmove(b->words + shift, b->words + first, used * sizeof(uint64_t));
+    if (shift > first) {
+      memset(b->words + first, 0, (shift - first) * sizeof(uint64_t));
+    } else {
+      memset(b->words + shift + used, 0, (b->n_words - shift - used) * sizeof(uint64_t));
+    }
+  }
+  b->base = lo;
+  b->cur_word = 0;
+  b->cur_before = 0;
+
+  return 0;
+}
+
+static int chunkID_set_add_chunk_dense(struct chunkID_set *h, int chunk_id)
+{
+  struct cids_bitmap *b = h->bitmap;
+  uint64_t *w, mask;
+  int off;
+
+  if (b == NULL) {
+    b = h->bitmap = bitmap_alloc(WORD_BASE(chunk_id), 1);
+    if (b == NULL) {
+      return -1;
+    }
+  }
+  if (chunk_id < b->base || (int64_t)chunk_id - b->base >= (int64_t)b->n_words * WORD_BITS) {
+    if (bitmap_extend(h, chunk_id) < 0) {
+      return -1;
+    }
+    b = h->bitmap;
+  }
+
+  off = chunk_id - b->base;
+  w = &b->words[off / WORD_BITS];
+  mask = 1ULL << (off % WORD_BITS);
+  if (*w & mask) {
+    return 0;
+  }
+  *w |= mask;
+  if (h->n_elements++ == 0) {
+    b->min = b->max = chunk_id;
+  } else if (chunk_id < b->min) {
+    b->min = chunk_id;
+  } else if (chunk_id > b->max) {
+    b->max = chunk_id;
+  }
+  b->cur_word = 0;
+  b->cur_before = 0;
+
+  return h->n_elements;
+}
+
+/*
+ * The "priority" of a chunk ID is its distance from the smallest ID in
+ * the set (so, it grows with the ID like the index in the set does).
+ */
+static int chunkID_set_check_dense(const struct chunkID_set *h, int chunk_id)
+{
+  const struct cids_bitmap *b = h->bitmap;
+  int off;
+
+  if (h->n_elements == 0 || chunk_id < b->min || chunk_id > b->max) {
+    return -1;
+  }
+  off = chunk_id - b->base;
+
+  return (b->words[off / WORD_BITS] >> (off % WORD_BITS)) & 1 ? chunk_id - b->min : -1;
+}
+
+static int chunkID_set_get_chunk_dense(const struct chunkID_set *h, int i)
+{
+  struct cids_bitmap *b = h->bitmap;
+  uint64_t w;
+  int n;
+
+  if (i < 0 || i >= h->n_elements) {
+    return -1;
+  }
+  if (i < b->cur_before) {
+    b->cur_word = 0;
+    b->cur_before = 0;
+  }
+  while (b->cur_before + (n = __builtin_popcountll(b->words[b->cur_word])) <= i) {
+    b->cur_before += n;
+    b->cur_word++;
+  }
+
+  w = b->words[b->cur_word];
+  for (n = i - b->cur_before; n > 0; n--) {
+    w &= w - 1;
+  }
+
+  return b->base + b->cur_word * WORD_BITS + __builtin_ctzll(w);
+}
+
+static void chunkID_set_clear_dense(struct chunkID_set *h, int size)
+{
+  free(h->bitmap);
+  h->bitmap = NULL;
+  h->n_elements = 0;
+  h->size = size;
+  if (size > 0) {
+    h->bitmap = bitmap_alloc(0, (size + WORD_BITS - 1) / WORD_BITS);
+    if (h->bitmap == NULL) {
+      h->size = 0;
+    }
+  }
+}
+
+/* Keep the size largest IDs */
+static void chunkID_set_trim_dense(struct chunkID_set *h, int size)
+{
+  struct cids_bitmap *b = h->bitmap;
+  int i, drop;
+
+  if (h->n_elements <= size) {
+    return;
+  }
+  drop = h->n_elements - (size > 0 ? size : 0);
+  for (i = (WORD_BASE(b->min) - b->base) / WORD_BITS; drop; i++) {
+    int n = __builtin_popcountll(b->words[i]);
+
+    if (n <= drop) {
+      b->words[i] = 0;
+      drop -= n;
+    } else {
+      while (drop--) {
+        b->words[i] &= b->words[i] - 1;
+      }
+      drop = 0;
+    }
+  }
+  h->n_elements = size > 0 ? size : 0;
+  if (h->n_elements) {
+    for (i = (WORD_BASE(b->min) - b->base) / WORD_BITS; b->words[i] == 0; i++);
+    b->min = b->base + i * WORD_BITS + __builtin_ctzll(b->words[i]);
+  }
+  b->cur_word = 0;
+  b->cur_before = 0;
+}
+
+/* Recompute size, smallest and largest ID after a bulk operation */
+static void bitmap_recount(struct chunkID_set *h)
+{
+  struct cids_bitmap *b = h->bitmap;
+  int i, first = -1, last = -1, n = 0;
+
+  for (i = 0; i < b->n_words; i++) {
+    if (b->words[i]) {
+      n += __builtin_popcountll(b->words[i]);
+      if (first < 0) {
+        first = i;
+      }
+      last = i;
+    }
+  }
+  h->n_elements = n;
+  if (n) {
+    b->min = b->base + first * WORD_BITS + __builtin_ctzll(b->words[first]);
+    b->max = b->base + last * WORD_BITS + WORD_BITS - 1 - __builtin_clzll(b->words[last]);
+  }
+  b->cur_word = 0;
+  b->cur_before = 0;
+}
+
+/* d = d op s, on n words */
+static void words_op(uint64_t *d, const uint64_t *s, int n, enum cids_set_op op)
+{
+  int i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i *)(d + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(s + i));
+
+    switch (op) {
+      case CIDS_UNION:
+        x = _mm256_or_si256(x, y);
+        break;
+      case CIDS_INTERSECTION:
+        x = _mm256_and_si256(x, y);
+        break;
+      case CIDS_DIFFERENCE:
+        x = _mm256_andnot_si256(y, x);
+        break;
+    }
+    _mm256_storeu_si256((__m256i *)(d + i), x);
+  }
+#elif defined(__SSE2__)
+  for (; i + 2 <= n; i += 2) {
+    __m128i x = _mm_loadu_si128((__m128i *)(d + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(s + i));
+
+    switch (op) {
+      case CIDS_UNION:
+        x = _mm_or_si128(x, y);
+        break;
+      case CIDS_INTERSECTION:
+        x = _mm_and_si128(x, y);
+        break;
+      case CIDS_DIFFERENCE:
+        x = _mm_andnot_si128(y, x);
+        break;
+    }
+    _mm_storeu_si128((__m128i *)(d + i), x);
+  }
+#endif
+  for (; i < n; i++) {
+    switch (op) {
+      case CIDS_UNION:
+        d[i] |= s[i];
+        break;
+      case CIDS_INTERSECTION:
+        d[i] &= s[i];
+        break;
+      case CIDS_DIFFERENCE:
+        d[i] &= ~s[i];
+        break;
+    }
+  }
+}
+
+/*
+ * Overlap between the bitmaps of h and a, as a range of word indexes in
+ * h (*first, *last excluded) and the corresponding offset in a.
+ */
+static int bitmap_overlap(const struct cids_bitmap *b, const struct cids_bitmap *ab, int *first, int *last)
+{
+  int64_t lo, hi;
+
+  lo = b->base > ab->base ? b->base : ab->base;
+  hi = (int64_t)b->base + (int64_t)b->n_words * WORD_BITS;
+  if ((int64_t)ab->base + (int64_t)ab->n_words * WORD_BITS < hi) {
+    hi = (int64_t)ab->base + (int64_t)ab->n_words * WORD_BITS;
+  }
+  if (lo >= hi) {
+    *first = *last = 0;
+
+    return 0;
+  }
+  *first = (lo - b->base) / WORD_BITS;
+  *last = (hi - b->base) / WORD_BITS;
+
+  return (int)((lo - ab->base) / WORD_BITS);
+}
+
+static int chunkID_set_op_dense(struct chunkID_set *h, const struct chunkID_set *a, enum cids_set_op op)
+{
+  const struct cids_bitmap *ab = a->bitmap;
+  struct cids_bitmap *b;
+  int first, last, off;
+
+  if (h == a) {
+    if (op == CIDS_DIFFERENCE) {
+      chunkID_set_trim_dense(h, 0);
+    }
+
+    return h->n_elements;
+  }
+  if (op == CIDS_UNION) {
+    if (a->n_elements == 0) {
+      return h->n_elements;
+    }
+    if (chunkID_set_add_chunk_dense(h, ab->min) < 0 || chunkID_set_add_chunk_dense(h, ab->max) < 0) {
+      return -1;
+    }
+  } else if (h->n_elements == 0 || a->n_elements == 0) {
+    if (op == CIDS_INTERSECTION) {
+      chunkID_set_trim_dense(h, 0);
+    }
+
+    return h->n_elements;
+  }
+
+  b = h->bitmap;
+  off = bitmap_overlap(b, ab, &first, &last);
+  if (op == CIDS_INTERSECTION) {
+    memset(b->words, 0, first * sizeof(uint64_t));
+    memset(b->words + last, 0, (b->n_words - last) * sizeof(uint64_t));
+  }
+  words_op(b->words + first, ab->words + off, last - first, op);
+  bitmap_recount(h);
+
+  return h->n_elements;
+}
+
+static int chunkID_set_count_difference_dense(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  const struct cids_bitmap *b = h->bitmap, *ab = a->bitmap;
+  int i, first, last, off, n;
+
+  if (h == a) {
+    return 0;
+  }
+  if (h->n_elements == 0 || a->n_elements == 0) {
+    return h->n_elements;
+  }
+  off = bitmap_overlap(b, ab, &first, &last);
+  n = h->n_elements;
+  for (i = first; i < last; i++) {
+    n -= __builtin_popcountll(b->words[i] & ab->words[off + i - first]);
+  }
+
+  return n;
+}
+
+struct cids_ops_iface dense_ops = {
+  .add_chunk = chunkID_set_add_chunk_dense,
+  .check = chunkID_set_check_dense,
+  .get_chunk = chunkID_set_get_chunk_dense,
+  .clear = chunkID_set_clear_dense,
+  .trim = chunkID_set_trim_dense,
+  .set_op = chunkID_set_op_dense,
+  .count_difference = chunkID_set_count_difference_dense,
+};
@@ -82,7 +82,98 @@ static int chunkID_set_check_set(const struct chunkID_set *h, int chunk_id)
   return p ? p - h->elements : -1;
 }
 
+static int chunkID_set_union_set(struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i, j, n;
+  int *res;
+
+  if (a->n_elements == 0 || h == a) {
+    return h->n_elements;
+  }
+  res = malloc((h->n_elements + a->n_elements) * sizeof(int));
+  if (res == NULL) {
+    return -1;
+  }
+  i = j = n = 0;
+  while (i < h->n_elements && j < a->n_elements) {
+    if (h->elements[i] < a->elements[j]) {
+      res[n++] = h->elements[i++];
+    } else if (h->elements[i] > a->elements[j]) {
+      res[n++] = a->elements[j++];
+    } else {
+      res[n++] = h->elements[i++];
+      j++;
+    }
+  }
+  while (i < h->n_elements) {
+    res[n++] = h->elements[i++];
+  }
+  while (j < a->n_elements) {
+    res[n++] = a->elements[j++];
+  }
+  free(h->elements);
+  h->elements = res;
+  h->size = h->n_elements + a->n_elements;
+  h->n_elements = n;
+
+  return n;
+}
+
+/* Keep the elements of h that are (keep = 1) or are not (keep = 0) in a */
+static int chunkID_set_filter_set(struct chunkID_set *h, const struct chunkID_set *a, int keep)
+{
+  int i, j, n;
+
+  i = j = n = 0;
+  while (i < h->n_elements) {
+    while (j < a->n_elements && a->elements[j] < h->elements[i]) {
+      j++;
+    }
+    if ((j < a->n_elements && a->elements[j] == h->elements[i]) == keep) {
+      h->elements[n++] = h->elements[i];
+    }
+    i++;
+  }
+  h->n_elements = n;
+
+  return n;
+}
+
+static int chunkID_set_op_set(struct chunkID_set *h, const struct chunkID_set *a, enum cids_set_op op)
+{
+  switch (op) {
+    case CIDS_UNION:
+      return chunkID_set_union_set(h, a);
+    case CIDS_INTERSECTION:
+      return chunkID_set_filter_set(h, a, 1);
+    case CIDS_DIFFERENCE:
+      return chunkID_set_filter_set(h, a, 0);
+  }
+
+  return -1;
+}
+
+static int chunkID_set_count_difference_set(const struct chunkID_set *h, const struct chunkID_set *a)
+{
+  int i, j, n;
+
+  i = j = n = 0;
+  while (i < h->n_elements) {
+    while (j < a->n_elements && a->elements[j] < h->elements[i]) {
+      j++;
+    }
+    if (j == a->n_elements || a->elements[j] != h->elements[i]) {
+      n++;
+    }
+    i++;
+  }
+
+  return n;
+}
+
 struct cids_ops_iface set_ops = {
   .add_chunk = chunkID_set_add_chunk_set,
   .check = chunkID_set_check_set,
+  .set_op = chunkID_set_op_set,
+  .count_difference = chunkID_set_count_difference_set,
 };
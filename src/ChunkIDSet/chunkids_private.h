@@ -3,14 +3,38 @@
 
 #define CIST_BITMAP 1
 #define CIST_PRIORITY 2
+#define CIST_COMPACT 3
+
+/*
+ * Dense sets: the IDs in [base, base + 64 * n_words) are stored as bits
+ * of words[] (base is a multiple of 64). cur_word and cur_before cache
+ * the position of the last chunkID_set_get_chunk() (cur_before is the
+ * number of IDs stored before words[cur_word]), so that sets can be
+ * scanned in linear time.
+ */
+struct cids_bitmap {
+  int base;
+  int n_words;
+  int min;
+  int max;
+  int cur_word;
+  int cur_before;
+  uint64_t words[];
+};
 
 struct chunkID_set {
   uint32_t type;
   uint32_t size;
   uint32_t n_elements;
   int *elements;
+  struct cids_bitmap *bitmap;
   struct cids_ops_iface *ops;
   struct cids_encoding_iface *enc;
 };
 
+struct chunkID_set *chunkID_set_alloc(void);
+int chunkID_set_reset(struct chunkID_set *h, uint32_t type);
+int chunkID_set_reserve(struct chunkID_set *h, int size);
+int chunkID_set_fit_range(struct chunkID_set *h, int min, int max);
+
 #endif /* CHUNKID_SET_PRIVATE */
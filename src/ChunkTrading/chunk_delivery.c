@@ -6,6 +6,12 @@
  */
 #include <stdlib.h>
 #include <stdint.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#else
+#define _WIN32_WINNT 0x0501 /* WINNT>=0x501 (WindowsXP) for supporting getaddrinfo/freeaddrinfo.*/
+#include "win32-net.h"
+#endif
 
 #include "int_coding.h"
 #include "chunk.h"
@@ -32,38 +38,60 @@ int parseChunkMsg(const uint8_t *buff, int buff_len, struct chunk *c, uint16_t *
   return 1;
 }
 
+int parseChunkMsgRef(uint8_t *buff, int buff_len, struct chunk *c, uint16_t *transid)
+{
+  int res;
+
+  if (c == NULL) {
+    return -1;
+  }
+
+  res = decodeChunkRef(c, buff + sizeof(*transid), buff_len - sizeof(*transid));
+  if (res < 0) {
+    return -1;
+  }
+
+  *transid = int16_rcpy(buff);
+
+  return 1;
+}
+
 /**
  * Send a Chunk to a target Peer
  *
- * Send a single Chunk to a given Peer
+ * Send a single Chunk to a given Peer. Only the message header and the
+ * chunk header are encoded in a local buffer: the chunk data and
+ * attributes are directly passed to the net helper
  *
  * @param[in] to destination peer
  * @param[in] c Chunk to send
  * @return 0 on success, <0 on error
  */
-//TO CHECK AND CORRECT
-//XXX Send data is in char while our buffer is in uint8
 int sendChunk(const struct nodeID * localID, const struct nodeID *to, const struct chunk *c, uint16_t transid)
 {
-  int buff_len;
-  uint8_t *buff;
-  int res;
-
-  buff_len  = CHUNK_HEADER_SIZE + sizeof(transid) + c->size + c->attributes_size;
-  buff = malloc(buff_len + 1);
-  if (buff == NULL) {
-      return -1;
-  }
-  buff[0] = MSG_TYPE_CHUNK;
-  int16_cpy(buff + 1, transid);
-  res = encodeChunk(c, buff + 1 + sizeof(transid), buff_len);
-  if (res < 0) {
-    free(buff);
+  uint8_t hdr[1 + sizeof(transid) + CHUNK_HEADER_SIZE];
+  struct iovec iov[3];
+  int iovcnt;
 
+  hdr[0] = MSG_TYPE_CHUNK;
+  int16_cpy(hdr + 1, transid);
+  if (encodeChunkHeader(c, hdr + 1 + sizeof(transid), CHUNK_HEADER_SIZE) < 0) {
     return -2;
   }
-  send_to_peer(localID, to, buff, buff_len + 1);
-  free(buff);
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iovcnt = 1;
+  if (c->size) {
+    iov[iovcnt].iov_base = c->data;
+    iov[iovcnt++].iov_len = c->size;
+  }
+  if (c->attributes_size) {
+    iov[iovcnt].iov_base = c->attributes;
+    iov[iovcnt++].iov_len = c->attributes_size;
+  }
+  if (send_to_peer_iov(localID, to, iov, iovcnt) < 0) {
+    return -1;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -13,14 +13,14 @@
 #include "chunk.h"
 #include "trade_msg_la.h"
 #include "int_coding.h"
+#include "chunk_pool.h"
 
 
-int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
+int encodeChunkHeader(const struct chunk *c, uint8_t *buff, int buff_len)
 {
   uint32_t half_ts;
 
-  if (buff_len < CHUNK_HEADER_SIZE + c->size + c->attributes_size) {
-    /* Not enough space... */
+  if (buff_len < CHUNK_HEADER_SIZE) {
     return -1;
   }
 
@@ -31,6 +31,18 @@ int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
   int_cpy(buff + 8, half_ts);
   int_cpy(buff + 12, c->size);
   int_cpy(buff + 16, c->attributes_size);
+
+  return CHUNK_HEADER_SIZE;
+}
+
+int encodeChunk(const struct chunk *c, uint8_t *buff, int buff_len)
+{
+  if (buff_len < CHUNK_HEADER_SIZE + c->size + c->attributes_size) {
+    /* Not enough space... */
+    return -1;
+  }
+
+  encodeChunkHeader(c, buff, buff_len);
   memcpy(buff + CHUNK_HEADER_SIZE, c->data, c->size);
   if (c->attributes_size) {
     memcpy(buff + CHUNK_HEADER_SIZE + c->size, c->attributes, c->attributes_size);
@@ -54,7 +66,7 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
   if (buff_len < c->size + CHUNK_HEADER_SIZE) {
     return -2;
   }
-  c->data = malloc(c->size);
+  c->data = chunk_pool_alloc(c->size);
   if (c->data == NULL) {
     return -3;
   }
@@ -64,7 +76,7 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
     if (buff_len < c->size + c->attributes_size) {
       return -4;
     }
-    c->attributes = malloc(c->attributes_size);
+    c->attributes = chunk_pool_alloc(c->attributes_size);
     if (c->attributes == NULL) {
       return -5;
     }
@@ -73,3 +85,27 @@ int decodeChunk(struct chunk *c, const uint8_t *buff, int buff_len)
 
   return CHUNK_HEADER_SIZE + c->size + c->attributes_size;
 }
+
+int decodeChunkRef(struct chunk *c, uint8_t *buff, int buff_len)
+{
+  if (buff_len < CHUNK_HEADER_SIZE) {
+    return -1;
+  }
+  c->id = int_rcpy(buff);
+  c->timestamp = int_rcpy(buff + 4);
+  c->timestamp = c->timestamp << 32;
+  c->timestamp |= int_rcpy(buff + 8);
+  c->size = int_rcpy(buff + 12);
+  c->attributes_size = int_rcpy(buff + 16);
+
+  /* Check the sizes one at a time, so that their sum cannot overflow */
+  if (c->size < 0 || c->attributes_size < 0 ||
+      c->size > buff_len - CHUNK_HEADER_SIZE ||
+      c->attributes_size > buff_len - CHUNK_HEADER_SIZE - c->size) {
+    return -2;
+  }
+  c->data = buff + CHUNK_HEADER_SIZE;
+  c->attributes = c->attributes_size ? buff + CHUNK_HEADER_SIZE + c->size : NULL;
+
+  return CHUNK_HEADER_SIZE + c->size + c->attributes_size;
+}
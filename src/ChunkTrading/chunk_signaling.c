@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 
 #include "chunk.h"
 #include "grapes_msg_types.h"
@@ -38,6 +40,8 @@
 #define MSG_SIG_ACK 11
 //Request the BufferMap
 #define MSG_SIG_BMREQ 12
+//Receive a BufferMap, full or as a difference from the previous one
+#define MSG_SIG_BMDELTA 13
 
 #define SIG_META_LEN 1024
 #define SIG_BUF_LEN 2048
@@ -50,9 +54,355 @@ struct sig_nal {
   uint8_t third_peer;//for buffer map exchange from other peers, just the first byte!
 } __attribute__((packed));
 
+/*
+ * Delta buffer maps: MSG_SIG_BMDELTA messages carry, between the sig_nal
+ * header and the owner ID, a BM_HDR_LEN bytes header: flags, sequence
+ * number, sequence number of the previous map (2 bytes each) and base
+ * (4 bytes). If BM_FULL is set the message contains the whole buffer map;
+ * otherwise, the map is obtained from the previous one (which must have
+ * sequence number prev_seq) by removing the chunks with ID < base and
+ * adding the chunks in the message.
+ * The sender remembers the last map sent to each destination and the
+ * receiver the last map received from each owner; a receiver that misses
+ * a map requests the full one (MSG_SIG_BMREQ). The receiver keeps the
+ * maps of at most BM_RX_MAX owners (the least recently updated one is
+ * dropped), and rejects maps spanning more than CHUNKID_SET_DENSE_RANGE.
+ */
+#define BM_HDR_LEN 9
+#define BM_FULL 0x01
+#define BM_FULL_EVERY 32
+#define BM_BUCKETS 64
+#define BM_KEY_LEN 160
+#define BM_RX_MAX 1024
+
+struct bm_state {
+  struct bm_state *next;
+  uint8_t key[BM_KEY_LEN];
+  int key_len;
+  struct chunkID_set *map;
+  uint16_t seq;
+  int valid;
+  int deltas;		/* sender: deltas since the last full map */
+  int requested;	/* receiver: full map already requested */
+  uint32_t used;	/* receiver: time of the last update */
+};
+
+static struct bm_state *bm_tx[BM_BUCKETS];
+static struct bm_state *bm_rx[BM_BUCKETS];
+static int bm_rx_cnt;
+static uint32_t bm_rx_clock;
+static struct chunkID_set *bm_scratch;
+static struct chunkID_set *bm_added;
+
+static int sig_compact_ids;
+static struct nodeID *sig_local_id;
 
 int chunkSignalingInit(struct nodeID *myID)
 {
+  sig_local_id = myID;
+
+  return 1;
+}
+
+void chunkSignalingCompactIDs(int enable)
+{
+  sig_compact_ids = enable;
+}
+
+/* The peers are identified by their compact dump */
+static int bm_key(uint8_t *key, const struct nodeID *id)
+{
+  return nodeid_dump_compact(key, id, BM_KEY_LEN);
+}
+
+static int bm_key_raw(uint8_t *key, const uint8_t *b, int len)
+{
+  struct nodeID *id;
+  int res;
+
+  if (len <= 0) {
+    return -1;
+  }
+  if (nodeid_is_compact(b)) {
+    if (len > BM_KEY_LEN) {
+      return -1;
+    }
+    memcpy(key, b, len);
+
+    return len;
+  }
+  id = nodeid_undump(b, &res);
+  if (id == NULL) {
+    return -1;
+  }
+  res = bm_key(key, id);
+  nodeid_free(id);
+
+  return res;
+}
+
+static struct bm_state **bm_bucket(struct bm_state **table, const uint8_t *key, int len)
+{
+  uint32_t h = 2166136261U;
+  int i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ key[i]) * 16777619U;
+  }
+
+  return &table[h % BM_BUCKETS];
+}
+
+static struct bm_state *bm_lookup(struct bm_state **table, const uint8_t *key, int len, int create)
+{
+  struct bm_state **b = bm_bucket(table, key, len), *st;
+
+  for (st = *b; st; st = st->next) {
+    if (st->key_len == len && !memcmp(st->key, key, len)) {
+      return st;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  st = malloc(sizeof(struct bm_state));
+  if (st == NULL) {
+    return NULL;
+  }
+  st->map = chunkID_set_init("type=dense");
+  if (st->map == NULL) {
+    free(st);
+
+    return NULL;
+  }
+  memcpy(st->key, key, len);
+  st->key_len = len;
+  st->seq = 0;
+  st->valid = 0;
+  st->deltas = 0;
+  st->requested = 0;
+  st->used = 0;
+  st->next = *b;
+  *b = st;
+
+  return st;
+}
+
+/* Returns 1 if the state has been found (and released), 0 otherwise */
+static int bm_forget(struct bm_state **table, const uint8_t *key, int len)
+{
+  struct bm_state **b = bm_bucket(table, key, len), *st;
+
+  for (; *b; b = &(*b)->next) {
+    st = *b;
+    if (st->key_len == len && !memcmp(st->key, key, len)) {
+      *b = st->next;
+      chunkID_set_free(st->map);
+      free(st);
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Drop the receiver state updated least recently */
+static void bm_rx_evict(void)
+{
+  struct bm_state *st, *old = NULL;
+  int i;
+
+  for (i = 0; i < BM_BUCKETS; i++) {
+    for (st = bm_rx[i]; st; st = st->next) {
+      if (old == NULL || bm_rx_clock - st->used > bm_rx_clock - old->used) {
+        old = st;
+      }
+    }
+  }
+  if (old) {
+    bm_rx_cnt -= bm_forget(bm_rx, old->key, old->key_len);
+  }
+}
+
+/*
+ * Extend [*lo, *hi] to contain the IDs of h (which can be unsorted);
+ * *lo > *hi for an empty range
+ */
+static void bm_span(const struct chunkID_set *h, int *lo, int *hi)
+{
+  int i;
+
+  for (i = 0; i < chunkID_set_size(h); i++) {
+    int id = chunkID_set_get_chunk(h, i);
+
+    if (id < *lo) {
+      *lo = id;
+    }
+    if (id > *hi) {
+      *hi = id;
+    }
+  }
+}
+
+static int bm_span_ok(int lo, int hi)
+{
+  return lo > hi || (int64_t)hi - lo <= CHUNKID_SET_DENSE_RANGE;
+}
+
+/* Replace the content of h with the content of a */
+static int bm_copy(struct chunkID_set *h, struct chunkID_set *a)
+{
+  chunkID_set_trim(h, 0);
+
+  return chunkID_set_union(h, a);
+}
+
+/* Number of chunk IDs < base in a sorted set */
+static int bm_below(const struct chunkID_set *h, int base)
+{
+  int i;
+
+  for (i = 0; i < chunkID_set_size(h) && chunkID_set_get_chunk(h, i) < base; i++);
+
+  return i;
+}
+
+static int bm_request_full(const uint8_t *owner, int owner_len);
+
+/*
+ * Rebuild the buffer map from a MSG_SIG_BMDELTA message: cset contains
+ * the chunk IDs received in the message, and is replaced by the map.
+ */
+static int bm_receive(const uint8_t *hdr, const uint8_t *owner, int owner_len, struct chunkID_set *cset)
+{
+  uint8_t key[BM_KEY_LEN];
+  struct bm_state *st;
+  uint16_t seq, prev_seq;
+  int key_len, base, lo = INT_MAX, hi = INT_MIN;
+
+  key_len = bm_key_raw(key, owner, owner_len);
+  if (key_len < 0 || cset == NULL) {
+    return -1;
+  }
+  bm_span(cset, &lo, &hi);
+  seq = int16_rcpy(hdr + 1);
+  prev_seq = int16_rcpy(hdr + 3);
+  base = int_rcpy(hdr + 5);
+
+  /* Only full maps create the state of an owner */
+  if (hdr[0] & BM_FULL) {
+    if (!bm_span_ok(lo, hi)) {
+      return -1;
+    }
+    st = bm_lookup(bm_rx, key, key_len, 0);
+    if (st == NULL) {
+      if (bm_rx_cnt >= BM_RX_MAX) {
+        bm_rx_evict();
+      }
+      st = bm_lookup(bm_rx, key, key_len, 1);
+      if (st == NULL) {
+        return -1;
+      }
+      bm_rx_cnt++;
+    }
+    st->valid = bm_copy(st->map, cset) >= 0;
+    st->seq = seq;
+    st->requested = 0;
+    st->used = ++bm_rx_clock;
+
+    return 1;
+  }
+  /* Unknown owners are not asked for the full map: it arrives periodically */
+  st = bm_lookup(bm_rx, key, key_len, 0);
+  if (st == NULL) {
+    return -1;
+  }
+  if (!st->valid || st->seq != prev_seq) {
+    st->valid = 0;
+    if (!st->requested) {
+      st->requested = bm_request_full(owner, owner_len) > 0;
+    }
+
+    return -1;
+  }
+  chunkID_set_trim(st->map, chunkID_set_size(st->map) - bm_below(st->map, base));
+  bm_span(st->map, &lo, &hi);
+  if (!bm_span_ok(lo, hi) || chunkID_set_union(st->map, cset) < 0 || bm_copy(cset, st->map) < 0) {
+    st->valid = 0;
+
+    return -1;
+  }
+  st->seq = seq;
+  st->used = ++bm_rx_clock;
+
+  return 1;
+}
+
+static int parseMeta(const uint8_t *meta, int meta_len, struct nodeID **owner_id,
+                     int *max_deliver, uint16_t *trans_id, enum signaling_type *sig_type,
+                     struct chunkID_set *cset)
+{
+  const struct sig_nal *signal = (const struct sig_nal *)meta;
+  const uint8_t *owner = &signal->third_peer;
+  int owner_len = meta_len - (sizeof(struct sig_nal) - 1);
+  int dummy;
+
+  if (meta_len < sizeof(struct sig_nal) - 1) {
+    return -1;
+  }
+  switch (signal->type) {
+    case MSG_SIG_OFF:
+      *sig_type = sig_offer;
+      break;
+    case MSG_SIG_ACC:
+      *sig_type = sig_accept;
+      break;
+    case MSG_SIG_REQ:
+      *sig_type = sig_request;
+      break;
+    case MSG_SIG_DEL:
+      *sig_type = sig_deliver;
+      break;
+    case MSG_SIG_BMOFF:
+      *sig_type = sig_send_buffermap;
+      break;
+    case MSG_SIG_ACK:
+      *sig_type = sig_ack;
+      break;
+    case MSG_SIG_BMREQ:
+      *sig_type = sig_request_buffermap;
+      break;
+    case MSG_SIG_BMDELTA:
+      *sig_type = sig_send_buffermap;
+      if (owner_len <= BM_HDR_LEN ||
+          bm_receive(owner, owner + BM_HDR_LEN, owner_len - BM_HDR_LEN, cset) < 0) {
+        return -1;
+      }
+      owner += BM_HDR_LEN;
+      owner_len -= BM_HDR_LEN;
+      break;
+    default:
+      fprintf(stderr, "Error invalid signaling message: type %d\n", signal->type);
+      return -1;
+  }
+  /* The requester of a buffer map gets a full map next time */
+  if (signal->type == MSG_SIG_BMREQ && owner_len > 0) {
+    uint8_t key[BM_KEY_LEN];
+    struct bm_state *st;
+    int key_len = bm_key_raw(key, owner, owner_len);
+
+    st = key_len > 0 ? bm_lookup(bm_tx, key, key_len, 0) : NULL;
+    if (st) {
+      st->valid = 0;
+    }
+  }
+  *max_deliver = signal->max_deliver;
+  *trans_id = signal->trans_id;
+  if (owner_id) {
+    *owner_id = (owner_len > 0 ? nodeid_undump(owner, &dummy) : NULL);
+  }
+
   return 1;
 }
 
@@ -60,98 +410,155 @@ int parseSignaling(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
                    struct chunkID_set **cset, int *max_deliver, uint16_t *trans_id,
                    enum signaling_type *sig_type)
 {
-  int meta_len = 0;
+  int meta_len = 0, res;
   void *meta;
 
   *cset = decodeChunkSignaling(&meta, &meta_len, buff, buff_len);
   if (meta_len) {
-    struct sig_nal *signal = meta;
-    int dummy;
-
-    switch (signal->type) {
-      case MSG_SIG_OFF:
-        *sig_type = sig_offer;
-        break;
-      case MSG_SIG_ACC:
-        *sig_type = sig_accept;
-        break;
-      case MSG_SIG_REQ:
-        *sig_type = sig_request;
-        break;
-      case MSG_SIG_DEL:
-        *sig_type = sig_deliver;
-        break;
-      case MSG_SIG_BMOFF:
-        *sig_type = sig_send_buffermap;
-        break;
-      case MSG_SIG_ACK:
-        *sig_type = sig_ack;
-        break;
-      case MSG_SIG_BMREQ:
-        *sig_type = sig_request_buffermap;
-        break;
-      default:
-        fprintf(stderr, "Error invalid signaling message: type %d\n", signal->type);
-        return -1;
-    }
-    *max_deliver = signal->max_deliver;
-    *trans_id = signal->trans_id;
-    *owner_id = (meta_len > sizeof(struct sig_nal) - 1 ? nodeid_undump(&(signal->third_peer), &dummy) : NULL);
+    res = parseMeta(meta, meta_len, owner_id, max_deliver, trans_id, sig_type, *cset);
     free(meta);
   } else {
     return -1;
   }
 
-  return 1;
+  return res;
 }
 
-static int sendSignaling(const struct nodeID *localID, int type, const struct nodeID *to_id,
-                         const struct nodeID *owner_id,
-                         const struct chunkID_set *cset, int max_deliver,
-                         uint16_t trans_id)
+int parseSignalingInto(const uint8_t *buff, int buff_len, struct nodeID **owner_id,
+                       struct chunkID_set *cset, int *max_deliver, uint16_t *trans_id,
+                       enum signaling_type *sig_type)
 {
-  int meta_len, msg_len;
-  uint8_t *buff;
-  struct sig_nal *sigmex;
-
-  sigmex = malloc(SIG_META_LEN);
-  if (!sigmex) {
-    fprintf(stderr, "Error allocating meta-buffer\n");
+  const uint8_t *meta;
+  int meta_len;
 
+  if (decodeChunkSignalingInto(cset, &meta, &meta_len, buff, buff_len) < 0 || meta_len == 0) {
     return -1;
   }
+
+  return parseMeta(meta, meta_len, owner_id, max_deliver, trans_id, sig_type, cset);
+}
+
+/*
+ * Encode a signaling message in buff (SIG_BUF_LEN bytes); hdr (hdr_len
+ * bytes) is inserted between the sig_nal header and the owner. Returns the
+ * message length, and the position of the sig_nal header in *sig_off.
+ */
+static int encodeSignaling(uint8_t *buff, int *sig_off, int type,
+                           const struct nodeID *owner_id,
+                           const struct chunkID_set *cset, int max_deliver,
+                           uint16_t trans_id, const uint8_t *hdr, int hdr_len)
+{
+  int meta_len, msg_len;
+  uint8_t meta[SIG_META_LEN];
+  struct sig_nal *sigmex = (struct sig_nal *)meta;
+
   sigmex->type = type;
   sigmex->max_deliver = max_deliver;    
   sigmex->trans_id = trans_id;
   sigmex->third_peer = 0;
   meta_len = sizeof(*sigmex) - 1;
+  if (hdr_len) {
+    memcpy(meta + meta_len, hdr, hdr_len);
+    meta_len += hdr_len;
+  }
   if (owner_id) {
-    meta_len += nodeid_dump(&sigmex->third_peer, owner_id, SIG_META_LEN - meta_len);
+    if (sig_compact_ids) {
+      meta_len += nodeid_dump_compact(meta + meta_len, owner_id, SIG_META_LEN - meta_len);
+    } else {
+      meta_len += nodeid_dump(meta + meta_len, owner_id, SIG_META_LEN - meta_len);
+    }
   }
-  buff = malloc(SIG_BUF_LEN);
-  if (!buff) {
-    fprintf(stderr, "Error allocating buffer\n");
-    free(sigmex);
+
+  buff[0] = MSG_TYPE_SIGNALLING;
+  msg_len = encodeChunkSignaling(cset, sigmex, meta_len, buff+1, SIG_BUF_LEN-1);
+  if (msg_len < 0) {
+    fprintf(stderr, "Error in encoding chunk set for sending a buffermap\n");
 
     return -1;
   }
+  /* The meta data are at the end of the message */
+  *sig_off = 1 + msg_len - meta_len;
 
-  buff[0] = MSG_TYPE_SIGNALLING;
-  msg_len = 1 + encodeChunkSignaling(cset, sigmex, meta_len, buff+1, SIG_BUF_LEN-1);
-  free(sigmex);
-  if (msg_len <= 0) {
-    fprintf(stderr, "Error in encoding chunk set for sending a buffermap\n");
-    free(buff);
+  return 1 + msg_len;
+}
+
+static int sendSignalingHdr(const struct nodeID *localID, int type, const struct nodeID *to_id,
+                            const struct nodeID *owner_id,
+                            const struct chunkID_set *cset, int max_deliver,
+                            uint16_t trans_id, const uint8_t *hdr, int hdr_len)
+{
+  uint8_t buff[SIG_BUF_LEN];
+  int msg_len, sig_off;
 
+  msg_len = encodeSignaling(buff, &sig_off, type, owner_id, cset, max_deliver, trans_id, hdr, hdr_len);
+  if (msg_len < 0) {
     return -1;
-  } else {
-    send_to_peer(localID, to_id, buff, msg_len);
-  }    
-  free(buff);
+  }
+  send_to_peer(localID, to_id, buff, msg_len);
 
   return 1;
 }
 
+/*
+ * Send the same message to n peers: the message is encoded only once, and
+ * only the transaction ID is changed for each destination; the messages
+ * are queued and transmitted together.
+ */
+static int sendSignalingMulti(const struct nodeID *localID, int type, struct nodeID **to, int n,
+                              const struct nodeID *owner_id,
+                              const struct chunkID_set *cset, int max_deliver,
+                              const uint16_t *trans_id)
+{
+  uint8_t buff[SIG_BUF_LEN];
+  int i, msg_len, sig_off, res;
+
+  if (n <= 0) {
+    return 0;
+  }
+  msg_len = encodeSignaling(buff, &sig_off, type, owner_id, cset, max_deliver, trans_id[0], NULL, 0);
+  if (msg_len < 0) {
+    return -1;
+  }
+  res = 0;
+  for (i = 0; i < n; i++) {
+    uint16_t tid = trans_id[i];
+
+    memcpy(buff + sig_off + offsetof(struct sig_nal, trans_id), &tid, sizeof(tid));
+    if (send_to_peer_queued(localID, to[i], buff, msg_len) >= 0) {
+      res++;
+    }
+  }
+  send_queue_flush(localID);
+
+  return res;
+}
+
+static int sendSignaling(const struct nodeID *localID, int type, const struct nodeID *to_id,
+                         const struct nodeID *owner_id,
+                         const struct chunkID_set *cset, int max_deliver,
+                         uint16_t trans_id)
+{
+  return sendSignalingHdr(localID, type, to_id, owner_id, cset, max_deliver, trans_id, NULL, 0);
+}
+
+static int bm_request_full(const uint8_t *owner, int owner_len)
+{
+  struct nodeID *to;
+  int res, dummy;
+
+  if (sig_local_id == NULL) {
+    return -1;
+  }
+  to = nodeid_undump(owner, &dummy);
+  if (to == NULL) {
+    return -1;
+  }
+  res = sendSignaling(sig_local_id, MSG_SIG_BMREQ, to, sig_local_id, NULL, 0, 0);
+  nodeid_free(to);
+
+  return res;
+}
+
 int requestChunks(const struct nodeID *localID, const struct nodeID *to, const ChunkIDSet *cset,
                   int max_deliver, uint16_t trans_id)
 {
@@ -181,6 +588,19 @@ int sendBufferMap(const struct nodeID *localID, const struct nodeID *to, const s
                        cb_size, trans_id);
 }
 
+int offerChunksMulti(const struct nodeID *localID, struct nodeID **to, int n,
+                     struct chunkID_set *cset, int max_deliver, const uint16_t *trans_id)
+{
+  return sendSignalingMulti(localID, MSG_SIG_OFF, to, n, NULL, cset, max_deliver, trans_id);
+}
+
+int sendBufferMapMulti(const struct nodeID *localID, struct nodeID **to, int n, const struct nodeID *owner,
+                       struct chunkID_set *bmap, int cb_size, const uint16_t *trans_id)
+{
+  return sendSignalingMulti(localID, MSG_SIG_BMOFF, to, n, (!owner ? localID : owner), bmap,
+                            cb_size, trans_id);
+}
+
 int sendAck(const struct nodeID *localID, const struct nodeID *to, struct chunkID_set *cset, uint16_t trans_id)
 {
     return sendSignaling(localID, MSG_SIG_ACK, to, NULL, cset, 0, trans_id);
@@ -192,3 +612,61 @@ int requestBufferMap(const struct nodeID *localID, const struct nodeID *to, cons
   return sendSignaling(localID, MSG_SIG_BMREQ, to, (!owner?localID:owner), NULL,
                        0, trans_id);
 }
+
+int sendBufferMapDelta(const struct nodeID *localID, const struct nodeID *to,
+                       struct chunkID_set *bmap, int cb_size, uint16_t trans_id)
+{
+  uint8_t key[BM_KEY_LEN], hdr[BM_HDR_LEN];
+  struct chunkID_set *tmp;
+  struct bm_state *st;
+  int key_len, base, res;
+
+  if (bm_scratch == NULL) {
+    bm_scratch = chunkID_set_init("type=dense");
+    bm_added = chunkID_set_init("type=dense,encoding=compact");
+    if (bm_scratch == NULL || bm_added == NULL) {
+      return -1;
+    }
+  }
+  key_len = bm_key(key, to);
+  st = key_len > 0 ? bm_lookup(bm_tx, key, key_len, 1) : NULL;
+  if (st == NULL || bm_copy(bm_scratch, bmap) < 0) {
+    return -1;
+  }
+
+  base = chunkID_set_size(bm_scratch) ? chunkID_set_get_chunk(bm_scratch, 0) : 0;
+  hdr[0] = BM_FULL;
+  int16_cpy(hdr + 1, st->seq + 1);
+  int16_cpy(hdr + 3, st->seq);
+  int_cpy(hdr + 5, base);
+  /* A delta can only remove the chunks below the new base */
+  if (st->valid && st->deltas < BM_FULL_EVERY && chunkID_set_size(bm_scratch) &&
+      chunkID_set_count_difference(st->map, bm_scratch) == bm_below(st->map, base)) {
+    if (bm_copy(bm_added, bm_scratch) >= 0 && chunkID_set_difference(bm_added, st->map) >= 0) {
+      hdr[0] = 0;
+    }
+  }
+
+  res = sendSignalingHdr(localID, MSG_SIG_BMDELTA, to, localID, hdr[0] ? bmap : bm_added,
+                         cb_size, trans_id, hdr, BM_HDR_LEN);
+  st->seq++;
+  st->valid = res > 0;
+  st->deltas = hdr[0] ? 0 : st->deltas + 1;
+  tmp = st->map;
+  st->map = bm_scratch;
+  bm_scratch = tmp;
+
+  return res;
+}
+
+void forgetBufferMaps(const struct nodeID *peer)
+{
+  uint8_t key[BM_KEY_LEN];
+  int key_len;
+
+  key_len = bm_key(key, peer);
+  if (key_len > 0) {
+    bm_forget(bm_tx, key, key_len);
+    bm_rx_cnt -= bm_forget(bm_rx, key, key_len);
+  }
+}
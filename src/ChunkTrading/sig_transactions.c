@@ -0,0 +1,534 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Signaling transactions table. The pending transactions are kept in a
+ *  hash table indexed by (peer, transaction ID), and in a timer wheel
+ *  (WHEEL_SLOTS slots of "tick" us each) used to expire them; transactions
+ *  expiring more than WHEEL_SLOTS ticks in the future stay in their slot
+ *  until their tick comes. The number of pending transactions containing
+ *  each chunk ID is kept in an open addressing hash table.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "chunkidset.h"
+#include "trade_sig_ha.h"
+#include "trade_sig_trans.h"
+#include "grapes_config.h"
+
+#define WHEEL_SLOTS 256
+#define PEER_BUCKETS 64
+#define DEFAULT_TIMEOUT 1000
+#define DEFAULT_TICK 10
+
+struct peer_entry {
+  struct peer_entry *next;
+  struct nodeID *id;
+  uint32_t hash;
+  struct sig_trans_stats stats;
+};
+
+struct transaction {
+  struct transaction *hnext;		/* hash chain */
+  struct transaction *wnext, *wprev;	/* timer wheel slot */
+  struct peer_entry *peer;
+  uint16_t trans_id;
+  enum signaling_type type;
+  uint64_t start;
+  uint64_t expire;			/* in ticks */
+  int n_chunks;
+  int *chunks;
+};
+
+struct chunk_count {
+  int id;
+  int count;				/* 0: empty slot */
+};
+
+struct sig_trans_table {
+  uint64_t timeout;
+  uint64_t tick;
+  uint64_t cur_tick;
+  int started;
+  struct transaction **buckets;
+  int n_buckets;
+  int n_trans;
+  struct transaction *wheel[WHEEL_SLOTS];
+  struct peer_entry *peers[PEER_BUCKETS];
+  struct chunk_count *counts;
+  int counts_size;
+  int counts_used;
+};
+
+static uint64_t time_us(const struct timeval *now)
+{
+  struct timeval tv;
+
+  if (now == NULL) {
+    gettimeofday(&tv, NULL);
+    now = &tv;
+  }
+
+  return (uint64_t)now->tv_sec * 1000000 + now->tv_usec;
+}
+
+static uint32_t trans_hash(const struct peer_entry *p, uint16_t trans_id)
+{
+  return p->hash ^ (trans_id * 2654435761U);
+}
+
+static struct peer_entry *peer_find(const struct sig_trans_table *t, const struct nodeID *id, uint32_t h)
+{
+  struct peer_entry *p;
+
+  for (p = t->peers[h % PEER_BUCKETS]; p; p = p->next) {
+    if (p->hash == h && nodeid_equal(p->id, id)) {
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+static struct peer_entry *peer_get(struct sig_trans_table *t, const struct nodeID *id)
+{
+  uint32_t h = nodeid_hash(id);
+  struct peer_entry *p;
+
+  p = peer_find(t, id, h);
+  if (p) {
+    return p;
+  }
+  p = malloc(sizeof(struct peer_entry));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->id = nodeid_dup(id);
+  if (p->id == NULL) {
+    free(p);
+
+    return NULL;
+  }
+  p->hash = h;
+  memset(&p->stats, 0, sizeof(p->stats));
+  p->stats.last_rtt = -1;
+  p->next = t->peers[h % PEER_BUCKETS];
+  t->peers[h % PEER_BUCKETS] = p;
+
+  return p;
+}
+
+/* Chunk ID counters: linear probing, with backward shift deletion */
+static struct chunk_count *count_slot(const struct sig_trans_table *t, int id)
+{
+  uint32_t i = ((uint32_t)id * 2654435761U) & (t->counts_size - 1);
+
+  while (t->counts[i].count && t->counts[i].id != id) {
+    i = (i + 1) & (t->counts_size - 1);
+  }
+
+  return &t->counts[i];
+}
+
+static int count_grow(struct sig_trans_table *t)
+{
+  struct chunk_count *old = t->counts;
+  int i, old_size = t->counts_size;
+
+  t->counts_size = old_size ? old_size * 2 : 256;
+  t->counts = calloc(t->counts_size, sizeof(struct chunk_count));
+  if (t->counts == NULL) {
+    t->counts = old;
+    t->counts_size = old_size;
+
+    return -1;
+  }
+  for (i = 0; i < old_size; i++) {
+    if (old[i].count) {
+      *count_slot(t, old[i].id) = old[i];
+    }
+  }
+  free(old);
+
+  return 0;
+}
+
+static int count_add(struct sig_trans_table *t, int id)
+{
+  struct chunk_count *c;
+
+  if ((t->counts_used + 1) * 2 > t->counts_size && count_grow(t) < 0) {
+    return -1;
+  }
+  c = count_slot(t, id);
+  if (c->count == 0) {
+    c->id = id;
+    t->counts_used++;
+  }
+  c->count++;
+
+  return 0;
+}
+
+static void count_del(struct sig_trans_table *t, int id)
+{
+  uint32_t mask = t->counts_size - 1, i, j, k;
+  struct chunk_count *c = count_slot(t, id);
+
+  if (c->count == 0 || --c->count) {
+    return;
+  }
+  t->counts_used--;
+  i = c - t->counts;
+  for (j = (i + 1) & mask; t->counts[j].count; j = (j + 1) & mask) {
+    k = ((uint32_t)t->counts[j].id * 2654435761U) & mask;
+    /* Move j back to i if its home slot is not in (i, j] */
+    if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+      t->counts[i] = t->counts[j];
+      i = j;
+    }
+  }
+  t->counts[i].count = 0;
+}
+
+static int buckets_grow(struct sig_trans_table *t)
+{
+  struct transaction **nb, *tr, *next;
+  int i, n = t->n_buckets * 2;
+
+  nb = calloc(n, sizeof(struct transaction *));
+  if (nb == NULL) {
+    return -1;
+  }
+  for (i = 0; i < t->n_buckets; i++) {
+    for (tr = t->buckets[i]; tr; tr = next) {
+      uint32_t h = trans_hash(tr->peer, tr->trans_id) % n;
+
+      next = tr->hnext;
+      tr->hnext = nb[h];
+      nb[h] = tr;
+    }
+  }
+  free(t->buckets);
+  t->buckets = nb;
+  t->n_buckets = n;
+
+  return 0;
+}
+
+static struct transaction **trans_find(struct sig_trans_table *t, const struct peer_entry *p, uint16_t trans_id)
+{
+  struct transaction **tr;
+
+  for (tr = &t->buckets[trans_hash(p, trans_id) % t->n_buckets]; *tr; tr = &(*tr)->hnext) {
+    if ((*tr)->peer == p && (*tr)->trans_id == trans_id) {
+      break;
+    }
+  }
+
+  return tr;
+}
+
+static void wheel_insert(struct sig_trans_table *t, struct transaction *tr)
+{
+  struct transaction **slot = &t->wheel[tr->expire % WHEEL_SLOTS];
+
+  tr->wprev = NULL;
+  tr->wnext = *slot;
+  if (*slot) {
+    (*slot)->wprev = tr;
+  }
+  *slot = tr;
+}
+
+static void wheel_remove(struct sig_trans_table *t, struct transaction *tr)
+{
+  if (tr->wprev) {
+    tr->wprev->wnext = tr->wnext;
+  } else {
+    t->wheel[tr->expire % WHEEL_SLOTS] = tr->wnext;
+  }
+  if (tr->wnext) {
+    tr->wnext->wprev = tr->wprev;
+  }
+}
+
+/* Remove the transaction from the hash chain pointed by link, and free it */
+static void trans_close(struct sig_trans_table *t, struct transaction **link)
+{
+  struct transaction *tr = *link;
+  int i;
+
+  *link = tr->hnext;
+  wheel_remove(t, tr);
+  for (i = 0; i < tr->n_chunks; i++) {
+    count_del(t, tr->chunks[i]);
+  }
+  tr->peer->stats.outstanding--;
+  t->n_trans--;
+  free(tr->chunks);
+  free(tr);
+}
+
+static void wheel_start(struct sig_trans_table *t, uint64_t now)
+{
+  if (!t->started) {
+    t->cur_tick = now / t->tick;
+    t->started = 1;
+  }
+}
+
+struct sig_trans_table *sig_trans_init(const char *config)
+{
+  struct sig_trans_table *t;
+  struct tag *cfg_tags;
+  int timeout, tick, size;
+
+  cfg_tags = grapes_config_parse(config);
+  if (!cfg_tags) {
+    return NULL;
+  }
+  grapes_config_value_int_default(cfg_tags, "timeout", &timeout, DEFAULT_TIMEOUT);
+  grapes_config_value_int_default(cfg_tags, "tick", &tick, DEFAULT_TICK);
+  grapes_config_value_int_default(cfg_tags, "size", &size, 0);
+  free(cfg_tags);
+  if (timeout <= 0 || tick <= 0) {
+    return NULL;
+  }
+
+  t = calloc(1, sizeof(struct sig_trans_table));
+  if (t == NULL) {
+    return NULL;
+  }
+  t->timeout = (uint64_t)timeout * 1000;
+  t->tick = (uint64_t)tick * 1000;
+  for (t->n_buckets = 64; t->n_buckets < size; t->n_buckets *= 2);
+  t->buckets = calloc(t->n_buckets, sizeof(struct transaction *));
+  if (t->buckets == NULL) {
+    free(t);
+
+    return NULL;
+  }
+
+  return t;
+}
+
+void sig_trans_destroy(struct sig_trans_table *t)
+{
+  int i;
+
+  for (i = 0; i < t->n_buckets; i++) {
+    while (t->buckets[i]) {
+      trans_close(t, &t->buckets[i]);
+    }
+  }
+  for (i = 0; i < PEER_BUCKETS; i++) {
+    while (t->peers[i]) {
+      struct peer_entry *p = t->peers[i];
+
+      t->peers[i] = p->next;
+      nodeid_free(p->id);
+      free(p);
+    }
+  }
+  free(t->buckets);
+  free(t->counts);
+  free(t);
+}
+
+int sig_trans_open(struct sig_trans_table *t, const struct nodeID *peer, uint16_t trans_id,
+                   enum signaling_type type, const struct chunkID_set *cset, const struct timeval *now)
+{
+  struct transaction **link, *tr;
+  struct peer_entry *p;
+  uint64_t start = time_us(now);
+  int i, n;
+
+  if (type != sig_offer && type != sig_request && type != sig_request_buffermap) {
+    return -1;
+  }
+  p = peer_get(t, peer);
+  if (p == NULL) {
+    return -1;
+  }
+  link = trans_find(t, p, trans_id);
+  if (*link) {
+    trans_close(t, link);
+  }
+  if (t->n_trans >= t->n_buckets * 2) {
+    buckets_grow(t);
+  }
+
+  n = cset ? chunkID_set_size(cset) : 0;
+  tr = malloc(sizeof(struct transaction));
+  if (tr == NULL) {
+    return -1;
+  }
+  tr->chunks = n > 0 ? malloc(n * sizeof(int)) : NULL;
+  if (n > 0 && tr->chunks == NULL) {
+    free(tr);
+
+    return -1;
+  }
+  tr->n_chunks = 0;
+  for (i = 0; i < n; i++) {
+    int id = chunkID_set_get_chunk(cset, i);
+
+    if (count_add(t, id) < 0) {
+      break;
+    }
+    tr->chunks[tr->n_chunks++] = id;
+  }
+
+  wheel_start(t, start);
+  tr->peer = p;
+  tr->trans_id = trans_id;
+  tr->type = type;
+  tr->start = start;
+  tr->expire = (start + t->timeout + t->tick - 1) / t->tick;
+  if (tr->expire < t->cur_tick) {
+    tr->expire = t->cur_tick;
+  }
+  link = &t->buckets[trans_hash(p, trans_id) % t->n_buckets];
+  tr->hnext = *link;
+  *link = tr;
+  wheel_insert(t, tr);
+  t->n_trans++;
+  p->stats.outstanding++;
+  p->stats.chunks_sent += tr->n_chunks;
+
+  return 1;
+}
+
+int sig_trans_match(struct sig_trans_table *t, const struct nodeID *peer, uint16_t trans_id,
+                    enum signaling_type type, const struct chunkID_set *cset, const struct timeval *now,
+                    int *rtt)
+{
+  struct transaction **link;
+  struct peer_entry *p;
+  struct sig_trans_stats *s;
+  int r;
+
+  p = peer_find(t, peer, nodeid_hash(peer));
+  if (p == NULL) {
+    return 0;
+  }
+  link = trans_find(t, p, trans_id);
+  if (*link == NULL ||
+      !((type == sig_accept && (*link)->type == sig_offer) ||
+        (type == sig_deliver && (*link)->type == sig_request) ||
+        (type == sig_send_buffermap && (*link)->type == sig_request_buffermap))) {
+    return 0;
+  }
+
+  r = time_us(now) - (*link)->start;
+  if (r < 0) {
+    r = 0;
+  }
+  s = &p->stats;
+  /* RFC 6298 estimator */
+  if (s->last_rtt < 0) {
+    s->srtt = r;
+    s->rttvar = r / 2;
+  } else {
+    s->rttvar = (3 * s->rttvar + abs(s->srtt - r)) / 4;
+    s->srtt = (7 * s->srtt + r) / 8;
+  }
+  s->last_rtt = r;
+  s->completed++;
+  s->chunks_replied += cset ? chunkID_set_size(cset) : 0;
+  trans_close(t, link);
+  if (rtt) {
+    *rtt = r;
+  }
+
+  return 1;
+}
+
+int sig_trans_expire(struct sig_trans_table *t, const struct timeval *now,
+                     struct sig_trans_timeout *expired, int n)
+{
+  uint64_t target = time_us(now);
+  int cnt = 0;
+
+  wheel_start(t, target);
+  target /= t->tick;
+  for (; t->cur_tick <= target; t->cur_tick++) {
+    struct transaction *tr, *next;
+
+    /* After a long pause, every slot is checked only once */
+    if (t->cur_tick + WHEEL_SLOTS <= target) {
+      t->cur_tick = target - WHEEL_SLOTS + 1;
+    }
+    for (tr = t->wheel[t->cur_tick % WHEEL_SLOTS]; tr; tr = next) {
+      next = tr->wnext;
+      if (tr->expire > target) {
+        continue;
+      }
+      if (cnt == n) {
+        return cnt;
+      }
+      expired[cnt].peer = tr->peer->id;
+      expired[cnt].trans_id = tr->trans_id;
+      expired[cnt].type = tr->type;
+      cnt++;
+      tr->peer->stats.timeouts++;
+      trans_close(t, trans_find(t, tr->peer, tr->trans_id));
+    }
+  }
+
+  return cnt;
+}
+
+int sig_trans_in_flight(const struct sig_trans_table *t, int chunk_id)
+{
+  if (t->counts_used == 0) {
+    return 0;
+  }
+
+  return count_slot(t, chunk_id)->count;
+}
+
+int sig_trans_peer_stats(const struct sig_trans_table *t, const struct nodeID *peer,
+                         struct sig_trans_stats *stats)
+{
+  const struct peer_entry *p;
+
+  p = peer_find(t, peer, nodeid_hash(peer));
+  if (p == NULL) {
+    return -1;
+  }
+  *stats = p->stats;
+
+  return 0;
+}
+
+void sig_trans_forget(struct sig_trans_table *t, const struct nodeID *peer)
+{
+  struct peer_entry **pp, *p;
+  int i;
+
+  p = peer_find(t, peer, nodeid_hash(peer));
+  if (p == NULL) {
+    return;
+  }
+  for (i = 0; i < t->n_buckets && p->stats.outstanding; i++) {
+    struct transaction **link = &t->buckets[i];
+
+    while (*link) {
+      if ((*link)->peer == p) {
+        trans_close(t, link);
+      } else {
+        link = &(*link)->hnext;
+      }
+    }
+  }
+  for (pp = &t->peers[p->hash % PEER_BUCKETS]; *pp != p; pp = &(*pp)->next);
+  *pp = p->next;
+  nodeid_free(p->id);
+  free(p);
+}
@@ -13,6 +13,7 @@
 #include "int_coding.h"
 #include "payload.h"
 #include "grapes_config.h"
+#include "chunk_pool.h"
 #include "ffmpeg_compat.h"
 #include "chunkiser_iface.h"
 
@@ -251,8 +252,8 @@ static void avf_close(struct chunkiser_ctx *s)
   avformat_close_input(&s->s);
 
   //free buffers
-  free(s->v_data);
-  free(s->a_data);
+  chunk_pool_free(s->v_data);
+  chunk_pool_free(s->a_data);
 
   free(s);
 }
@@ -397,11 +398,11 @@ static uint8_t *avf_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_
   header_size = get_header_size(s->s->streams[pkt.stream_index]);
   if (!*frames) {
     *chunksize = pkt.size + header_size + FRAME_HEADER_SIZE;
-    *data = malloc(*chunksize);
+    *data = chunk_pool_alloc(*chunksize);
     // we will fill the header at the end
   } else {
     *chunksize += pkt.size + FRAME_HEADER_SIZE;
-    *data = realloc(*data, *chunksize);
+    *data = chunk_pool_realloc(*data, *chunksize);
   }
 
   if (*data == NULL) {
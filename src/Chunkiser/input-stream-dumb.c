@@ -16,6 +16,7 @@
 
 #include "chunkiser_iface.h"
 #include "grapes_config.h"
+#include "chunk_pool.h"
 
 struct chunkiser_ctx {
   int loop;	//loop on input file infinitely
@@ -75,7 +76,7 @@ static uint8_t *dumb_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64
 {
   uint8_t *res;
 
-  res = malloc(s->chunk_size);
+  res = chunk_pool_alloc(s->chunk_size);
   if (res == NULL) {
     *size = -1;
 
@@ -90,7 +91,7 @@ static uint8_t *dumb_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64
         *size = 0;
       }
     }
-    free(res);
+    chunk_pool_free(res);
     res = NULL;
   }
 
@@ -15,6 +15,7 @@
 #include "config.h"
 #include "chunkiser_iface.h"
 #include "chunkiser_attrib.h"
+#include "chunk_pool.h"
 
 #define STATIC_BUFF_SIZE 1000 * 1024
 
@@ -301,9 +302,9 @@ static void ipb_close(struct chunkiser_ctx *s)
     }
   }
   av_close_input_file(s->s);
-  free(s->i_chunk);
-  free(s->p_chunk);
-  free(s->b_chunk);
+  chunk_pool_free(s->i_chunk);
+  chunk_pool_free(s->p_chunk);
+  chunk_pool_free(s->b_chunk);
   fclose(s->chunk_log.log);
   free(s);
 }
@@ -383,13 +384,13 @@ static uint8_t *ipb_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_
       s->b_ready = 1;
       if (s->i_chunk == NULL) {
 
-        s->i_chunk = malloc(VIDEO_PAYLOAD_HEADER_SIZE);
+        s->i_chunk = chunk_pool_alloc(VIDEO_PAYLOAD_HEADER_SIZE);
         s->i_chunk_size = VIDEO_PAYLOAD_HEADER_SIZE;
         video_header_fill(s->i_chunk, s->s->streams[pkt.stream_index]);
       }
       frame_add(s->chunk_log.i_frames, s->chunk_log.frame_number);
       s->i_chunk_size += pkt.size + FRAME_HEADER_SIZE;
-      s->i_chunk = realloc(s->i_chunk, s->i_chunk_size);
+      s->i_chunk = chunk_pool_realloc(s->i_chunk, s->i_chunk_size);
       data = s->i_chunk + (s->i_chunk_size - (pkt.size + FRAME_HEADER_SIZE));
       break;
     case FF_P_TYPE:
@@ -402,13 +403,13 @@ static uint8_t *ipb_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_
         if (*size) chunk_print(s->chunk_log.log, id, s->chunk_log.p_frames, FF_P_TYPE);
       }
       if (s->p_chunk == NULL) {
-        s->p_chunk = malloc(VIDEO_PAYLOAD_HEADER_SIZE);
+        s->p_chunk = chunk_pool_alloc(VIDEO_PAYLOAD_HEADER_SIZE);
         s->p_chunk_size = VIDEO_PAYLOAD_HEADER_SIZE;
         video_header_fill(s->p_chunk, s->s->streams[pkt.stream_index]);
       }
       frame_add(s->chunk_log.p_frames, s->chunk_log.frame_number);
       s->p_chunk_size += pkt.size + FRAME_HEADER_SIZE;
-      s->p_chunk = realloc(s->p_chunk, s->p_chunk_size);
+      s->p_chunk = chunk_pool_realloc(s->p_chunk, s->p_chunk_size);
       data = s->p_chunk + (s->p_chunk_size - (pkt.size + FRAME_HEADER_SIZE));
       break;
     case FF_B_TYPE:
@@ -421,13 +422,13 @@ static uint8_t *ipb_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_
         if (*size) chunk_print(s->chunk_log.log, id, s->chunk_log.b_frames, FF_B_TYPE);
       }
       if (s->b_chunk == NULL) {
-        s->b_chunk = malloc(VIDEO_PAYLOAD_HEADER_SIZE);
+        s->b_chunk = chunk_pool_alloc(VIDEO_PAYLOAD_HEADER_SIZE);
         s->b_chunk_size = VIDEO_PAYLOAD_HEADER_SIZE;
         video_header_fill(s->b_chunk, s->s->streams[pkt.stream_index]);
       }
       frame_add(s->chunk_log.b_frames, s->chunk_log.frame_number);
       s->b_chunk_size += pkt.size + FRAME_HEADER_SIZE;
-      s->b_chunk = realloc(s->b_chunk, s->b_chunk_size);
+      s->b_chunk = chunk_pool_realloc(s->b_chunk, s->b_chunk_size);
       data = s->b_chunk + (s->b_chunk_size - (pkt.size + FRAME_HEADER_SIZE));
       break;
   }
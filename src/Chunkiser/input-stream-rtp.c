@@ -45,6 +45,7 @@
 #include "int_coding.h"
 #include "payload.h"
 #include "grapes_config.h"
+#include "chunk_pool.h"
 #include "chunkiser_iface.h"
 #include "stream-rtp.h"
 
@@ -547,7 +548,7 @@ static void rtp_close(struct chunkiser_ctx  *ctx) {
   int i;
 
   if (ctx->buff != NULL) {
-    free(ctx->buff);
+    chunk_pool_free(ctx->buff);
   }
   for (i = 0; ctx->fds[i] >= 0; i++) {
     close(ctx->fds[i]);
@@ -579,7 +580,7 @@ static uint8_t *rtp_chunkise(struct chunkiser_ctx *ctx, int id, int *size, uint6
 
   // Allocate new buffer if needed
   if (ctx->buff == NULL) {
-    ctx->buff = malloc(ctx->max_size);
+    ctx->buff = chunk_pool_alloc(ctx->max_size);
     ctx->ntp_ts_status = 0;
     if (ctx->buff == NULL) {
       printf_log(ctx, 0, "Could not alloccate chunk buffer: exiting.");
@@ -16,6 +16,7 @@
 
 #include "chunkiser_iface.h"
 #include "grapes_config.h"
+#include "chunk_pool.h"
 
 struct chunkiser_ctx {
   int loop;	//loop on input file infinitely
@@ -103,7 +104,7 @@ static uint8_t *ts_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_t
   uint8_t *res;
 
   if (!s->pcr_period) {
-    res = malloc(s->pkts_per_chunk * 188);
+    res = chunk_pool_alloc(s->pkts_per_chunk * 188);
     if (res == NULL) {
       *size = -1;
 
@@ -129,7 +130,7 @@ static uint8_t *ts_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_t
     *size = 0;
     if (s->size + 188 > s->bufsize) {
       s->bufsize += BUFSIZE_INCR;
-      s->buff = realloc(s->buff, s->bufsize);
+      s->buff = chunk_pool_realloc(s->buff, s->bufsize);
     }
     done = 0;
     while(!done) {
@@ -187,7 +188,7 @@ static uint8_t *ts_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_t
         *size = 0;
       }
     }
-    free(res);
+    chunk_pool_free(res);
     res = NULL;
   }
 
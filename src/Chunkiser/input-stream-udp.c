@@ -22,6 +22,7 @@
 #include "int_coding.h"
 #include "payload.h"
 #include "grapes_config.h"
+#include "chunk_pool.h"
 #include "chunkiser_iface.h"
 
 #define UDP_PORTS_NUM_MAX 10
@@ -170,7 +171,7 @@ static uint8_t *udp_chunkise(struct chunkiser_ctx *s, int id, int *size, uint64_
   int i;
 
   if (s->buff == NULL) {
-    s->buff = malloc(UDP_BUF_SIZE + UDP_PAYLOAD_HEADER_SIZE);
+    s->buff = chunk_pool_alloc(UDP_BUF_SIZE + UDP_PAYLOAD_HEADER_SIZE);
     if (s->buff == NULL) {
       *size = -1;
 
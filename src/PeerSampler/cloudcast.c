@@ -27,6 +27,7 @@
 #include "../Cache/proto.h"
 #include "grapes_config.h"
 #include "grapes_msg_types.h"
+#include "grapes_timer.h"
 
 #define DEFAULT_CACHE_SIZE 20
 #define DEFAULT_PARTIAL_VIEW_SIZE 5
@@ -37,6 +38,7 @@
 
 struct peersampler_context{
   uint64_t currtime;
+  struct grapes_timer *timer;	/* armed at the next transmission */
   int cache_size;
   int sent_entries;
   struct peer_cache *local_cache;
@@ -59,17 +61,6 @@ struct peersampler_context{
   struct nodeID **r;
 };
 
-
-/* return the time in microseconds */
-static uint64_t gettime(void)
-{
-  struct timeval tv;
-
-  gettimeofday(&tv, NULL);
-
-  return tv.tv_usec + tv.tv_sec * 1000000ull;
-}
-
 static struct peersampler_context* cloudcast_context_init(void){
   struct peersampler_context* con;
   con = (struct peersampler_context*) calloc(1,sizeof(struct peersampler_context));
@@ -78,12 +69,17 @@ static struct peersampler_context* cloudcast_context_init(void){
     return NULL;
   }
   memset(con, 0, sizeof(struct peersampler_context));
+  con->timer = grapes_timer_new();
+  if (!con->timer) {
+    free(con);
+    return NULL;
+  }
 
   //Initialize context with default values
   con->bootstrap = true;
   con->bootstrap_period = CLOUDCAST_BOOTSTRAP_PERIOD;
   con->period = CLOUDCAST_PERIOD;
-  con->currtime = gettime();
+  con->currtime = grapes_timer_now();
   con->cloud_contact_treshold = CLOUDCAST_TRESHOLD;
   con->last_cloud_contact_sec = 0;
   con->max_silence = 0;
@@ -98,15 +94,17 @@ static int time_to_send(struct peersampler_context* con)
 {
   long time;
   int p = con->bootstrap ? con->bootstrap_period : con->period;
+  int res = 0;
 
-  time = gettime();
+  time = grapes_timer_now();
   if (time - con->currtime > p) {
     if (con->bootstrap) con->currtime = time;
     else con->currtime += p;
-    return 1;
+    res = 1;
   }
+  grapes_timer_set(con->timer, con->currtime + p + 1);
 
-  return 0;
+  return res;
 }
 
 /*
@@ -116,7 +114,7 @@ static struct peersampler_context* cloudcast_init(struct nodeID *myID, const voi
 {
   struct tag *cfg_tags;
   struct peersampler_context *con;
-  int res;
+  int res, compact_ids;
 
   con = cloudcast_context_init();
   if (!con) return NULL;
@@ -140,10 +138,12 @@ static struct peersampler_context* cloudcast_init(struct nodeID *myID, const voi
   if (!res) {
     con->max_silence = 0;
   }
+  grapes_config_value_int_default(cfg_tags, "compact_ids", &compact_ids, 0);
 
   con->local_cache = cache_init(con->cache_size, metadata_size, 0);
   if (con->local_cache == NULL) {
     fprintf(stderr, "cloudcast: Error initializing local cache\n");
+    grapes_timer_free(con->timer);
     free(con);
     return NULL;
   }
@@ -151,10 +151,13 @@ static struct peersampler_context* cloudcast_init(struct nodeID *myID, const voi
   con->proto_context = cloudcast_proto_init(myID, metadata, metadata_size);
   if (!con->proto_context){
     free(con->local_cache);
+    grapes_timer_free(con->timer);
     free(con);
     return NULL;
   }
+  cloudcast_proto_compact_ids(con->proto_context, compact_ids);
   con->cloud_nodes = cloudcast_get_cloud_nodes(con->proto_context, 2);
+  grapes_timer_set(con->timer, con->currtime + con->bootstrap_period + 1);
 
   return con;
 }
@@ -213,7 +216,7 @@ static int cloudcast_cloud_dialogue(struct peersampler_context *context,
   /* Obtain the timestamp reported by the last query_cloud operation and
      compute delta */
   cloud_tstamp = cloudcast_timestamp_cloud(context->proto_context) * 1000000ull;
-  current_time = gettime();
+  current_time = grapes_timer_now();
   delta = current_time - cloud_tstamp;
 
   /* Fill up the request with one spot free for local node */
@@ -283,7 +286,7 @@ static int silence_treshold(struct peersampler_context *context)
   if (context->last_cloud_contact_sec == 0) return 0;
 
   threshold = (context->max_silence * context->period) / 1000000ull;
-  delta = (gettime() / 1000000ull) - context->last_cloud_contact_sec;
+  delta = (grapes_timer_now() / 1000000ull) - context->last_cloud_contact_sec;
 
   return delta > threshold &&
     ((double) rand())/RAND_MAX < context->cloud_respawn_prob;
@@ -326,7 +329,7 @@ static int cloudcast_active_thread(struct peersampler_context *context)
   }
 
   if (cloudcast_is_cloud_node(context->proto_context, context->dst)) {
-    context->last_cloud_contact_sec = gettime() / 1000000ull;
+    context->last_cloud_contact_sec = grapes_timer_now() / 1000000ull;
 
     /* Request cloud view */
     err = cloudcast_query_cloud(context->proto_context);
@@ -491,6 +494,7 @@ void cloudcast_destroy(struct peersampler_context **context)
 			cache_free((*context)->local_cache);
 		if((*context)->flying_cache)
 			cache_free((*context)->flying_cache);
+		grapes_timer_free((*context)->timer);
 		free(*context);
 		*context = NULL;
 	}
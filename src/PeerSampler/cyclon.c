@@ -19,6 +19,7 @@
 #include "../Cache/proto.h"
 #include "grapes_config.h"
 #include "grapes_msg_types.h"
+#include "grapes_timer.h"
 
 #define DEFAULT_CACHE_SIZE 10
 #define DEFAULT_BOOTSTRAP_CYCLES 5
@@ -27,9 +28,11 @@
 
 struct peersampler_context{
   uint64_t currtime;
+  struct grapes_timer *timer;	/* armed at the next transmission */
   int cache_size;
   int sent_entries;
   struct peer_cache *local_cache;
+  struct peer_cache *remote_cache;	/* last received cache, reused for each message */
   bool bootstrap;
   int bootstrap_period;
   int bootstrap_cycles;
@@ -42,24 +45,20 @@ struct peersampler_context{
   const struct nodeID **r;
 };
 
-
-static uint64_t gettime(void)
-{
-  struct timeval tv;
-
-  gettimeofday(&tv, NULL);
-
-  return tv.tv_usec + tv.tv_sec * 1000000ull;
-}
-
 static struct peersampler_context* cyclon_context_init(void)
 {
   struct peersampler_context* con;
   con = (struct peersampler_context*) calloc(1,sizeof(struct peersampler_context));
+  if (!con) return NULL;
+  con->timer = grapes_timer_new();
+  if (!con->timer) {
+    free(con);
+    return NULL;
+  }
 
   //Initialize context with default values
   con->bootstrap = true;
-  con->currtime = gettime();
+  con->currtime = grapes_timer_now();
 
   return con;
 }
@@ -67,13 +66,15 @@ static struct peersampler_context* cyclon_context_init(void)
 static int time_to_send(struct peersampler_context* con)
 {
   int p = con->bootstrap ? con->bootstrap_period : con->period;
-  if (gettime() - con->currtime > p) {
-    con->currtime += p;
+  int res = 0;
 
-    return 1;
+  if (grapes_timer_now() - con->currtime > p) {
+    con->currtime += p;
+    res = 1;
   }
+  grapes_timer_set(con->timer, con->currtime + p + 1);
 
-  return 0;
+  return res;
 }
 
 /*
@@ -83,7 +84,7 @@ static struct peersampler_context* cyclon_init(struct nodeID *myID, const void *
 {
   struct tag *cfg_tags;
   struct peersampler_context *con;
-  int res;
+  int res, compact_ids;
 
   con = cyclon_context_init();
   if (!con) return NULL;
@@ -109,10 +110,19 @@ static struct peersampler_context* cyclon_init(struct nodeID *myID, const void *
   if (!res) {
     con->bootstrap_cycles = DEFAULT_BOOTSTRAP_CYCLES;
   }
+  grapes_config_value_int_default(cfg_tags, "compact_ids", &compact_ids, 0);
   free(cfg_tags);
 
   con->local_cache = cache_init(con->cache_size, metadata_size, 0);
   if (con->local_cache == NULL) {
+    grapes_timer_free(con->timer);
+    free(con);
+    return NULL;
+  }
+  con->remote_cache = cache_init(0, metadata_size, 0);
+  if (con->remote_cache == NULL) {
+    cache_free(con->local_cache);
+    grapes_timer_free(con->timer);
     free(con);
     return NULL;
   }
@@ -120,9 +130,13 @@ static struct peersampler_context* cyclon_init(struct nodeID *myID, const void *
   con->pc = cyclon_proto_init(myID, metadata, metadata_size);
   if (!con->pc){
     free(con->local_cache);
+    cache_free(con->remote_cache);
+    grapes_timer_free(con->timer);
     free(con);
     return NULL;
   }
+  cyclon_proto_compact_ids(con->pc, compact_ids);
+  grapes_timer_set(con->timer, con->currtime + con->bootstrap_period + 1);
 
   return con;
 }
@@ -159,7 +173,8 @@ static int cyclon_parse_data(struct peersampler_context *context, const uint8_t
       }
     }
 
-    remote_cache = entries_undump(buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    remote_cache = context->remote_cache;
+    cache_undump(remote_cache, buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
     if (h->type == CYCLON_QUERY) {
       sent_cache = rand_cache(context->local_cache, context->sent_entries);
       cyclon_reply(context->pc, remote_cache, sent_cache);
@@ -167,8 +182,7 @@ static int cyclon_parse_data(struct peersampler_context *context, const uint8_t
       context->dst = NULL;
     }
     cache_check(context->local_cache);
-    cache_add_cache(context->local_cache, remote_cache);
-    cache_free(remote_cache);
+    cache_take_cache(context->local_cache, remote_cache);
     if (sent_cache) {
       cache_add_cache(context->local_cache, sent_cache);
       cache_free(sent_cache);
@@ -269,8 +283,11 @@ void cyclon_destroy(struct peersampler_context **context)
 			free((*context)->r);
 		if((*context)->local_cache)
 			cache_free((*context)->local_cache);
+		if((*context)->remote_cache)
+			cache_free((*context)->remote_cache);
 		if((*context)->flying_cache)
 			cache_free((*context)->flying_cache);
+		grapes_timer_free((*context)->timer);
 		free(*context);
 		*context = NULL;
 	}
@@ -20,6 +20,7 @@
 #include "../Cache/proto.h"
 #include "grapes_config.h"
 #include "grapes_msg_types.h"
+#include "grapes_timer.h"
 
 #define DEFAULT_CACHE_SIZE 10
 #define DEFAULT_MAX_TIMESTAMP 5
@@ -29,9 +30,11 @@
 
 struct peersampler_context{
   uint64_t currtime;
+  struct grapes_timer *timer;	/* armed at the next transmission */
   int cache_size;
   int cache_size_threshold;
   struct peer_cache *local_cache;
+  struct peer_cache *remote_cache;	/* last received cache, reused for each message */
   bool bootstrap;
   struct nodeID *bootstrap_node;
   int bootstrap_period;
@@ -49,24 +52,21 @@ struct peersampler_context{
   int slowstart;
 };
 
-static uint64_t gettime(void)
-{
-  struct timeval tv;
-
-  gettimeofday(&tv, NULL);
-
-  return tv.tv_usec + tv.tv_sec * 1000000ull;
-}
-
 static struct peersampler_context* ncast_context_init(void)
 {
   struct peersampler_context* con;
   con = (struct peersampler_context*) calloc(1,sizeof(struct peersampler_context));
+  if (!con) return NULL;
+  con->timer = grapes_timer_new();
+  if (!con->timer) {
+    free(con);
+    return NULL;
+  }
 
   //Initialize context with default values
   con->bootstrap = true;
   con->bootstrap_node = NULL;
-  con->currtime = gettime();
+  con->currtime = grapes_timer_now();
   con->r = NULL;
 
   return con;
@@ -75,13 +75,15 @@ static struct peersampler_context* ncast_context_init(void)
 static int time_to_send(struct peersampler_context *context)
 {
   int p = context->bootstrap ? context->bootstrap_period : context->period;
-  if (gettime() - context->currtime > p) {
-    context->currtime += p;
+  int res = 0;
 
-    return 1;
+  if (grapes_timer_now() - context->currtime > p) {
+    context->currtime += p;
+    res = 1;
   }
+  grapes_timer_set(context->timer, context->currtime + p + 1);
 
-  return 0;
+  return res;
 }
 
 static void cache_size_threshold_init(struct peersampler_context* context)
@@ -96,7 +98,7 @@ static struct peersampler_context* init(struct nodeID *myID, const void *metadat
 {
   struct tag *cfg_tags;
   struct peersampler_context *context;
-  int max_timestamp;
+  int max_timestamp, compact_ids;
 
   context = ncast_context_init();
   if (!context) return NULL;
@@ -111,10 +113,19 @@ static struct peersampler_context* init(struct nodeID *myID, const void *metadat
   grapes_config_value_int_default(cfg_tags, "restart", &context->restart, plus_features);
   grapes_config_value_int_default(cfg_tags, "randomize", &context->randomize, plus_features);
   grapes_config_value_int_default(cfg_tags, "slowstart", &context->slowstart, plus_features);
+  grapes_config_value_int_default(cfg_tags, "compact_ids", &compact_ids, 0);
   free(cfg_tags);
 
   context->local_cache = cache_init(context->cache_size, metadata_size, max_timestamp);
   if (context->local_cache == NULL) {
+    grapes_timer_free(context->timer);
+    free(context);
+    return NULL;
+  }
+  context->remote_cache = cache_init(0, metadata_size, 0);
+  if (context->remote_cache == NULL) {
+    cache_free(context->local_cache);
+    grapes_timer_free(context->timer);
     free(context);
     return NULL;
   }
@@ -124,15 +135,19 @@ static struct peersampler_context* init(struct nodeID *myID, const void *metadat
   context->tc = ncast_proto_init(myID, metadata, metadata_size);
   if (!context->tc){
     free(context->local_cache);
+    cache_free(context->remote_cache);
+    grapes_timer_free(context->timer);
     free(context);
     return NULL;
   }
+  ncast_proto_compact_ids(context->tc, compact_ids);
 
   context->query_tokens = 0;
   context->reply_tokens = 0;
   context->first_ts = (max_timestamp + 1) / 2;
   // increase timestamp for initial message, since that is out of the normal cycle of the bootstrap peer
   ncast_proto_myentry_update(context->tc, NULL, context->first_ts, NULL, 0);
+  grapes_timer_set(context->timer, context->currtime + context->bootstrap_period + 1);
 
   return context;
 }
@@ -173,7 +188,7 @@ static int ncast_parse_data(struct peersampler_context *context, const uint8_t *
 
   if (len) {
     const struct topo_header *h = (const struct topo_header *)buff;
-    struct peer_cache *new, *remote_cache;
+    struct peer_cache *remote_cache;
 
     if (h->protocol != MSG_TYPE_TOPOLOGY) {
       fprintf(stderr, "NCAST: Wrong protocol!\n");
@@ -187,7 +202,8 @@ static int ncast_parse_data(struct peersampler_context *context, const uint8_t *
       ncast_proto_myentry_update(context->tc, NULL , - context->first_ts, NULL, 0);  // reset the timestamp of our own ID, we are in normal cycle, we will not disturb the algorithm
     }
 
-    remote_cache = entries_undump(buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
+    remote_cache = context->remote_cache;
+    cache_undump(remote_cache, buff + sizeof(struct topo_header), len - sizeof(struct topo_header));
     if (h->type == NCAST_QUERY) {
       context->reply_tokens--;	//sending a reply to someone who presumably receives it
       cache_randomize(context->local_cache);
@@ -197,12 +213,7 @@ static int ncast_parse_data(struct peersampler_context *context, const uint8_t *
     }
     cache_randomize(context->local_cache);
     cache_randomize(remote_cache);
-    new = merge_caches(context->local_cache, remote_cache, context->cache_size, &dummy);
-    cache_free(remote_cache);
-    if (new != NULL) {
-      cache_free(context->local_cache);
-      context->local_cache = new;
-    }
+    cache_merge(context->local_cache, remote_cache, context->cache_size, &dummy);
   }
 
   if (time_to_send(context)) {
@@ -286,10 +297,13 @@ void ncast_destroy(struct peersampler_context **context)
 			free((*context)->r);
 		if((*context)->local_cache)
 			cache_free((*context)->local_cache);
+		if((*context)->remote_cache)
+			cache_free((*context)->remote_cache);
 		if((*context)->tc)
 			ncast_proto_destroy(&((*context)->tc));
 		if((*context)->bootstrap_node)
 			nodeid_free(((*context)->bootstrap_node));
+		grapes_timer_free((*context)->timer);
 		free(*context);
 		*context = NULL;
 	}
@@ -7,15 +7,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include "scheduler_la.h"
+#include "sched_private.h"
 
 #include<stdio.h>
 
 #define MAX(A,B)    ((A)>(B) ? (A) : (B))
 #define MIN(A,B)    ((A)<(B) ? (A) : (B))
 
+/* Use the partial selection if at most 1/TOPK_RATIO of the items are needed */
+#define TOPK_RATIO 4
+
 struct iw {
   int index;
   double weight;
+  int tie;	//random key, for breaking ties in the partial selection
 };
 
 static int cmp_iw_reverse(const void *a, const void *b)
@@ -25,17 +30,95 @@ static int cmp_iw_reverse(const void *a, const void *b)
   return a1->weight==b1->weight ? 0 : (a1->weight<b1->weight ? 1 : -1);
 }
 
+static int iw_better(const struct iw *a, const struct iw *b)
+{
+  return a->weight > b->weight || (a->weight == b->weight && a->tie > b->tie);
+}
+
+// restore the heap property (the root is the worst item) from position i down
+static void iw_sift_down(struct iw *heap, int n, int i)
+{
+  struct iw iwt = heap[i];
+
+  while (2 * i + 1 < n) {
+    int c = 2 * i + 1;
+
+    if (c + 1 < n && iw_better(&heap[c], &heap[c + 1])) c++;
+    if (!iw_better(&iwt, &heap[c])) break;
+    heap[i] = heap[c];
+    i = c;
+  }
+  heap[i] = iwt;
+}
+
+static void iw_sift_up(struct iw *heap, int i)
+{
+  struct iw iwt = heap[i];
+
+  while (i > 0 && iw_better(&heap[(i - 1) / 2], &iwt)) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = iwt;
+}
+
 /**
-  * Select best N of K based using a given evaluator function
+  * Select best N of K keeping the N best items in a bounded heap: O(K log N).
+  * Each item gets a random key, used for ordering items with the same
+  * weight, so that ties are broken uniformly at random.
   */
-void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate)(void *),unsigned char *bests,size_t *bests_len){
-  struct iw iws[nmemb];
+static void selectBestsHeap(struct sched_ctx *ctx, size_t size,unsigned char *base, size_t nmemb, const double *w,unsigned char *bests,size_t *bests_len){
+  int k = MIN(*bests_len, nmemb);
+  struct iw *heap = sched_alloc(ctx, k * sizeof(struct iw));
+  int i, n = 0;
+
+  if (heap == NULL) {
+    *bests_len = 0;
+    return;
+  }
+  for (i=0; i<nmemb; i++){
+    struct iw c;
+
+    c.index = i;
+    c.weight = w[i];
+    c.tie = sched_rand(ctx);
+    if (n < k) {
+      heap[n] = c;
+      iw_sift_up(heap, n++);
+    } else if (k > 0 && iw_better(&c, &heap[0])) {
+      heap[0] = c;
+      iw_sift_down(heap, n, 0);
+    }
+  }
+
+  // move the worst item to the end until the heap is empty: descending order
+  for (i=n-1; i>0; i--){
+    struct iw iwt = heap[0];
+    heap[0] = heap[i];
+    heap[i] = iwt;
+    iw_sift_down(heap, i, 0);
+  }
+
+  *bests_len = n;
+  for (i=0; i<n; i++){
+     memcpy(bests + size*i, base + size*heap[i].index, size);
+  }
+}
+
+/**
+  * Select best N of K sorting all the items
+  */
+static void selectBestsSort(struct sched_ctx *ctx, size_t size,unsigned char *base, size_t nmemb, const double *w,unsigned char *bests,size_t *bests_len){
+  struct iw *iws = sched_alloc(ctx, nmemb * sizeof(struct iw));
   int i;
 
-  // calculate weights
+  if (iws == NULL) {
+    *bests_len = 0;
+    return;
+  }
   for (i=0; i<nmemb; i++){
      iws[i].index = i;
-     iws[i].weight = evaluate(base + size*i);
+     iws[i].weight = w[i];
   }
 
   // sort in descending order
@@ -47,7 +130,7 @@ void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate
     for (j=i; j<nmemb && iws[i].weight == iws[j].weight; j++);
     for (k=i; k<j; k++){
       struct iw iwt = iws[k];
-      int r = i + (rand() % (j-i));
+      int r = i + (sched_rand(ctx) % (j-i));
       iws[k] = iws[r];
       iws[r] = iwt;
     }
@@ -63,20 +146,35 @@ void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate
 }
 
 /**
-  * Select N of K with weigthed random choice, without replacement (multiple selection), based on a given evaluator function
+  * Select best N of K based on the given weights
   */
-void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weight)(void *),unsigned char *selected,size_t *selected_len){
+static void selectBestsW(struct sched_ctx *ctx, size_t size,unsigned char *base, size_t nmemb, const double *w,unsigned char *bests,size_t *bests_len){
+  if (*bests_len * TOPK_RATIO <= nmemb) {
+    selectBestsHeap(ctx, size, base, nmemb, w, bests, bests_len);
+  } else {
+    selectBestsSort(ctx, size, base, nmemb, w, bests, bests_len);
+  }
+}
+
+/**
+  * Select N of K with weigthed random choice, without replacement (multiple selection), based on the given weights
+  */
+static void selectWeightedW(struct sched_ctx *ctx, size_t size,unsigned char *base, size_t nmemb, const double *w,unsigned char *selected,size_t *selected_len){
   int i,j,k;
-  double weights[nmemb];
+  double *weights = sched_alloc(ctx, nmemb * sizeof(double));
   double w_sum=0;
-  double selected_index[nmemb];
+  int *selected_index = sched_alloc(ctx, nmemb * sizeof(int));
   int s=0;
   int s_max = MIN (*selected_len, nmemb);
   int zeros = 0;
 
+  if (weights == NULL || selected_index == NULL) {
+    *selected_len = 0;
+    return;
+  }
   // calculate weights
   for (i=0; i<nmemb; i++){
-     weights[i] = weight(base + size*i);
+     weights[i] = w[i];
      // weights should not be negative
      weights[i] = MAX (weights[i], 0);
      if (weights[i] == 0) zeros += 1;
@@ -95,7 +193,7 @@ void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weigh
 
   while (s < s_max) {
     // select one randomly
-    double t = w_sum * (rand() / (RAND_MAX + 1.0));
+    double t = w_sum * (sched_rand(ctx) / (RAND_MAX + 1.0));
     //search for it in the CDF
     double cdf = 0;
     for (j=0; j<nmemb; j++){
@@ -118,12 +216,195 @@ void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weigh
   *selected_len=s;
 }
 
+// Fenwick tree of weights (tree[1..n]), for sampling without replacement
+static void fenwick_add(double *tree, int n, int i, double delta){
+  for (i++; i<=n; i+=i&-i) tree[i] += delta;
+}
+
+// build the tree in O(n), returning the total weight
+static double fenwick_build(double *tree, const double *weights, int n){
+  double sum = 0;
+  int i, j;
+
+  tree[0] = 0;
+  for (i=1; i<=n; i++){
+    tree[i] = weights[i-1];
+    sum += weights[i-1];
+  }
+  for (i=1; i<=n; i++){
+    j = i + (i&-i);
+    if (j <= n) tree[j] += tree[i];
+  }
+
+  return sum;
+}
+
+// index of the item containing t in the CDF (n if t is beyond the total weight)
+static int fenwick_find(const double *tree, int n, double t){
+  int pos = 0, step;
+
+  for (step=1; step*2<=n; step*=2);
+  for (; step; step/=2){
+    if (pos+step <= n && tree[pos+step] <= t) {
+      pos += step;
+      t -= tree[pos];
+    }
+  }
+
+  return pos;
+}
+
+/**
+  * Select N of K with weigthed random choice, without replacement, in O(K + N log K).
+  * The selection has the same distribution of selectWeighted(), but the
+  * weights are kept in a Fenwick tree, and each selected item is removed
+  * from the tree, so that it cannot be selected again.
+  */
+static void selectWeightedTreeW(struct sched_ctx *ctx, size_t size,unsigned char *base, size_t nmemb, const double *w,unsigned char *selected,size_t *selected_len){
+  int i,j;
+  double *weights = sched_alloc(ctx, nmemb * sizeof(double));
+  double *tree = sched_alloc(ctx, (nmemb + 1) * sizeof(double));
+  double w_sum=0;
+  int s=0;
+  int s_max = MIN (*selected_len, nmemb);
+  int zeros = 0;
+
+  if (weights == NULL || tree == NULL) {
+    *selected_len = 0;
+    return;
+  }
+  // calculate weights
+  for (i=0; i<nmemb; i++){
+     weights[i] = w[i];
+     // weights should not be negative
+     weights[i] = MAX (weights[i], 0);
+     if (weights[i] == 0) zeros += 1;
+     w_sum += weights[i];
+  }
+
+  // all weights shuold not be zero, but if if happens, do something
+  if (w_sum == 0) {
+    for (i=0; i<nmemb; i++){
+      weights[i] = 1;
+      w_sum += weights[i];
+    }
+  } else { //exclude 0 weight from selection
+    s_max = MIN (s_max, nmemb - zeros);
+  }
+
+  fenwick_build(tree, weights, nmemb);
+  while (s < s_max) {
+    double t = w_sum * (sched_rand(ctx) / (RAND_MAX + 1.0));
+
+    j = fenwick_find(tree, nmemb, t);
+    if (j == nmemb || weights[j] == 0) {
+      // rounding errors accumulated in the tree: rebuild it, and scan the CDF
+      w_sum = fenwick_build(tree, weights, nmemb);
+      t = w_sum * (sched_rand(ctx) / (RAND_MAX + 1.0));
+      for (j=0; j<nmemb-1 && (weights[j] == 0 || t >= weights[j]); j++) t -= weights[j];
+      while (weights[j] == 0) j--;
+    }
+    memcpy(selected + size*s++, base + size*j, size);
+    fenwick_add(tree, nmemb, j, -weights[j]);
+    w_sum -= weights[j];
+    weights[j] = 0;
+  }
+  *selected_len=s;
+}
+
+/**
+  * Select N of K with the given ordering method, based on the given weights
+  */
+static void selectWithOrderingW(struct sched_ctx *ctx, SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, const double *w, unsigned char *selected,size_t *selected_len){
+  if (w == NULL) *selected_len = 0;
+  else if (ordering == SCHED_WEIGHTED) selectWeightedW(ctx, size, base, nmemb, w, selected, selected_len);
+  else if (ordering == SCHED_WEIGHTED_TREE) selectWeightedTreeW(ctx, size, base, nmemb, w, selected, selected_len);
+  else selectBestsW(ctx, size, base, nmemb, w, selected, selected_len);
+}
+
+/**
+  * Select N of K with the given ordering method, using the scratch memory of a context
+  */
+void selectWithOrderingCtx(struct sched_ctx *ctx, SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, evaluateUserFunction evaluate, unsigned char *selected,size_t *selected_len, void *user){
+  struct sched_ctx tmp;
+  struct sched_mark m;
+  double *w;
+  int i;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  // calculate weights
+  w = sched_alloc(ctx, nmemb * sizeof(double));
+  if (w) {
+    for (i=0; i<nmemb; i++){
+       w[i] = evaluate(base + size*i, user);
+    }
+  }
+  selectWithOrderingW(ctx, ordering, size, base, nmemb, w, selected, selected_len);
+  sched_ctx_leave(ctx, &tmp, &m);
+}
+
+/*
+ * Adapters for the evaluator and filter functions without user data: the
+ * functions are passed as user data
+ */
+struct plain_funcs {
+  filterFunction filter;
+  evaluateFunction evaluate;
+  peerEvaluateFunction peer;
+  chunkEvaluateFunction chunk;
+  pairEvaluateFunction pair;
+};
+
+static int plainFilter(schedPeerID p, schedChunkID c, void *user){
+  return ((struct plain_funcs *)user)->filter(p, c);
+}
+
+static double plainEvaluate(void *item, void *user){
+  return ((struct plain_funcs *)user)->evaluate(item);
+}
+
+static double plainPeer(schedPeerID *p, void *user){
+  return ((struct plain_funcs *)user)->peer(p);
+}
+
+static double plainChunk(schedChunkID *c, void *user){
+  return ((struct plain_funcs *)user)->chunk(c);
+}
+
+static double plainPair(struct PeerChunk *pc, void *user){
+  return ((struct plain_funcs *)user)->pair(pc);
+}
+
+#define PLAIN_FILTER(f) ((f) ? plainFilter : NULL)
+
 /**
   * Select best N of K with the given ordering method
   */
 void selectWithOrdering(SchedOrdering ordering, size_t size, unsigned char *base, size_t nmemb, double(*evaluate)(void *), unsigned char *selected,size_t *selected_len){
-  if (ordering == SCHED_WEIGHTED) selectWeighted(size, base, nmemb, evaluate, selected, selected_len);
-  else selectBests(size, base, nmemb, evaluate, selected, selected_len);
+  struct plain_funcs f = {.evaluate = evaluate};
+
+  selectWithOrderingCtx(NULL, ordering, size, base, nmemb, plainEvaluate, selected, selected_len, &f);
+}
+
+/**
+  * Select best N of K based using a given evaluator function
+  */
+void selectBests(size_t size,unsigned char *base, size_t nmemb, double(*evaluate)(void *),unsigned char *bests,size_t *bests_len){
+  selectWithOrdering(SCHED_BEST, size, base, nmemb, evaluate, bests, bests_len);
+}
+
+/**
+  * Select N of K with weigthed random choice, without replacement (multiple selection), based on a given evaluator function
+  */
+void selectWeighted(size_t size,unsigned char *base, size_t nmemb, double(*weight)(void *),unsigned char *selected,size_t *selected_len){
+  selectWithOrdering(SCHED_WEIGHTED, size, base, nmemb, weight, selected, selected_len);
+}
+
+/**
+  * Select N of K with weigthed random choice, without replacement, using a Fenwick tree
+  */
+void selectWeightedTree(size_t size,unsigned char *base, size_t nmemb, double(*weight)(void *),unsigned char *selected,size_t *selected_len){
+  selectWithOrdering(SCHED_WEIGHTED_TREE, size, base, nmemb, weight, selected, selected_len);
 }
 
 /**
@@ -151,14 +432,14 @@ void selectPairs(SchedOrdering ordering, struct PeerChunk *pairs, size_t pairs_l
 /**
   * Filter a list of peers. Include a peer if the filter function is true with at least one of the given chunks
   */
-void filterPeers2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
+static void filterPeersUser(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
                      schedPeerID *filteredpeers, size_t *filtered_len,	//out, inout
-                     filterFunction filter){
+                     filterUserFunction filter, void *user){
   int p,c;
   int f=0;
   for (p=0; p<peers_len; p++){
     for (c=0; c<chunks_len; c++){
-      if (!filter || filter(peers[p],chunks[c])) {
+      if (!filter || filter(peers[p],chunks[c],user)) {
         filteredpeers[f++]=peers[p];
         break;
       }
@@ -168,17 +449,25 @@ void filterPeers2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, si
   *filtered_len=f;
 }
 
+void filterPeers2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
+                     schedPeerID *filteredpeers, size_t *filtered_len,	//out, inout
+                     filterFunction filter){
+  struct plain_funcs f = {.filter = filter};
+
+  filterPeersUser(peers, peers_len, chunks, chunks_len, filteredpeers, filtered_len, PLAIN_FILTER(filter), &f);
+}
+
 /**
   * Filter a list of chunks. Include a chunk if the filter function is true with at least one of the given peers
   */
-void filterChunks2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
+static void filterChunksUser(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
                      schedChunkID *filtered, size_t *filtered_len,	//out, inout
-                     filterFunction filter){
+                     filterUserFunction filter, void *user){
   int p,c;
   int f=0;
   for (c=0; c<chunks_len; c++){
     for (p=0; p<peers_len; p++){
-      if (!filter || filter(peers[p],chunks[c])) {
+      if (!filter || filter(peers[p],chunks[c],user)) {
         filtered[f++]=chunks[c];
         break;
       }
@@ -188,49 +477,86 @@ void filterChunks2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, s
   *filtered_len=f;
 }
 
+void filterChunks2(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,
+                     schedChunkID *filtered, size_t *filtered_len,	//out, inout
+                     filterFunction filter){
+  struct plain_funcs f = {.filter = filter};
+
+  filterChunksUser(peers, peers_len, chunks, chunks_len, filtered, filtered_len, PLAIN_FILTER(filter), &f);
+}
+
 /**
   * Filter a list of peer-chunk pairs (in place)
   */
-void filterPairs(struct PeerChunk *pairs, size_t *pairs_len,
-                     filterFunction filter){
+static void filterPairsUser(struct PeerChunk *pairs, size_t *pairs_len,
+                     filterUserFunction filter, void *user){
   int pc;
   int f=0;
   for (pc=0; pc<(*pairs_len); pc++){
-    if (!filter || filter(pairs[pc].peer,pairs[pc].chunk)) {
+    if (!filter || filter(pairs[pc].peer,pairs[pc].chunk,user)) {
       pairs[f++]=pairs[pc];
     }
   }
   *pairs_len=f;
 }
 
+void filterPairs(struct PeerChunk *pairs, size_t *pairs_len,
+                     filterFunction filter){
+  struct plain_funcs f = {.filter = filter};
+
+  filterPairsUser(pairs, pairs_len, PLAIN_FILTER(filter), &f);
+}
+
 /**
   * Select at most N of K peers, among those where filter is true with at least one of the chunks.
   */
-void selectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+static void peersForChunks(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      schedPeerID *selected, size_t *selected_len,	//out, inout
-                     filterFunction filter,
-                     peerEvaluateFunction evaluate){
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction evaluate, void *user){
 
   size_t filtered_len=peers_len;
-  schedPeerID filtered[filtered_len];
+  schedPeerID *filtered = sched_alloc(ctx, filtered_len * sizeof(schedPeerID));
 
-  filterPeers2(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter);
+  if (filtered == NULL) {
+    *selected_len = 0;
+    return;
+  }
+  filterPeersUser(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter, user);
 	//fprintf(stderr,"[DEBUG] Filtered peers for offer: %d\n",filtered_len);
 
-  selectPeers(ordering, filtered, filtered_len, evaluate, selected, selected_len);
+  selectWithOrderingCtx(ctx, ordering, sizeof(filtered[0]), (void*)filtered, filtered_len, (evaluateUserFunction)evaluate, (void*)selected, selected_len, user);
 }
 
-void selectChunksForPeers(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+static void chunksForPeers(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      schedChunkID *selected, size_t *selected_len,	//out, inout
-                     filterFunction filter,
-                     chunkEvaluateFunction evaluate){
+                     filterUserFunction filter,
+                     chunkEvaluateUserFunction evaluate, void *user){
 
   size_t filtered_len=chunks_len;
-  schedChunkID filtered[filtered_len];
+  schedChunkID *filtered = sched_alloc(ctx, filtered_len * sizeof(schedChunkID));
 
-  filterChunks2(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter);
+  if (filtered == NULL) {
+    *selected_len = 0;
+    return;
+  }
+  filterChunksUser(peers, peers_len, chunks,chunks_len, filtered, &filtered_len, filter, user);
 
-  selectChunks(ordering, filtered, filtered_len, evaluate, selected, selected_len);
+  selectWithOrderingCtx(ctx, ordering, sizeof(filtered[0]), (void*)filtered, filtered_len, (evaluateUserFunction)evaluate, (void*)selected, selected_len, user);
+}
+
+void selectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     schedPeerID *selected, size_t *selected_len,	//out, inout
+                     filterFunction filter,
+                     peerEvaluateFunction evaluate){
+  schedSelectPeersForChunks(ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, filter, evaluate);
+}
+
+void selectChunksForPeers(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     schedChunkID *selected, size_t *selected_len,	//out, inout
+                     filterFunction filter,
+                     chunkEvaluateFunction evaluate){
+  schedSelectChunksForPeers(ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, filter, evaluate);
 }
 
 
@@ -269,41 +595,153 @@ void toPairs(schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t
 }
 
 /*----------------- scheduler_la implementations --------------*/
+void schedSelectChunksForPeersCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     schedChunkID *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     chunkEvaluateUserFunction evaluate, void *user){
+  struct sched_ctx tmp;
+  struct sched_mark m;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  chunksForPeers(ctx, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, filter, evaluate, user);
+  sched_ctx_leave(ctx, &tmp, &m);
+}
+
 void schedSelectChunksForPeers(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      schedChunkID *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      chunkEvaluateFunction evaluate){
-   selectChunksForPeers(ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, filter, evaluate);
+  struct plain_funcs f = {.filter = filter, .chunk = evaluate};
+
+  schedSelectChunksForPeersCtx(NULL, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, PLAIN_FILTER(filter), plainChunk, &f);
+}
+
+void schedSelectPeersForChunksCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
+                     schedPeerID *selected, size_t *selected_len,       //out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction evaluate, void *user){
+  struct sched_ctx tmp;
+  struct sched_mark m;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  peersForChunks(ctx, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, filter, evaluate, user);
+  sched_ctx_leave(ctx, &tmp, &m);
+}
+
+void schedSelectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
+                     schedPeerID *selected, size_t *selected_len,       //out, inout
+                     filterFunction filter,
+                     peerEvaluateFunction evaluate){
+  struct plain_funcs f = {.filter = filter, .peer = evaluate};
+
+  schedSelectPeersForChunksCtx(NULL, ordering, peers, peers_len, chunks, chunks_len,        //in
+                     selected, selected_len,       //out, inout
+                     PLAIN_FILTER(filter),
+                     plainPeer, &f);
+}
+
+void schedSelectPeerFirstCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, void *user){
+  struct sched_ctx tmp;
+  struct sched_mark m;
+  size_t p_len=1;
+  schedPeerID *p;
+  size_t c_len=*selected_len;
+  schedChunkID *c;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  p = sched_alloc(ctx, p_len * sizeof(schedPeerID));
+  c = sched_alloc(ctx, c_len * sizeof(schedChunkID));
+  if (p && c) {
+    peersForChunks(ctx, ordering, peers, peers_len, chunks, chunks_len, p, &p_len, filter, peerevaluate, user);
+    chunksForPeers(ctx, ordering, p, p_len, chunks, chunks_len, c, &c_len, filter, chunkevaluate, user);
+
+    toPairsPeerFirst(p,p_len,c,c_len,selected,selected_len);
+  } else {
+    *selected_len = 0;
+  }
+  sched_ctx_leave(ctx, &tmp, &m);
 }
 
 void schedSelectPeerFirst(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      struct PeerChunk *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      peerEvaluateFunction peerevaluate, chunkEvaluateFunction chunkevaluate){
+  struct plain_funcs f = {.filter = filter, .peer = peerevaluate, .chunk = chunkevaluate};
 
-  size_t p_len=1;
-  schedPeerID p[p_len];
-  size_t c_len=*selected_len;
-  schedChunkID c[c_len];
-  selectPeersForChunks(ordering, peers, peers_len, chunks, chunks_len, p, &p_len, filter, peerevaluate);
-  selectChunksForPeers(ordering, p, p_len, chunks, chunks_len, c, &c_len, filter, chunkevaluate);
+  schedSelectPeerFirstCtx(NULL, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, PLAIN_FILTER(filter), plainPeer, plainChunk, &f);
+}
 
-  toPairsPeerFirst(p,p_len,c,c_len,selected,selected_len);
+void schedSelectChunkFirstCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, void *user){
+  struct sched_ctx tmp;
+  struct sched_mark m;
+  size_t p_len=*selected_len;
+  schedPeerID *p;
+  size_t c_len=1;
+  schedChunkID *c;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  p = sched_alloc(ctx, p_len * sizeof(schedPeerID));
+  c = sched_alloc(ctx, c_len * sizeof(schedChunkID));
+  if (p && c) {
+    chunksForPeers(ctx, ordering, peers, peers_len, chunks, chunks_len, c, &c_len, filter, chunkevaluate, user);
+    peersForChunks(ctx, ordering, peers, peers_len, c, c_len, p, &p_len, filter, peerevaluate, user);
+
+    toPairsChunkFirst(p,p_len,c,c_len,selected,selected_len);
+  } else {
+    *selected_len = 0;
+  }
+  sched_ctx_leave(ctx, &tmp, &m);
 }
 
 void schedSelectChunkFirst(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      struct PeerChunk *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
                      peerEvaluateFunction peerevaluate, chunkEvaluateFunction chunkevaluate){
+  struct plain_funcs f = {.filter = filter, .peer = peerevaluate, .chunk = chunkevaluate};
 
-  size_t p_len=*selected_len;
-  schedPeerID p[p_len];
-  size_t c_len=1;
-  schedChunkID c[c_len];
-  selectChunksForPeers(ordering, peers, peers_len, chunks, chunks_len, c, &c_len, filter, chunkevaluate);
-  selectPeersForChunks(ordering, peers, peers_len, c, c_len, p, &p_len, filter, peerevaluate);
+  schedSelectChunkFirstCtx(NULL, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, PLAIN_FILTER(filter), plainPeer, plainChunk, &f);
+}
+
+// all the peer-chunk pairs satisfying the filter
+static struct PeerChunk *filteredPairs(struct sched_ctx *ctx, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     filterUserFunction filter, void *user, size_t *pairs_len){	//out
+  struct PeerChunk *pairs;
 
-  toPairsChunkFirst(p,p_len,c,c_len,selected,selected_len);
+  *pairs_len=peers_len*chunks_len;
+  pairs = sched_alloc(ctx, *pairs_len * sizeof(struct PeerChunk));
+  if (pairs == NULL) {
+    return NULL;
+  }
+  toPairs(peers,peers_len,chunks,chunks_len,pairs,pairs_len);
+  filterPairsUser(pairs,pairs_len,filter,user);
+
+  return pairs;
+}
+
+void schedSelectHybridCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
+                     filterUserFunction filter,
+                     pairEvaluateUserFunction pairevaluate, void *user)
+{
+  struct sched_ctx tmp;
+  struct sched_mark m;
+  size_t pairs_len;
+  struct PeerChunk *pairs;
+
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  pairs = filteredPairs(ctx, peers, peers_len, chunks, chunks_len, filter, user, &pairs_len);
+  if (pairs) {
+    selectWithOrderingCtx(ctx, ordering, sizeof(pairs[0]), (void*)pairs, pairs_len, (evaluateUserFunction)pairevaluate, (void*)selected, selected_len, user);
+  } else {
+    *selected_len = 0;
+  }
+  sched_ctx_leave(ctx, &tmp, &m);
 }
 
 void schedSelectHybrid(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
@@ -311,48 +749,48 @@ void schedSelectHybrid(SchedOrdering ordering, schedPeerID *peers, size_t peers_
                      filterFunction filter,
                      pairEvaluateFunction pairevaluate)
 {
-  size_t pairs_len=peers_len*chunks_len;
-  struct PeerChunk pairs[pairs_len];
-  toPairs(peers,peers_len,chunks,chunks_len,pairs,&pairs_len);
-  filterPairs(pairs,&pairs_len,filter);
-  selectPairs(ordering,pairs,pairs_len,pairevaluate,selected,selected_len);
-}
-
+  struct plain_funcs f = {.filter = filter, .pair = pairevaluate};
 
-peerEvaluateFunction peer_ev;
-chunkEvaluateFunction chunk_ev;
-double2op peerchunk_wc;
-
-double combinedWeight(struct PeerChunk* pc){
-  return peerchunk_wc(peer_ev(&pc->peer),chunk_ev(&pc->chunk));
+  schedSelectHybridCtx(NULL, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, PLAIN_FILTER(filter), plainPair, &f);
 }
 
 /**
   * Convenience function for combining peer and chunk weights
-  * not thread safe!
   */
-void schedSelectComposed(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+void schedSelectComposedCtx(struct sched_ctx *ctx, SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
                      struct PeerChunk *selected, size_t *selected_len,	//out, inout
-                     filterFunction filter,
-                     peerEvaluateFunction peerevaluate, chunkEvaluateFunction chunkevaluate, double2op weightcombine)
+                     filterUserFunction filter,
+                     peerEvaluateUserFunction peerevaluate, chunkEvaluateUserFunction chunkevaluate, double2op weightcombine, void *user)
 {
-  peer_ev=peerevaluate;
-  chunk_ev=chunkevaluate;
-  peerchunk_wc=weightcombine;
-  schedSelectHybrid(ordering,peers,peers_len,chunks,chunks_len,selected,selected_len,filter,combinedWeight);
+  struct sched_ctx tmp;
+  struct sched_mark m;
+  size_t pairs_len;
+  struct PeerChunk *pairs;
+  double *w = NULL;
+  int i;
 
+  ctx = sched_ctx_enter(ctx, &tmp, &m);
+  pairs = filteredPairs(ctx, peers, peers_len, chunks, chunks_len, filter, user, &pairs_len);
+  if (pairs) {
+    w = sched_alloc(ctx, pairs_len * sizeof(double));
+  }
+  if (w) {
+    for (i=0; i<pairs_len; i++){
+      w[i] = weightcombine(peerevaluate(&pairs[i].peer, user), chunkevaluate(&pairs[i].chunk, user));
+    }
+    selectWithOrderingW(ctx, ordering, sizeof(pairs[0]), (void*)pairs, pairs_len, w, (void*)selected, selected_len);
+  } else {
+    *selected_len = 0;
+  }
+  sched_ctx_leave(ctx, &tmp, &m);
 }
 
-void schedSelectPeersForChunks(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len,        //in
-                     schedPeerID *selected, size_t *selected_len,       //out, inout
+void schedSelectComposed(SchedOrdering ordering, schedPeerID *peers, size_t peers_len, schedChunkID *chunks, size_t chunks_len, 	//in
+                     struct PeerChunk *selected, size_t *selected_len,	//out, inout
                      filterFunction filter,
-                     peerEvaluateFunction evaluate){
-   selectPeersForChunks(ordering, peers, peers_len, chunks, chunks_len,        //in
-                     selected, selected_len,       //out, inout
-                     filter,
-                      evaluate);
-}
-
-
-
+                     peerEvaluateFunction peerevaluate, chunkEvaluateFunction chunkevaluate, double2op weightcombine)
+{
+  struct plain_funcs f = {.filter = filter, .peer = peerevaluate, .chunk = chunkevaluate};
 
+  schedSelectComposedCtx(NULL, ordering, peers, peers_len, chunks, chunks_len, selected, selected_len, PLAIN_FILTER(filter), plainPeer, plainChunk, weightcombine, &f);
+}
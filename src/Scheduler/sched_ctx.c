@@ -0,0 +1,188 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Scheduler contexts: the scratch memory needed by the selection
+ *  functions is taken from a list of heap blocks, which are reused across
+ *  invocations instead of allocating variable length arrays on the stack.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "grapes_config.h"
+#include "scheduler_la.h"
+#include "sched_private.h"
+
+#define SCHED_ALIGN 16
+#define SCHED_BLOCK_MIN 4096
+#define MAX(A,B)    ((A)>(B) ? (A) : (B))
+
+struct sched_block {
+  struct sched_block *next;
+  size_t size;
+  size_t used;
+};
+
+#define ALIGN_UP(x) (((x) + SCHED_ALIGN - 1) & ~(size_t)(SCHED_ALIGN - 1))
+#define BLOCK_DATA(b) ((unsigned char *)(b) + ALIGN_UP(sizeof(struct sched_block)))
+
+static struct sched_block *block_new(struct sched_ctx *ctx, size_t size)
+{
+  struct sched_block *b;
+
+  if (ctx->max_size && ctx->total + size > ctx->max_size) {
+    return NULL;
+  }
+  b = malloc(ALIGN_UP(sizeof(struct sched_block)) + size);
+  if (b == NULL) {
+    return NULL;
+  }
+  b->size = size;
+  b->used = 0;
+  ctx->total += size;
+
+  return b;
+}
+
+static void blocks_free(struct sched_block *b)
+{
+  while (b) {
+    struct sched_block *next = b->next;
+
+    free(b);
+    b = next;
+  }
+}
+
+void *sched_alloc(struct sched_ctx *ctx, size_t size)
+{
+  struct sched_block *b = ctx->blocks, **f;
+  void *res;
+
+  size = ALIGN_UP(size ? size : 1);
+  if (b == NULL || b->size - b->used < size) {
+    /* Reuse a released block, if large enough */
+    for (f = &ctx->free; *f && (*f)->size < size; f = &(*f)->next);
+    if (*f) {
+      b = *f;
+      *f = b->next;
+    } else {
+      size_t bsize = MAX(size, ctx->blocks ? ctx->blocks->size * 2 : SCHED_BLOCK_MIN);
+
+      b = block_new(ctx, bsize);
+      if (b == NULL && bsize > size) {
+        b = block_new(ctx, size);
+      }
+      if (b == NULL) {
+        return NULL;
+      }
+    }
+    b->used = 0;
+    b->next = ctx->blocks;
+    ctx->blocks = b;
+  }
+  res = BLOCK_DATA(b) + b->used;
+  b->used += size;
+
+  return res;
+}
+
+void sched_mark(const struct sched_ctx *ctx, struct sched_mark *m)
+{
+  m->block = ctx->blocks;
+  m->used = ctx->blocks ? ctx->blocks->used : 0;
+}
+
+void sched_release(struct sched_ctx *ctx, const struct sched_mark *m)
+{
+  while (ctx->blocks && ctx->blocks != m->block) {
+    struct sched_block *b = ctx->blocks;
+
+    ctx->blocks = b->next;
+    b->next = ctx->free;
+    ctx->free = b;
+  }
+  if (ctx->blocks) {
+    ctx->blocks->used = m->used;
+  }
+}
+
+int sched_rand(struct sched_ctx *ctx)
+{
+  uint32_t x;
+
+  if (!ctx->own_rand) {
+    return rand();
+  }
+  /* xorshift32 */
+  x = ctx->rand_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  ctx->rand_state = x;
+
+  return x % ((uint32_t)RAND_MAX + 1);
+}
+
+struct sched_ctx *sched_ctx_enter(struct sched_ctx *ctx, struct sched_ctx *tmp, struct sched_mark *m)
+{
+  if (ctx == NULL) {
+    tmp->blocks = tmp->free = NULL;
+    tmp->total = tmp->max_size = 0;
+    tmp->own_rand = 0;
+    ctx = tmp;
+  }
+  sched_mark(ctx, m);
+
+  return ctx;
+}
+
+void sched_ctx_leave(struct sched_ctx *ctx, struct sched_ctx *tmp, const struct sched_mark *m)
+{
+  if (ctx == tmp) {
+    blocks_free(ctx->blocks);
+    blocks_free(ctx->free);
+  } else {
+    sched_release(ctx, m);
+  }
+}
+
+struct sched_ctx *schedCtxInit(const char *config)
+{
+  struct sched_ctx *ctx;
+  struct tag *cfg_tags;
+  int size = 0, max_size = 0, seed = 0, own_rand = 0;
+
+  cfg_tags = grapes_config_parse(config);
+  if (cfg_tags) {
+    grapes_config_value_int(cfg_tags, "size", &size);
+    grapes_config_value_int(cfg_tags, "max_size", &max_size);
+    own_rand = grapes_config_value_int(cfg_tags, "seed", &seed);
+    free(cfg_tags);
+  }
+
+  ctx = malloc(sizeof(struct sched_ctx));
+  if (ctx == NULL) {
+    return NULL;
+  }
+  ctx->blocks = ctx->free = NULL;
+  ctx->total = 0;
+  ctx->max_size = max_size > 0 ? max_size : 0;
+  ctx->own_rand = own_rand;
+  ctx->rand_state = seed ? seed : 1;
+  if (size > 0) {
+    ctx->free = block_new(ctx, ALIGN_UP(size));
+    if (ctx->free) {
+      ctx->free->next = NULL;
+    }
+  }
+
+  return ctx;
+}
+
+void schedCtxFree(struct sched_ctx *ctx)
+{
+  blocks_free(ctx->blocks);
+  blocks_free(ctx->free);
+  free(ctx);
+}
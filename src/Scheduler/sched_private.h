@@ -0,0 +1,43 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ */
+
+#ifndef SCHED_PRIVATE_H
+#define SCHED_PRIVATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct sched_block;
+
+/* Scratch memory: blocks are allocated with a stack discipline */
+struct sched_ctx {
+  struct sched_block *blocks;	/* in use, current block first */
+  struct sched_block *free;	/* released blocks, kept for reuse */
+  size_t total;			/* size of all the blocks */
+  size_t max_size;		/* 0 for no limit */
+  int own_rand;			/* use rand_state instead of rand() */
+  uint32_t rand_state;
+};
+
+struct sched_mark {
+  struct sched_block *block;
+  size_t used;
+};
+
+/*
+ * Get a context for an entry point: if ctx is NULL, tmp is initialized
+ * and used as a temporary context. The memory allocated after this call
+ * is released by sched_ctx_leave().
+ */
+struct sched_ctx *sched_ctx_enter(struct sched_ctx *ctx, struct sched_ctx *tmp, struct sched_mark *m);
+void sched_ctx_leave(struct sched_ctx *ctx, struct sched_ctx *tmp, const struct sched_mark *m);
+
+/* A random number between 0 and RAND_MAX */
+int sched_rand(struct sched_ctx *ctx);
+
+void *sched_alloc(struct sched_ctx *ctx, size_t size);
+void sched_mark(const struct sched_ctx *ctx, struct sched_mark *m);
+void sched_release(struct sched_ctx *ctx, const struct sched_mark *m);
+
+#endif	/* SCHED_PRIVATE_H */
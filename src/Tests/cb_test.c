@@ -11,6 +11,10 @@
 #include <string.h>
 #include "chunk.h"
 #include "chunkbuffer.h"
+#include "trade_msg_la.h"
+#include "rcbuf.h"
+#include "chunk_pool.h"
+#include "int_coding.h"
 
 static struct chunk *chunk_forge(int id)
 {
@@ -53,6 +57,48 @@ static void chunk_add(struct chunk_buffer *cb, int id)
   free(c);
 }
 
+static void chunk_add_ref(struct chunk_buffer *cb, int id)
+{
+  struct chunk *c, dc;
+  struct rcbuf *rb;
+  int res;
+
+  printf("Inserting %d without copying it... ", id);
+  c = chunk_forge(id);
+  rb = c ? rcbuf_new(CHUNK_HEADER_SIZE + c->size) : NULL;
+  if (rb) {
+    encodeChunk(c, rcbuf_data(rb), rcbuf_size(rb));
+    res = decodeChunkRef(&dc, rcbuf_data(rb), rcbuf_size(rb));
+    if (res < 0 || cb_add_chunk_ref(cb, &dc, rb) < 0) {
+      printf("not inserted");
+    }
+    rcbuf_unref(rb);
+  } else {
+    printf("Failed to create the chunk");
+  }
+  printf("\n");
+  if (c) {
+    free(c->data);
+  }
+  free(c);
+}
+
+/* A header whose sizes overflow when summed must not be accepted */
+static int chunk_bad_ref(void)
+{
+  struct chunk c;
+  uint8_t buff[64];
+  int res;
+
+  memset(buff, 0, sizeof(buff));
+  int_cpy(buff + 12, 0x7FFFFFFF);
+  int_cpy(buff + 16, 0x7FFFFFFF);
+  res = decodeChunkRef(&c, buff, sizeof(buff));
+  printf("Decoding a chunk with overflowing sizes: %d\n", res);
+
+  return res < 0 ? 0 : -1;
+}
+
 static void cb_print(const struct chunk_buffer *cb)
 {
   struct chunk *buff;
@@ -64,11 +110,12 @@ static void cb_print(const struct chunk_buffer *cb)
   }
 }
 
-int main(int argc, char *argv[])
+static int cb_run(const char *config)
 {
   struct chunk_buffer *b;
 
-  b = cb_init("size=8,time=now");
+  printf("Testing %s\n", config);
+  b = cb_init(config);
   if (b == NULL) {
     printf("Error initialising the Chunk Buffer\n");
 
@@ -101,8 +148,36 @@ int main(int argc, char *argv[])
   chunk_add(b, 2);
   chunk_add(b, 33);
   cb_print(b);
+  chunk_add_ref(b, 120);
+  chunk_add_ref(b, 120);
+  chunk_add(b, 121);
+  cb_print(b);
 
   cb_destroy(b);
 
   return 0;
 }
+
+int main(int argc, char *argv[])
+{
+  struct chunk_pool_stats s;
+
+  if (cb_run("size=8,time=now") < 0) {
+    return -1;
+  }
+  if (cb_run("size=8,time=now,type=ring") < 0) {
+    return -1;
+  }
+  if (cb_run("size=8,time=now,pool_size=1048576") < 0) {
+    return -1;
+  }
+  if (chunk_bad_ref() < 0) {
+    return -1;
+  }
+  chunk_pool_get_stats(&s);
+  printf("Pool: %llu allocs, %llu hits, %llu frees, %zu bytes allocated, %zu in use\n",
+         (unsigned long long)s.allocs, (unsigned long long)s.hits,
+         (unsigned long long)s.frees, s.footprint, s.in_use);
+
+  return 0;
+}
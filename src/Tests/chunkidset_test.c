@@ -10,6 +10,7 @@
 #include <string.h>
 #include "chunkidset.h"
 #include "trade_sig_la.h"
+#include "int_coding.h"
 #include "chunkid_set_h.h"
 
 static void simple_test(void)
@@ -66,6 +67,115 @@ static void encoding_test(const char *mode)
   free(cset1);
 }
 
+static void decode_into_test(void)
+{
+  static const char *modes[] = {"type=priority", "type=bitmap", "type=bitmap,encoding=compact", "type=dense"};
+  struct chunkID_set *cset, *rset;
+  static uint8_t buff[2048];
+  const uint8_t *meta;
+  int i, res, meta_len;
+
+  rset = chunkID_set_init("type=dense");
+  for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+    cset = chunkID_set_init(modes[i]);
+    if (!cset || !rset) {
+      fprintf(stderr,"Unable to allocate memory for rcset\n");
+
+      return;
+    }
+    chunkID_set_add_chunk(cset, 10 + i);
+    chunkID_set_add_chunk(cset, 5);
+    chunkID_set_add_chunk(cset, 7);
+    res = encodeChunkSignaling(cset, "meta", 5, buff, sizeof(buff));
+    res = decodeChunkSignalingInto(rset, &meta, &meta_len, buff, res);
+    printf("Decoding %s into the same set: %d, metadata %s\n", modes[i], res, meta_len ? (const char *)meta : "none");
+    printChunkID_set(rset);
+    chunkID_set_free(cset);
+  }
+  chunkID_set_free(rset);
+}
+
+/* Compact sets claiming huge runs, or IDs overflowing, must be rejected */
+static void compact_bounds_test(void)
+{
+  struct chunkID_set *cset;
+  static uint8_t buff[64];
+  const uint8_t *meta;
+  int len, meta_len, res;
+
+  cset = chunkID_set_init("type=bitmap,encoding=compact");
+  if (!cset) {
+    fprintf(stderr,"Unable to allocate memory for rcset\n");
+
+    return;
+  }
+  int_cpy(buff, 0xFFFFFFFF);
+  int_cpy(buff + 4, 3);		/* CIST_COMPACT */
+  int_cpy(buff + 8, 0);
+  buff[12] = 1;			/* COMPACT_RUNS */
+  len = 13;
+  len += varint_cpy(buff + len, 1);
+  len += varint_cpy(buff + len, 0);
+  len += varint_cpy(buff + len, 0xFFFFFFFE);
+  res = decodeChunkSignalingInto(cset, &meta, &meta_len, buff, len);
+  printf("Decoding a run of 2^32 - 1 IDs: %d\n", res);
+
+  int_cpy(buff, 2);
+  buff[12] = 0;			/* COMPACT_DELTA */
+  len = 13;
+  len += varint_cpy(buff + len, 0x7FFFFFFF);
+  len += varint_cpy(buff + len, 0);
+  res = decodeChunkSignalingInto(cset, &meta, &meta_len, buff, len);
+  printf("Decoding IDs larger than INT_MAX: %d (%d chunks)\n", res, chunkID_set_size(cset));
+  chunkID_set_free(cset);
+
+  /* A dense set must not allocate a bitmap covering the whole range */
+  cset = chunkID_set_init("type=dense");
+  if (!cset) {
+    fprintf(stderr,"Unable to allocate memory for rcset\n");
+
+    return;
+  }
+  len = 13;
+  len += varint_cpy(buff + len, 0);
+  len += varint_cpy(buff + len, 0x7FFFFFFE);
+  res = decodeChunkSignalingInto(cset, &meta, &meta_len, buff, len);
+  printf("Decoding IDs 0 and INT_MAX into a dense set: %d (%d chunks)\n", res, chunkID_set_size(cset));
+  printChunkID_set(cset);
+  chunkID_set_free(cset);
+}
+
+static void set_ops_test(const char *mode)
+{
+  struct chunkID_set *cset, *cset1;
+  char config[32];
+  int i;
+
+  sprintf(config, "type=%s", mode);
+  cset = chunkID_set_init(config);
+  cset1 = chunkID_set_init(config);
+  if (!cset || !cset1) {
+    fprintf(stderr,"Unable to allocate memory for rcset\n");
+
+    return;
+  }
+  for (i = 0; i < 100; i += 2) {
+    chunkID_set_add_chunk(cset, i);
+  }
+  for (i = 0; i < 200; i += 3) {
+    chunkID_set_add_chunk(cset1, i);
+  }
+  printf("%s: %d chunks are not in the other set\n", mode, chunkID_set_count_difference(cset, cset1));
+  chunkID_set_difference(cset, cset1);
+  printChunkID_set(cset);
+  chunkID_set_union(cset, cset1);
+  printChunkID_set(cset);
+  chunkID_set_intersection(cset, cset1);
+  printChunkID_set(cset);
+  chunkID_set_free(cset);
+  chunkID_set_free(cset1);
+}
+
 static void metadata_test(void)
 {
   struct chunkID_set *cset;
@@ -94,6 +204,14 @@ int main(int argc, char *argv[])
   simple_test();
   encoding_test("priority");
   encoding_test("bitmap");
+  encoding_test("dense");
+  encoding_test("bitmap,encoding=compact");
+  encoding_test("dense,encoding=compact");
+  decode_into_test();
+  compact_bounds_test();
+  set_ops_test("priority");
+  set_ops_test("bitmap");
+  set_ops_test("dense");
   metadata_test();
 
   return 0;
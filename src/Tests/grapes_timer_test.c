@@ -0,0 +1,107 @@
+/*
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Test for the protocol timers: some timers are armed, and the time until
+ *  the first deadline is checked while the (simulated) time goes on.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "grapes_timer.h"
+
+#define N_TIMERS 4
+#define BASE_TIME 1000000000ull
+
+static struct timeval ms(int t)
+{
+  struct timeval tv;
+
+  tv.tv_sec = BASE_TIME / 1000000 + t / 1000;
+  tv.tv_usec = (t % 1000) * 1000;
+
+  return tv;
+}
+
+static uint64_t deadline(int t)
+{
+  return BASE_TIME + (uint64_t)t * 1000;
+}
+
+/* The time (in ms) until the first deadline, -1 if no timer is armed */
+static int next(int t)
+{
+  struct timeval now = ms(t), tout;
+
+  if (grapes_timer_next(&now, &tout) == 0) {
+    return -1;
+  }
+
+  return tout.tv_sec * 1000 + tout.tv_usec / 1000;
+}
+
+int main(int argc, char *argv[])
+{
+  struct grapes_timer *t[N_TIMERS];
+  int i, res, errors = 0;
+
+  for (i = 0; i < N_TIMERS; i++) {
+    t[i] = grapes_timer_new();
+    if (t[i] == NULL) {
+      fprintf(stderr, "Initialization failed\n");
+
+      return -1;
+    }
+  }
+  res = next(0);
+  printf("No timers armed: %d\n", res);
+  errors += res != -1;
+
+  /* A 2s period, a 10s period, and a deadline far in the future */
+  grapes_timer_set(t[0], deadline(2000));
+  grapes_timer_set(t[1], deadline(10000));
+  grapes_timer_set(t[2], deadline(3600 * 1000));
+  res = next(0);
+  printf("Next deadline at 0ms: %dms (expected 2000)\n", res);
+  errors += res != 2000;
+  res = next(1500);
+  printf("Next deadline at 1500ms: %dms (expected 500)\n", res);
+  errors += res != 500;
+
+  /* The first timer expires; it is due until it is set again */
+  res = next(2300);
+  printf("Next deadline at 2300ms: %dms (expected 0)\n", res);
+  errors += res != 0;
+  grapes_timer_set(t[0], deadline(4000));
+  errors += next(2300) != 1700;
+
+  /* A deadline earlier than the current tick, and one in the same tick */
+  grapes_timer_set(t[3], deadline(2000));
+  errors += next(2300) != 0;
+  grapes_timer_set(t[3], deadline(2305));
+  errors += next(2300) != 5;
+  grapes_timer_set(t[3], 0);
+  errors += next(2300) != 1700;
+
+  /* Only the timers in later rounds of the wheel are left */
+  grapes_timer_free(t[0]);
+  grapes_timer_free(t[1]);
+  res = next(2300);
+  printf("Next deadline at 2300ms: %dms (expected %d)\n", res, 3600 * 1000 - 2300);
+  errors += res != 3600 * 1000 - 2300;
+
+  /* After a long pause */
+  res = next(3600 * 1000 + 1);
+  errors += res != 0;
+  grapes_timer_set(t[2], deadline(3600 * 1000 + 2000));
+  errors += next(3600 * 1000 + 1) != 1999;
+
+  grapes_timer_free(t[2]);
+  grapes_timer_free(t[3]);
+  errors += next(3600 * 1000 + 1) != -1;
+  printf("%d errors\n", errors);
+
+  return errors ? 1 : 0;
+}
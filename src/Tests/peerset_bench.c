@@ -0,0 +1,121 @@
+/*
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Micro-benchmark for nodeID comparison: looks up all the peers of a
+ *  large peerset, and compares the binary nodeid_cmp() against the old
+ *  string-based comparison (inet_ntop() + strcmp()).
+ */
+
+#include <sys/time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "net_helper.h"
+#include "peerset.h"
+
+#define PEERS 10000
+#define ROUNDS 10
+
+static uint64_t gettime(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+
+  return tv.tv_usec + tv.tv_sec * 1000000ull;
+}
+
+static int nodeid_cmp_str(const struct nodeID *s1, const struct nodeID *s2)
+{
+  char ip1[80], ip2[80];
+  int res;
+
+  node_ip(s1, ip1, 80);
+  node_ip(s2, ip2, 80);
+  res = strcmp(ip1, ip2);
+
+  return res ? res : node_port(s1) - node_port(s2);
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+  return nodeid_cmp_str(*(struct nodeID *const *)a, *(struct nodeID *const *)b);
+}
+
+static int cmp_bin(const void *a, const void *b)
+{
+  return nodeid_cmp(*(struct nodeID *const *)a, *(struct nodeID *const *)b);
+}
+
+static uint64_t lookup_all(struct nodeID **sorted, struct nodeID **ids, int n, int (*cmp)(const void *, const void *))
+{
+  uint64_t t;
+  int i, j, found = 0;
+
+  t = gettime();
+  for (j = 0; j < ROUNDS; j++) {
+    for (i = 0; i < n; i++) {
+      found += bsearch(&ids[i], sorted, n, sizeof(struct nodeID *), cmp) != NULL;
+    }
+  }
+  t = gettime() - t;
+  if (found != n * ROUNDS) {
+    fprintf(stderr, "Lookup failed: %d of %d found\n", found, n * ROUNDS);
+    exit(-1);
+  }
+
+  return t;
+}
+
+int main(int argc, char *argv[])
+{
+  struct nodeID *ids[PEERS], *sorted_str[PEERS], *sorted_bin[PEERS];
+  struct peerset *ps;
+  uint64_t t_str, t_bin, t;
+  uint32_t h = 0;
+  int i, found;
+
+  for (i = 0; i < PEERS; i++) {
+    char ip[32];
+
+    sprintf(ip, "10.%d.%d.%d", (i >> 8) & 0xff, i & 0xff, i % 7);
+    ids[i] = create_node(ip, 5000 + i % 13);
+    sorted_str[i] = sorted_bin[i] = ids[i];
+  }
+  qsort(sorted_str, PEERS, sizeof(struct nodeID *), cmp_str);
+  qsort(sorted_bin, PEERS, sizeof(struct nodeID *), cmp_bin);
+
+  t_str = lookup_all(sorted_str, ids, PEERS, cmp_str);
+  t_bin = lookup_all(sorted_bin, ids, PEERS, cmp_bin);
+  printf("bsearch on %d peers (x%d): string compare %llu us, binary compare %llu us (speedup %.1fx)\n",
+         PEERS, ROUNDS, (unsigned long long)t_str, (unsigned long long)t_bin, (double)t_str / (t_bin ? t_bin : 1));
+
+  ps = peerset_init("size=0");
+  for (i = 0; i < PEERS; i++) {
+    peerset_add_peer(ps, ids[i]);
+  }
+  t = gettime();
+  for (found = 0, i = 0; i < PEERS * ROUNDS; i++) {
+    found += peerset_check(ps, ids[i % PEERS]) >= 0;
+  }
+  t = gettime() - t;
+  printf("peerset_check on %d peers (x%d): %llu us, %d found\n",
+         PEERS, ROUNDS, (unsigned long long)t, found);
+
+  t = gettime();
+  for (i = 0; i < PEERS * ROUNDS; i++) {
+    h += nodeid_hash(ids[i % PEERS]);
+  }
+  t = gettime() - t;
+  printf("nodeid_hash on %d peers (x%d): %llu us (%x)\n",
+         PEERS, ROUNDS, (unsigned long long)t, h);
+
+  peerset_destroy(&ps);
+  for (i = 0; i < PEERS; i++) {
+    nodeid_free(ids[i]);
+  }
+
+  return found == PEERS * ROUNDS ? 0 : -1;
+}
@@ -0,0 +1,123 @@
+/*
+ *  This is free software; see gpl-3.0.txt
+ *
+ *  Test for the signaling transactions table: transactions are opened
+ *  with some peers, and then matched or expired (the time is simulated).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "net_helper.h"
+#include "chunkidset.h"
+#include "trade_sig_ha.h"
+#include "trade_sig_trans.h"
+
+#define N_PEERS 4
+
+static struct timeval ms(int t)
+{
+  struct timeval tv;
+
+  tv.tv_sec = 1000 + t / 1000;
+  tv.tv_usec = (t % 1000) * 1000;
+
+  return tv;
+}
+
+int main(int argc, char *argv[])
+{
+  struct sig_trans_table *t;
+  struct nodeID *peers[N_PEERS];
+  struct chunkID_set *cset;
+  struct sig_trans_timeout expired[8];
+  struct sig_trans_stats stats;
+  struct timeval now;
+  int i, res, rtt, errors = 0;
+
+  t = sig_trans_init("timeout=500,tick=10");
+  cset = chunkID_set_init("size=0");
+  if (t == NULL || cset == NULL) {
+    fprintf(stderr, "Initialization failed\n");
+
+    return -1;
+  }
+  for (i = 0; i < N_PEERS; i++) {
+    peers[i] = create_node("127.0.0.1", 6000 + i);
+  }
+  for (i = 10; i < 15; i++) {
+    chunkID_set_add_chunk(cset, i);
+  }
+
+  /* Offer chunks 10-14 to all the peers at t = 0 */
+  now = ms(0);
+  for (i = 0; i < N_PEERS; i++) {
+    sig_trans_open(t, peers[i], 100 + i, sig_offer, cset, &now);
+  }
+  printf("Chunk 12 in flight %d times (expected %d)\n", sig_trans_in_flight(t, 12), N_PEERS);
+  errors += sig_trans_in_flight(t, 12) != N_PEERS;
+  errors += sig_trans_in_flight(t, 20) != 0;
+
+  /* Peer 0 accepts after 120ms */
+  now = ms(120);
+  res = sig_trans_match(t, peers[0], 100, sig_accept, cset, &now, &rtt);
+  printf("Accept from peer 0: %d, RTT %dus\n", res, rtt);
+  errors += res != 1 || rtt != 120000;
+  /* The same accept again, and a reply with the wrong type, are stale */
+  res = sig_trans_match(t, peers[0], 100, sig_accept, cset, &now, NULL);
+  errors += res != 0;
+  res = sig_trans_match(t, peers[1], 101, sig_deliver, cset, &now, NULL);
+  errors += res != 0;
+  errors += sig_trans_in_flight(t, 12) != N_PEERS - 1;
+
+  /* Nothing expires before the timeout */
+  now = ms(490);
+  res = sig_trans_expire(t, &now, expired, 8);
+  printf("%d transactions expired at 490ms\n", res);
+  errors += res != 0;
+
+  /* Peer 1 replies, the others expire (two at a time) */
+  res = sig_trans_match(t, peers[1], 101, sig_accept, NULL, &now, NULL);
+  errors += res != 1;
+  now = ms(520);
+  res = sig_trans_expire(t, &now, expired, 1);
+  res += sig_trans_expire(t, &now, expired + 1, 8);
+  printf("%d transactions expired at 520ms\n", res);
+  errors += res != N_PEERS - 2;
+  for (i = 0; i < res; i++) {
+    errors += expired[i].type != sig_offer;
+    errors += !nodeid_equal(expired[i].peer, peers[expired[i].trans_id - 100]);
+  }
+  res = sig_trans_match(t, peers[2], 102, sig_accept, cset, &now, NULL);
+  errors += res != 0;
+  errors += sig_trans_in_flight(t, 12) != 0;
+
+  /* A request expiring long after the wheel was checked */
+  sig_trans_open(t, peers[3], 7, sig_request, cset, &now);
+  now = ms(20000);
+  res = sig_trans_expire(t, &now, expired, 8);
+  errors += res != 1 || expired[0].trans_id != 7 || expired[0].type != sig_request;
+
+  sig_trans_peer_stats(t, peers[0], &stats);
+  printf("Peer 0: %u completed, %u timeouts, srtt %dus, %u chunks sent, %u replied\n",
+         stats.completed, stats.timeouts, stats.srtt, stats.chunks_sent, stats.chunks_replied);
+  errors += stats.completed != 1 || stats.timeouts != 0 || stats.srtt != 120000;
+  sig_trans_peer_stats(t, peers[3], &stats);
+  printf("Peer 3: %u completed, %u timeouts, %d outstanding\n",
+         stats.completed, stats.timeouts, stats.outstanding);
+  errors += stats.completed != 0 || stats.timeouts != 2 || stats.outstanding != 0;
+
+  sig_trans_forget(t, peers[3]);
+  errors += sig_trans_peer_stats(t, peers[3], &stats) != -1;
+
+  sig_trans_destroy(t);
+  chunkID_set_free(cset);
+  for (i = 0; i < N_PEERS; i++) {
+    nodeid_free(peers[i]);
+  }
+  printf("%d errors\n", errors);
+
+  return errors ? 1 : 0;
+}
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <float.h>
 
 #include "net_helper.h"
 #include "../Cache/blist_cache.h"
@@ -17,6 +18,7 @@
 #include "../Cache/proto.h"
 #include "grapes_msg_types.h"
 #include "grapes_config.h"
+#include "grapes_timer.h"
 #include "topman_iface.h"
 
 #define TMAN_INIT_PEERS 10 // max # of neighbors in local cache (should be >= than the next)
@@ -31,6 +33,7 @@ static  int max_gossiping_peers;
 static	int restart_countdown = TMAN_RESTART_COUNT;
 
 static uint64_t currtime;
+static struct grapes_timer *timer;	// armed at the next transmission
 static int cache_size;
 static struct peer_cache *local_cache;
 static int default_period;
@@ -44,6 +47,7 @@ static struct nodeID *restart_peer;
 static uint8_t *zero;
 
 static rankingFunction userRankFunct;
+static scoringFunction userScoreFunct;
 
 static int tmanRankFunct (const void *target, const void *p1, const void *p2) {
 
@@ -56,13 +60,19 @@ static int tmanRankFunct (const void *target, const void *p1, const void *p2) {
 	return userRankFunct(target, p1, p2);
 }
 
-static uint64_t gettime(void)
-{
-	struct timeval tv;
+// peers without metadata are ranked last, as in tmanRankFunct
+static double tmanScoreFunct (const void *target, const void *p) {
 
-	gettimeofday(&tv, NULL);
+	if (memcmp(target,zero,mymeta_size) == 0)
+		return 0;
+	if (memcmp(p,zero,mymeta_size) == 0)
+		return DBL_MAX;
+	return userScoreFunct(target, p);
+}
 
-	return tv.tv_usec + tv.tv_sec * 1000000ull;
+static struct peer_cache *tmanRank(const struct peer_cache *c, const struct nodeID *target, const void *target_meta)
+{
+	return blist_cache_rank_scored(c, userScoreFunct ? tmanScoreFunct : NULL, tmanRankFunct, target, target_meta);
 }
 
 static int tmanInit(struct nodeID *myID, void *metadata, int metadata_size, rankingFunction rfun, const char *config)
@@ -100,8 +110,15 @@ static int tmanInit(struct nodeID *myID, void *metadata, int metadata_size, rank
 	if (local_cache == NULL) {
 		return -1;
 	}
+	if (timer == NULL) {
+		timer = grapes_timer_new();
+		if (timer == NULL) {
+			return -1;
+		}
+	}
 	active = -1;
-	currtime = gettime();
+	currtime = grapes_timer_now();
+	grapes_timer_set(timer, currtime + period + 1);
 
 	return 0;
 }
@@ -131,14 +148,23 @@ static int tmanGetNeighbourhoodSize(void)
 	return i;
 }
 
+static void set_period(int p)
+{
+	period = p;
+	grapes_timer_set(timer, currtime + period + 1);
+}
+
 static int time_to_send(void)
 {
-	if (gettime() - currtime > period) {
+	int res = 0;
+
+	if (grapes_timer_now() - currtime > period) {
 		currtime += period;
-		return 1;
+		res = 1;
 	}
+	grapes_timer_set(timer, currtime + period + 1);
 
-	return 0;
+	return res;
 }
 
 static int tmanAddNeighbour(struct nodeID *neighbour, void *metadata, int metadata_size)
@@ -172,7 +198,7 @@ static int tmanChangeMetadata(void *metadata, int metadata_size)
 	mymeta = metadata;
 
 	if (active >= 0) {
-		new = blist_cache_rank(local_cache, tmanRankFunct, NULL, mymeta);
+		new = tmanRank(local_cache, NULL, mymeta);
 		if (new) {
 			blist_cache_free(local_cache);
 			local_cache = new;
@@ -209,7 +235,7 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 		}
 
 		if (h->type == TMAN_QUERY) {
-			new = blist_cache_rank(local_cache, tmanRankFunct, blist_nodeid(remote_cache, 0), blist_get_metadata(remote_cache, &msize));
+			new = tmanRank(local_cache, blist_nodeid(remote_cache, 0), blist_get_metadata(remote_cache, &msize));
 			if (new) {
 				blist_tman_reply(remote_cache, new, max_gossiping_peers);
 				blist_cache_free(new);
@@ -219,11 +245,11 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 		}
 
 		if (restart_peer && nodeid_equal(restart_peer, blist_nodeid(remote_cache,0))) { // restart phase : receiving new cache from chosen alive peer...
-			new = blist_cache_rank(remote_cache,tmanRankFunct,NULL,mymeta);
+			new = tmanRank(remote_cache, NULL,mymeta);
 			if (new) {
 				cache_size = init_cache_size;
 				blist_cache_resize(new,cache_size);
-				period = default_period;
+				set_period(default_period);
 				fprintf(stderr,"RESTARTING TMAN!!!\n");
 			}
 			nodeid_free(restart_peer);
@@ -233,7 +259,7 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 		else {	// normal phase
 			temp = blist_cache_union(local_cache,remote_cache,&s);
 			if (temp) {
-				new = blist_cache_rank(temp,tmanRankFunct,NULL,mymeta);
+				new = tmanRank(temp, NULL,mymeta);
 				cache_size = ((s/2)*2.5) > cache_size ? ((s/2)*2.5) : cache_size;
 				blist_cache_resize(new,cache_size);
 				blist_cache_free(temp);
@@ -264,7 +290,7 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 	if (active > 0 && tmanGetNeighbourhoodSize() < size && !restart_countdown) {
 		fprintf(stderr, "TMAN: Too few peers in cache! Triggering a restart...\n");
 		active = 0;
-		period = TMAN_INIT_PERIOD;
+		set_period(TMAN_INIT_PERIOD);
 	}
 
 	if (active <= 0) {	// active < 0 -> bootstrap phase ; active = 0 -> restart phase
@@ -280,7 +306,7 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 			restart_peer = nodeid_dup(blist_nodeid(ncache, 0));
 			restart_countdown = TMAN_RESTART_COUNT;
 			mdata = blist_get_metadata(ncache, &msize);
-			new = blist_cache_rank(active < 0 ? ncache : local_cache, tmanRankFunct, restart_peer, mdata);
+			new = tmanRank(active < 0 ? ncache : local_cache, restart_peer, mdata);
 			if (new) {
 				blist_tman_query_peer(new, restart_peer, max_gossiping_peers);
 				blist_cache_free(new);
@@ -303,7 +329,7 @@ static int tmanParseData(const uint8_t *buff, int len, struct nodeID **peers, in
 	}
 	else { // normal phase
 	chosen = blist_rand_peer(local_cache, (void **)&meta, max_preferred_peers);
-	new = blist_cache_rank(local_cache, tmanRankFunct, chosen, meta);
+	new = tmanRank(local_cache, chosen, meta);
 	if (new==NULL) {
 		fprintf(stderr, "TMAN: No cache could be sent to remote peer!\n");
 		return 1;
@@ -345,6 +371,14 @@ static int tmanRemoveNeighbour(struct nodeID *neighbour)
 }
 
 
+static int tmanSetScoringFunction(scoringFunction sfun)
+{
+	userScoreFunct = sfun;
+
+	return 0;
+}
+
+
 struct topman_iface tman = {
 	.init = tmanInit,
 	.changeMetadata = tmanChangeMetadata,
@@ -356,4 +390,5 @@ struct topman_iface tman = {
 	.shrinkNeighbourhood = tmanShrinkNeighbourhood,
 	.removeNeighbour = tmanRemoveNeighbour,
 	.getNeighbourhoodSize = tmanGetNeighbourhoodSize,
+	.setScoringFunction = tmanSetScoringFunction,
 };
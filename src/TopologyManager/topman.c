@@ -19,6 +19,16 @@ int tmanInit(struct nodeID *myID, void *metadata, int metadata_size, tmanRanking
 }
 
 
+int tmanSetScoringFunction(tmanScoringFunction sfun)
+{
+	if (tm->setScoringFunction == NULL) {
+		return -1;
+	}
+
+	return tm->setScoringFunction(sfun);
+}
+
+
 int tmanAddNeighbour(struct nodeID *neighbour, void *metadata, int metadata_size)
 {
 	return tm->addNeighbour(neighbour, metadata, metadata_size);
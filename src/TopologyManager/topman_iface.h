@@ -1,4 +1,5 @@
 typedef int (*rankingFunction)(const void *target, const void *p1, const void *p2);	// FIXME!
+typedef double (*scoringFunction)(const void *target, const void *p);
 
 struct topman_iface {
   int (*init)(struct nodeID *myID, void *metadata, int metadata_size, rankingFunction rfun, const char *config);
@@ -11,4 +12,5 @@ struct topman_iface {
   int (*shrinkNeighbourhood)(int n);
   int (*removeNeighbour)(struct nodeID *neighbour);
   int (*getNeighbourhoodSize)(void);
+  int (*setScoringFunction)(scoringFunction sfun);
 };
@@ -0,0 +1,215 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chunk_pool.h"
+
+#define POOL_MIN_SHIFT 10	/* 1KB */
+#define POOL_MAX_SHIFT 22	/* 4MB */
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define SLAB_SIZE 256 * 1024
+
+/*
+ * Blocks are carved from slabs (large allocations that are never
+ * released); the slabs are kept ordered by address, so that
+ * chunk_pool_free() can find out if a block belongs to the pool.
+ * Free blocks are kept in a list per size class, linked through the
+ * blocks themselves.
+ */
+struct pool_slab {
+  uint8_t *base;
+  size_t size;
+  int cls;
+};
+
+static struct pool_slab *slabs;
+static int n_slabs, max_slabs;
+static void *free_lists[POOL_CLASSES];
+static size_t pool_max;
+static struct chunk_pool_stats stats;
+static int pool_lock;
+
+static inline void lock(void)
+{
+  while (__sync_lock_test_and_set(&pool_lock, 1));
+}
+
+static inline void unlock(void)
+{
+  __sync_lock_release(&pool_lock);
+}
+
+static inline size_t block_size(int cls)
+{
+  return (size_t)1 << (cls + POOL_MIN_SHIFT);
+}
+
+static int size_class(size_t size)
+{
+  int cls;
+
+  for (cls = 0; cls < POOL_CLASSES && block_size(cls) < size; cls++);
+
+  return cls < POOL_CLASSES ? cls : -1;
+}
+
+static const struct pool_slab *slab_find(const void *p)
+{
+  int lo = 0, hi = n_slabs - 1;
+  const uint8_t *b = p;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+
+    if (b < slabs[mid].base) {
+      hi = mid - 1;
+    } else if (b >= slabs[mid].base + slabs[mid].size) {
+      lo = mid + 1;
+    } else {
+      return &slabs[mid];
+    }
+  }
+
+  return NULL;
+}
+
+static int slab_add(int cls)
+{
+  size_t bsize = block_size(cls);
+  size_t size = bsize > SLAB_SIZE ? bsize : SLAB_SIZE;
+  uint8_t *base, *b;
+  int i;
+
+  if (stats.footprint + size > pool_max) {
+    return -1;
+  }
+  if (n_slabs == max_slabs) {
+    struct pool_slab *s;
+
+    s = realloc(slabs, sizeof(struct pool_slab) * (max_slabs ? max_slabs * 2 : 16));
+    if (s == NULL) {
+      return -1;
+    }
+    slabs = s;
+    max_slabs = max_slabs ? max_slabs * 2 : 16;
+  }
+  base = malloc(size);
+  if (base == NULL) {
+    return -1;
+  }
+
+  for (i = n_slabs; i > 0 && slabs[i - 1].base > base; i--);
+  memmove(slabs + i + 1, slabs + i, sizeof(struct pool_slab) * (n_slabs - i));
+  slabs[i].base = base;
+  slabs[i].size = size;
+  slabs[i].cls = cls;
+  n_slabs++;
+  stats.footprint += size;
+
+  for (b = base; b + bsize <= base + size; b += bsize) {
+    *(void **)b = free_lists[cls];
+    free_lists[cls] = b;
+  }
+
+  return 0;
+}
+
+int chunk_pool_init(size_t size)
+{
+  lock();
+  pool_max = size;
+  unlock();
+
+  return 0;
+}
+
+void *chunk_pool_alloc(size_t size)
+{
+  void *p;
+  int cls;
+
+  lock();
+  stats.allocs++;
+  cls = pool_max ? size_class(size) : -1;
+  if (cls < 0) {
+    unlock();
+
+    return malloc(size);
+  }
+  if (free_lists[cls]) {
+    stats.hits++;
+  } else if (slab_add(cls) < 0) {
+    unlock();
+
+    return malloc(size);
+  }
+  p = free_lists[cls];
+  free_lists[cls] = *(void **)p;
+  stats.in_use += block_size(cls);
+  unlock();
+
+  return p;
+}
+
+void chunk_pool_free(void *p)
+{
+  const struct pool_slab *s;
+
+  if (p == NULL) {
+    return;
+  }
+  lock();
+  s = slab_find(p);
+  if (s == NULL) {
+    unlock();
+    free(p);
+
+    return;
+  }
+  *(void **)p = free_lists[s->cls];
+  free_lists[s->cls] = p;
+  stats.frees++;
+  stats.in_use -= block_size(s->cls);
+  unlock();
+}
+
+void *chunk_pool_realloc(void *p, size_t size)
+{
+  const struct pool_slab *s;
+  size_t bsize;
+  void *res;
+
+  if (p == NULL) {
+    return chunk_pool_alloc(size);
+  }
+  lock();
+  s = slab_find(p);
+  bsize = s ? block_size(s->cls) : 0;
+  unlock();
+  if (s == NULL) {
+    return realloc(p, size);
+  }
+  if (size <= bsize) {
+    return p;
+  }
+
+  res = chunk_pool_alloc(size);
+  if (res == NULL) {
+    return NULL;
+  }
+  memcpy(res, p, bsize);
+  chunk_pool_free(p);
+
+  return res;
+}
+
+void chunk_pool_get_stats(struct chunk_pool_stats *s)
+{
+  lock();
+  *s = stats;
+  unlock();
+}
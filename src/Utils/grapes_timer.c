@@ -0,0 +1,164 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ *
+ *  Protocol timers: the armed timers are kept in a timer wheel (WHEEL_SLOTS
+ *  slots of TICK us each); timers expiring more than WHEEL_SLOTS ticks in
+ *  the future stay in their slot until their tick comes. When the wheel is
+ *  advanced, the timers whose tick passed are moved to the expired list,
+ *  where they stay until they are set again.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "grapes_timer.h"
+
+#define WHEEL_SLOTS 1024
+#define TICK 10000
+
+struct grapes_timer {
+  struct grapes_timer *next, *prev;
+  struct grapes_timer **list;		/* NULL if not armed */
+  uint64_t deadline;
+  uint64_t expire;			/* in ticks */
+};
+
+static struct grapes_timer *wheel[WHEEL_SLOTS];
+static struct grapes_timer *expired;
+static uint64_t cur_tick;		/* first tick not checked yet */
+
+static uint64_t time_us(const struct timeval *now)
+{
+  struct timeval tv;
+
+  if (now == NULL) {
+    gettimeofday(&tv, NULL);
+    now = &tv;
+  }
+
+  return (uint64_t)now->tv_sec * 1000000 + now->tv_usec;
+}
+
+static void timer_link(struct grapes_timer **list, struct grapes_timer *t)
+{
+  t->list = list;
+  t->prev = NULL;
+  t->next = *list;
+  if (*list) {
+    (*list)->prev = t;
+  }
+  *list = t;
+}
+
+static void timer_unlink(struct grapes_timer *t)
+{
+  if (t->prev) {
+    t->prev->next = t->next;
+  } else {
+    *t->list = t->next;
+  }
+  if (t->next) {
+    t->next->prev = t->prev;
+  }
+  t->list = NULL;
+}
+
+/* Move the timers expiring up to the target tick to the expired list */
+static void wheel_advance(uint64_t target)
+{
+  for (; cur_tick <= target; cur_tick++) {
+    struct grapes_timer *t, *next;
+
+    /* After a long pause, every slot is checked only once */
+    if (cur_tick + WHEEL_SLOTS <= target) {
+      cur_tick = target - WHEEL_SLOTS + 1;
+    }
+    for (t = wheel[cur_tick % WHEEL_SLOTS]; t; t = next) {
+      next = t->next;
+      if (t->expire <= target) {
+        timer_unlink(t);
+        timer_link(&expired, t);
+      }
+    }
+  }
+}
+
+uint64_t grapes_timer_now(void)
+{
+  return time_us(NULL);
+}
+
+struct grapes_timer *grapes_timer_new(void)
+{
+  return calloc(1, sizeof(struct grapes_timer));
+}
+
+void grapes_timer_free(struct grapes_timer *t)
+{
+  if (t->list) {
+    timer_unlink(t);
+  }
+  free(t);
+}
+
+void grapes_timer_set(struct grapes_timer *t, uint64_t deadline)
+{
+  if (t->list) {
+    if (t->deadline == deadline) {
+      return;
+    }
+    timer_unlink(t);
+  }
+  t->deadline = deadline;
+  if (deadline == 0) {
+    return;
+  }
+  t->expire = deadline / TICK;
+  timer_link(t->expire < cur_tick ? &expired : &wheel[t->expire % WHEEL_SLOTS], t);
+}
+
+int grapes_timer_next(const struct timeval *now, struct timeval *tout)
+{
+  uint64_t t_now = time_us(now), first = 0, far = 0, diff;
+  const struct grapes_timer *t;
+  int i;
+
+  wheel_advance(t_now / TICK);
+  for (t = expired; t; t = t->next) {
+    if (first == 0 || t->deadline < first) {
+      first = t->deadline;
+    }
+  }
+
+  /*
+   * The timers in the wheel expire after the expired ones; the first
+   * slot containing a timer for the current round gives the earliest
+   * tick; if there is none, all the timers expire in later rounds.
+   */
+  for (i = 0; first == 0 && i < WHEEL_SLOTS; i++) {
+    uint64_t tick = cur_tick + i;
+
+    for (t = wheel[tick % WHEEL_SLOTS]; t; t = t->next) {
+      if (t->expire == tick) {
+        if (first == 0 || t->deadline < first) {
+          first = t->deadline;
+        }
+      } else if (far == 0 || t->deadline < far) {
+        far = t->deadline;
+      }
+    }
+  }
+  if (first == 0) {
+    first = far;
+  }
+  if (first == 0) {
+    return 0;
+  }
+
+  diff = first > t_now ? first - t_now : 0;
+  tout->tv_sec = diff / 1000000;
+  tout->tv_usec = diff % 1000000;
+
+  return 1;
+}
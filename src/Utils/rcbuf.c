@@ -0,0 +1,56 @@
+/*
+ *  This is free software; see lgpl-2.1.txt
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "rcbuf.h"
+#include "chunk_pool.h"
+
+struct rcbuf {
+  int refs;
+  int size;
+  uint8_t data[];
+};
+
+struct rcbuf *rcbuf_new(int size)
+{
+  struct rcbuf *b;
+
+  if (size < 0) {
+    return NULL;
+  }
+  b = chunk_pool_alloc(sizeof(struct rcbuf) + size);
+  if (b == NULL) {
+    return NULL;
+  }
+  b->refs = 1;
+  b->size = size;
+
+  return b;
+}
+
+uint8_t *rcbuf_data(struct rcbuf *b)
+{
+  return b->data;
+}
+
+int rcbuf_size(const struct rcbuf *b)
+{
+  return b->size;
+}
+
+struct rcbuf *rcbuf_ref(struct rcbuf *b)
+{
+  __sync_fetch_and_add(&b->refs, 1);
+
+  return b;
+}
+
+void rcbuf_unref(struct rcbuf *b)
+{
+  if (__sync_sub_and_fetch(&b->refs, 1) == 0) {
+    chunk_pool_free(b);
+  }
+}
@@ -14,6 +14,11 @@
 
 #include "net_helper.h"
 
+struct iovec {                    /* Scatter/gather array items */
+  void  *iov_base;              /* Starting address */
+  size_t iov_len;               /* Number of bytes to transfer */
+};
+
 struct nodeID {
   struct sockaddr_in addr;
   int fd;
@@ -66,6 +71,31 @@ int wait4data(const struct nodeID *s, struct timeval *tout, int *user_fds)
   return 2;
 }
 
+/* No epoll here: the nh_poll functions are not available */
+struct nh_poll *nh_poll_init(const struct nodeID *n, int mode)
+{
+  return NULL;
+}
+
+int nh_poll_add(struct nh_poll *p, int fd)
+{
+  return -1;
+}
+
+int nh_poll_del(struct nh_poll *p, int fd)
+{
+  return -1;
+}
+
+int nh_poll_wait(struct nh_poll *p, struct timeval *tout, int *node_ready, int *ready_fds, int *ready_len)
+{
+  return -1;
+}
+
+void nh_poll_destroy(struct nh_poll *p)
+{
+}
+
 struct nodeID *create_node(const char *IPaddr, int port)
 {
   struct nodeID *s;
@@ -142,6 +172,47 @@ int send_to_peer(const struct nodeID *from, struct nodeID *to, const uint8_t *bu
   return res;
 }
 
+/* No sendmsg() here: the buffers are copied in a single message */
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *iov, int iovcnt)
+{
+  uint8_t *buff;
+  int i, size, res;
+
+  if (iovcnt <= 0 || iovcnt > NH_IOV_MAX) return -1;
+  size = 0;
+  for (i = 0; i < iovcnt; i++) {
+    size += iov[i].iov_len;
+  }
+  if (size <= 0) return -1;
+
+  buff = malloc(size);
+  if (buff == NULL) return -1;
+  size = 0;
+  for (i = 0; i < iovcnt; i++) {
+    memcpy(buff + size, iov[i].iov_base, iov[i].iov_len);
+    size += iov[i].iov_len;
+  }
+  res = send_to_peer(from, (struct nodeID *)to, buff, size);
+  free(buff);
+
+  return res < 0 ? -1 : size;
+}
+
+/* No sendmmsg() here: queued messages are sent immediately */
+int send_to_peer_queued(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+  int res;
+
+  res = send_to_peer(from, (struct nodeID *)to, buffer_ptr, buffer_size);
+
+  return res < 0 ? -1 : buffer_size;
+}
+
+int send_queue_flush(const struct nodeID *from)
+{
+  return 0;
+}
+
 int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size)
 {
   int res, recv, len, addrlen;
@@ -172,6 +243,18 @@ int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *
   return recv;
 }
 
+/* No recvmmsg() here */
+int recv_from_peer_batch(const struct nodeID *local, struct nh_msg *msgs, int n)
+{
+  return -1;
+}
+
+/* Fragments are not reassembled out of order here: no statistics */
+int nh_frag_stats_get(const struct nodeID *remote, struct nh_frag_stats *stats)
+{
+  return -1;
+}
+
 int node_addr(const struct nodeID *s, char *addr, int len)
 {
   int n;
@@ -203,6 +286,22 @@ int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2)
   return memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_in));
 }
 
+uint32_t nodeid_hash(const struct nodeID *s)
+{
+  const uint8_t *a = (const uint8_t *)&s->addr.sin_addr;
+  const uint8_t *port = (const uint8_t *)&s->addr.sin_port;
+  uint32_t h = 2166136261u;	/* FNV-1a */
+  int i;
+
+  for (i = 0; i < sizeof(s->addr.sin_addr); i++) {
+    h = (h ^ a[i]) * 16777619u;
+  }
+  h = (h ^ port[0]) * 16777619u;
+  h = (h ^ port[1]) * 16777619u;
+
+  return h;
+}
+
 int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
 {
   if (max_write_size < sizeof(struct sockaddr_in)) return -1;
@@ -212,10 +311,50 @@ int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
   return sizeof(struct sockaddr_in);
 }
 
-struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+int nodeid_dump_compact(uint8_t *b, const struct nodeID *s, size_t max_write_size)
+{
+  if (max_write_size < 1 + sizeof(s->addr.sin_addr) + sizeof(s->addr.sin_port)) return -1;
+
+  b[0] = 0xC4;	/* compact format, version 1, IPv4 */
+  memcpy(b + 1, &s->addr.sin_addr, sizeof(s->addr.sin_addr));
+  memcpy(b + 1 + sizeof(s->addr.sin_addr), &s->addr.sin_port, sizeof(s->addr.sin_port));
+
+  return 1 + sizeof(s->addr.sin_addr) + sizeof(s->addr.sin_port);
+}
+
+int nodeid_is_compact(const uint8_t *b)
+{
+  return (b[0] & 0xFC) == 0xC4;
+}
+
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len)
 {
   struct nodeID *res;
-  res = malloc(sizeof(struct nodeID));
+
+  if (nodeid_is_compact(b)) {
+    /* Only IPv4 addresses can be represented here */
+    if ((b[0] & 0x03) != 0x00) {
+      fprintf(stderr, "Net-helper: unsupported compact nodeID type %d\n", b[0] & 0x03);
+      *len = 0;
+
+      return NULL;
+    }
+    res = s ? s : malloc(sizeof(struct nodeID));
+    if (res == NULL) {
+      *len = 0;
+
+      return NULL;
+    }
+    memset(&res->addr, 0, sizeof(struct sockaddr_in));
+    res->addr.sin_family = AF_INET;
+    memcpy(&res->addr.sin_addr, b + 1, sizeof(res->addr.sin_addr));
+    memcpy(&res->addr.sin_port, b + 1 + sizeof(res->addr.sin_addr), sizeof(res->addr.sin_port));
+    res->fd = -1;
+    *len = 1 + sizeof(res->addr.sin_addr) + sizeof(res->addr.sin_port);
+
+    return res;
+  }
+  res = s ? s : malloc(sizeof(struct nodeID));
   if (res != NULL) {
     memcpy(&res->addr, b, sizeof(struct sockaddr_in));
     res->fd = -1;
@@ -225,6 +364,11 @@ struct nodeID *nodeid_undump(const uint8_t *b, int *len)
   return res;
 }
 
+struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+{
+  return nodeid_undump_reuse(NULL, b, len);
+}
+
 void nodeid_free(struct nodeID *s)
 {
   free(s);
@@ -6,6 +6,10 @@
  *  This is free software; see lgpl-2.1.txt
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* for sendmmsg() and recvmmsg() */
+#endif
+
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
@@ -24,9 +28,24 @@
 #include "win32-net.h"
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 #include "net_helper.h"
+#include "grapes_config.h"
 
 #define MAX_MSG_SIZE 1024 * 60
+#define BATCH_MAX 64
+#define BATCH_ARENA_SIZE 256 * 1024
+#define REASM_TIMEOUT 2000		/* ms */
+#define REASM_MEM_MAX 32 * 1024 * 1024
+#define REASM_INFLIGHT 8
+#define FRAG_PEERS_HASH 256
+#define FRAG_PEERS_MAX 4096
+#define FRAG_PEERS_IDLE 10		/* reasm timeouts */
+#define FRAG_DONE 8
+#define FRAGS(size) (((size) + MAX_MSG_SIZE - 1) / (MAX_MSG_SIZE))
 enum L3PROTOCOL {IPv4, IPv6} l3 = IPv4;
 
 struct nodeID {
@@ -34,6 +53,10 @@ struct nodeID {
   int fd;
 };
 
+static int reasm_timeout = REASM_TIMEOUT;
+static int reasm_mem_max = REASM_MEM_MAX;
+static int reasm_inflight = REASM_INFLIGHT;
+
 #ifdef _WIN32
 static int inet_aton(const char *cp, struct in_addr *addr)
 {
@@ -147,6 +170,341 @@ ssize_t sendmsg (int sd, struct msghdr * msg, int flags)
 
 #endif
 
+#ifndef __linux__
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0x10000
+#endif
+
+static int sendmmsg(int sd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  int i, res;
+
+  for (i = 0; i < vlen; i++) {
+    res = sendmsg(sd, &msgvec[i].msg_hdr, flags);
+    if (res < 0) {
+      return i ? i : -1;
+    }
+    msgvec[i].msg_len = res;
+  }
+
+  return i;
+}
+
+static int recvmmsg(int sd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+{
+  int i, res;
+
+  /* Only the first message is waited for, as with MSG_WAITFORONE */
+  res = recvmsg(sd, &msgvec[0].msg_hdr, 0);
+  if (res < 0) {
+    return -1;
+  }
+  msgvec[0].msg_len = res;
+  for (i = 1; i < vlen; i++) {
+    struct timeval tout = {0, 0};
+    fd_set fds;
+
+    FD_ZERO(&fds);
+    FD_SET(sd, &fds);
+    if (select(sd + 1, &fds, NULL, NULL, &tout) <= 0) {
+      break;
+    }
+    res = recvmsg(sd, &msgvec[i].msg_hdr, 0);
+    if (res < 0) {
+      break;
+    }
+    msgvec[i].msg_len = res;
+  }
+
+  return i;
+}
+#endif
+
+struct nh_poll {
+  int node_fd;
+  int mode;
+  int n_fds;		/* registered fds, including node_fd */
+#ifdef __linux__
+  int epfd;
+  struct epoll_event *events;
+  int events_size;
+#else
+  int *fds;
+  int fds_size;
+#endif
+};
+
+struct nh_poll *nh_poll_init(const struct nodeID *n, int mode)
+{
+  struct nh_poll *p;
+
+  p = malloc(sizeof(struct nh_poll));
+  if (p == NULL) {
+    return NULL;
+  }
+  memset(p, 0, sizeof(struct nh_poll));
+  p->node_fd = -1;
+  p->mode = mode;
+#ifdef __linux__
+  p->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (p->epfd < 0) {
+    free(p);
+
+    return NULL;
+  }
+#endif
+  if (n && nh_poll_add(p, n->fd) < 0) {
+    nh_poll_destroy(p);
+
+    return NULL;
+  }
+  p->node_fd = n ? n->fd : -1;
+
+  return p;
+}
+
+int nh_poll_add(struct nh_poll *p, int fd)
+{
+#ifdef __linux__
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | (p->mode == NH_POLL_EDGE ? EPOLLET : 0);
+  ev.data.fd = fd;
+  if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return errno == EEXIST ? 0 : -1;
+  }
+#else
+  int i;
+
+  for (i = 0; i < p->n_fds; i++) {
+    if (p->fds[i] == fd) {
+      return 0;
+    }
+  }
+  if (fd >= FD_SETSIZE) {
+    return -1;
+  }
+  if (p->n_fds == p->fds_size) {
+    int *res;
+
+    res = realloc(p->fds, (p->fds_size + 16) * sizeof(int));
+    if (res == NULL) {
+      return -1;
+    }
+    p->fds = res;
+    p->fds_size += 16;
+  }
+  p->fds[p->n_fds] = fd;
+#endif
+  p->n_fds++;
+
+  return 1;
+}
+
+int nh_poll_del(struct nh_poll *p, int fd)
+{
+#ifdef __linux__
+  if (epoll_ctl(p->epfd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+    return errno == ENOENT ? 0 : -1;
+  }
+#else
+  int i;
+
+  for (i = 0; i < p->n_fds; i++) {
+    if (p->fds[i] == fd) {
+      break;
+    }
+  }
+  if (i == p->n_fds) {
+    return 0;
+  }
+  p->fds[i] = p->fds[p->n_fds - 1];
+#endif
+  p->n_fds--;
+  if (fd == p->node_fd) {
+    p->node_fd = -1;
+  }
+
+  return 1;
+}
+
+int nh_poll_wait(struct nh_poll *p, struct timeval *tout, int *node_ready, int *ready_fds, int *ready_len)
+{
+  struct timeval start, now;
+  int i, res, n;
+#ifdef __linux__
+  int ms;
+#else
+  fd_set fds;
+  int max_fd;
+#endif
+
+  *node_ready = 0;
+  if (tout) {
+    gettimeofday(&start, NULL);
+  }
+#ifdef __linux__
+  if (p->events_size < p->n_fds) {
+    struct epoll_event *ev;
+
+    ev = realloc(p->events, p->n_fds * sizeof(struct epoll_event));
+    if (ev == NULL) {
+      return -1;
+    }
+    p->events = ev;
+    p->events_size = p->n_fds;
+  }
+  /* Round up, to avoid busy looping on sub-millisecond timeouts */
+  ms = tout ? tout->tv_sec * 1000 + (tout->tv_usec + 999) / 1000 : -1;
+  res = epoll_wait(p->epfd, p->events, p->events_size ? p->events_size : 1, ms);
+#else
+  FD_ZERO(&fds);
+  max_fd = -1;
+  for (i = 0; i < p->n_fds; i++) {
+    FD_SET(p->fds[i], &fds);
+    if (p->fds[i] > max_fd) {
+      max_fd = p->fds[i];
+    }
+  }
+  res = select(max_fd + 1, &fds, NULL, NULL, tout);
+#endif
+  if (tout) {
+    /* Report the remaining time, as select() does on Linux */
+    gettimeofday(&now, NULL);
+    now.tv_sec -= start.tv_sec;
+    now.tv_usec -= start.tv_usec;
+    if (now.tv_usec < 0) {
+      now.tv_sec--;
+      now.tv_usec += 1000000;
+    }
+    tout->tv_sec -= now.tv_sec;
+    tout->tv_usec -= now.tv_usec;
+    if (tout->tv_usec < 0) {
+      tout->tv_sec--;
+      tout->tv_usec += 1000000;
+    }
+    if (tout->tv_sec < 0) {
+      tout->tv_sec = 0;
+      tout->tv_usec = 0;
+    }
+  }
+  if (res <= 0) {
+    *ready_len = 0;
+
+    return res;
+  }
+
+  n = 0;
+#ifdef __linux__
+  for (i = 0; i < res; i++) {
+    int fd = p->events[i].data.fd;
+#else
+  for (i = 0; i < p->n_fds; i++) {
+    int fd = p->fds[i];
+
+    if (!FD_ISSET(fd, &fds)) continue;
+#endif
+    if (fd == p->node_fd) {
+      *node_ready = 1;
+    } else if (n < *ready_len) {
+      ready_fds[n++] = fd;
+    }
+  }
+  *ready_len = n;
+
+  return *node_ready + n;
+}
+
+void nh_poll_destroy(struct nh_poll *p)
+{
+#ifdef __linux__
+  close(p->epfd);
+  free(p->events);
+#else
+  free(p->fds);
+#endif
+  free(p);
+}
+
+/*
+ * State of the poll object used by wait4data(): w4d_fds is the list of user
+ * fds as passed by the caller (before the non-ready ones are marked with
+ * -2), and the poll object is rebuilt only when this list changes.
+ */
+static struct nh_poll *w4d_poll;
+static int *w4d_fds;
+static int w4d_n_fds;
+static int w4d_busy;
+
+static int wait4data_register(const struct nodeID *s, const int *user_fds, int n)
+{
+  int i, res, changed;
+
+  if (w4d_poll && w4d_poll->node_fd != (s ? s->fd : -1)) {
+    nh_poll_destroy(w4d_poll);
+    w4d_poll = NULL;
+  }
+  if (w4d_poll == NULL) {
+    w4d_poll = nh_poll_init(s, NH_POLL_LEVEL);
+    if (w4d_poll == NULL) {
+      return -1;
+    }
+    w4d_n_fds = 0;
+  }
+
+  changed = n != w4d_n_fds;
+  for (i = 0; !changed && i < n; i++) {
+    changed = user_fds[i] != w4d_fds[i];
+  }
+  if (!changed) {
+    /*
+     * epoll forgets the fds when they are closed: add them again (this
+     * does nothing for the ones still registered), so that an fd closed
+     * and reopened with the same number is monitored, as with select()
+     */
+    for (i = 0; i < n; i++) {
+      if (user_fds[i] >= 0) {
+        res = nh_poll_add(w4d_poll, user_fds[i]);
+        if (res < 0) {
+          return -1;
+        }
+        w4d_poll->n_fds -= res;		/* It was already counted */
+      }
+    }
+
+    return 0;
+  }
+
+  for (i = 0; i < w4d_n_fds; i++) {
+    if (w4d_fds[i] >= 0) {
+      nh_poll_del(w4d_poll, w4d_fds[i]);
+    }
+  }
+#ifdef __linux__
+  /* The closed fds are not found by nh_poll_del() */
+  w4d_poll->n_fds = w4d_poll->node_fd >= 0;
+#endif
+  w4d_n_fds = 0;
+  w4d_fds = realloc(w4d_fds, (n ? n : 1) * sizeof(int));
+  if (w4d_fds == NULL) {
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    if (user_fds[i] >= 0 && nh_poll_add(w4d_poll, user_fds[i]) < 0) {
+      return -1;
+    }
+    w4d_fds[w4d_n_fds++] = user_fds[i];
+  }
+
+  return 1;
+}
+
 int wait4data(const struct nodeID *s, struct timeval *tout, int *user_fds)
 /* returns 0 if timeout expires 
  * returns -1 in case of error of the select function
@@ -155,37 +513,68 @@ int wait4data(const struct nodeID *s, struct timeval *tout, int *user_fds)
  * returns 2 if some of the user_fds file descriptors is ready
  */
 {
-  fd_set fds;
-  int i, res, max_fd;
+  struct nh_poll *p;
+  int i, j, res, node_ready, ready_len;
+  int n_user = 0;
 
-  FD_ZERO(&fds);
-  if (s) {
-    max_fd = s->fd;
-    FD_SET(s->fd, &fds);
-  } else {
-    max_fd = -1;
-  }
   if (user_fds) {
-    for (i = 0; user_fds[i] != -1; i++) {
-      FD_SET(user_fds[i], &fds);
-      if (user_fds[i] > max_fd) {
-        max_fd = user_fds[i];
+    for (n_user = 0; user_fds[n_user] != -1; n_user++);
+  }
+  {
+    int fds[n_user + 1];
+    int ready[n_user + 1];
+
+    /* The cached poll object cannot be shared by concurrent callers */
+    if (__sync_lock_test_and_set(&w4d_busy, 1) == 0) {
+      /*
+       * The fds marked with -2 by the previous call are replaced by the
+       * ones the caller passed in the same positions, so that they are
+       * still monitored and the registered set does not change
+       */
+      for (i = 0; i < n_user; i++) {
+        fds[i] = user_fds[i] == -2 && i < w4d_n_fds ? w4d_fds[i] : user_fds[i];
+      }
+      if (wait4data_register(s, fds, n_user) < 0) {
+        __sync_lock_release(&w4d_busy);
+
+        return -1;
+      }
+      p = w4d_poll;
+    } else {
+      /* The original fds are not known here: the ones marked with -2 are skipped */
+      p = nh_poll_init(s, NH_POLL_LEVEL);
+      if (p == NULL) {
+        return -1;
+      }
+      for (i = 0; i < n_user; i++) {
+        fds[i] = user_fds[i];
+        if (fds[i] >= 0 && nh_poll_add(p, fds[i]) < 0) {
+          nh_poll_destroy(p);
+
+          return -1;
+        }
       }
     }
-  }
-  res = select(max_fd + 1, &fds, NULL, NULL, tout);
-  if (res <= 0) {
-    return res;
-  }
-  if (s && FD_ISSET(s->fd, &fds)) {
-    return 1;
-  }
 
-  /* If execution arrives here, user_fds cannot be 0
-     (an FD is ready, and it's not s->fd) */
-  for (i = 0; user_fds[i] != -1; i++) {
-    if (!FD_ISSET(user_fds[i], &fds)) {
-      user_fds[i] = -2;
+    ready_len = n_user + 1;
+    res = nh_poll_wait(p, tout, &node_ready, ready, &ready_len);
+    if (p == w4d_poll) {
+      __sync_lock_release(&w4d_busy);
+    } else {
+      nh_poll_destroy(p);
+    }
+    if (res <= 0) {
+      return res;
+    }
+    if (node_ready) {
+      return 1;
+    }
+
+    /* If execution arrives here, user_fds cannot be 0
+       (an FD is ready, and it's not s->fd) */
+    for (i = 0; i < n_user; i++) {
+      for (j = 0; j < ready_len && ready[j] != fds[i]; j++);
+      user_fds[i] = j < ready_len ? fds[i] : -2;
     }
   }
 
@@ -245,6 +634,16 @@ struct nodeID *net_helper_init(const char *my_addr, int port, const char *config
   int res;
   struct nodeID *myself;
 
+  if (config) {
+    struct tag *cfg_tags;
+
+    cfg_tags = grapes_config_parse(config);
+    grapes_config_value_int_default(cfg_tags, "reasm_timeout", &reasm_timeout, REASM_TIMEOUT);
+    grapes_config_value_int_default(cfg_tags, "reasm_mem", &reasm_mem_max, REASM_MEM_MAX);
+    grapes_config_value_int_default(cfg_tags, "reasm_inflight", &reasm_inflight, REASM_INFLIGHT);
+    free(cfg_tags);
+  }
+
   myself = create_node(my_addr, port);
   if (myself == NULL) {
     fprintf(stderr, "Error creating my socket (%s:%d)!\n", my_addr, port);
@@ -299,97 +698,722 @@ struct my_hdr_t {
   uint8_t frags;
 } __attribute__((packed));
 
-int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+static uint8_t send_m_seq;	/* shared by send_to_peer() and send_to_peer_queued() */
+
+struct send_queue {
+  int fd;
+  int n_msgs;
+  struct mmsghdr msgs[BATCH_MAX];
+  struct iovec iov[BATCH_MAX][2];
+  struct my_hdr_t hdr[BATCH_MAX];
+  struct sockaddr_storage to[BATCH_MAX];
+  uint8_t *arena;
+  int arena_used;
+};
+
+static struct send_queue *sq;
+
+int send_to_peer_iov(const struct nodeID *from, const struct nodeID *to, const struct iovec *iov, int iovcnt)
 {
   struct msghdr msg = {0};
-  static struct my_hdr_t my_hdr;
-  struct iovec iov[2];
-  int res;
-
-  if (buffer_size <= 0) return -1;
+  struct my_hdr_t my_hdr;
+  struct sockaddr_storage to_addr;	/* msg_name is not const */
+  struct iovec frag_iov[NH_IOV_MAX + 1];
+  int i, size, res, sent;
+  size_t off;
+
+  if (iovcnt <= 0 || iovcnt > NH_IOV_MAX) return -1;
+  size = 0;
+  for (i = 0; i < iovcnt; i++) {
+    size += iov[i].iov_len;
+  }
+  if (size <= 0) return -1;
 
-  iov[0].iov_base = &my_hdr;
-  iov[0].iov_len = sizeof(struct my_hdr_t);
-  msg.msg_name = &to->addr;
+  frag_iov[0].iov_base = &my_hdr;
+  frag_iov[0].iov_len = sizeof(struct my_hdr_t);
+  memcpy(&to_addr, &to->addr, sizeof(struct sockaddr_storage));
+  msg.msg_name = &to_addr;
   msg.msg_namelen = sizeof(struct sockaddr_storage);
-  msg.msg_iovlen = 2;
-  msg.msg_iov = iov;
+  msg.msg_iov = frag_iov;
 
-  my_hdr.m_seq++;
-  my_hdr.frags = (buffer_size / (MAX_MSG_SIZE)) + 1;
+  my_hdr.m_seq = ++send_m_seq;
+  my_hdr.frags = FRAGS(size);
   my_hdr.frag_seq = 0;
 
+  /* Each fragment takes up to MAX_MSG_SIZE bytes from the buffers,
+   * starting at offset off of iov[i]
+   */
+  sent = 0;
+  i = 0;
+  off = 0;
   do {
-    iov[1].iov_base = buffer_ptr;
-    if (buffer_size > MAX_MSG_SIZE) {
-      iov[1].iov_len = MAX_MSG_SIZE;
-    } else {
-      iov[1].iov_len = buffer_size;
+    int n = 1, frag_size = 0;
+
+    while (i < iovcnt && frag_size < MAX_MSG_SIZE) {
+      size_t len = iov[i].iov_len - off;
+
+      if (len > MAX_MSG_SIZE - frag_size) {
+        len = MAX_MSG_SIZE - frag_size;
+      }
+      if (len) {
+        frag_iov[n].iov_base = (uint8_t *)iov[i].iov_base + off;
+        frag_iov[n++].iov_len = len;
+        frag_size += len;
+      }
+      off += len;
+      if (off == iov[i].iov_len) {
+        i++;
+        off = 0;
+      }
     }
+    msg.msg_iovlen = n;
     my_hdr.frag_seq++;
 
-    buffer_size -= iov[1].iov_len;
-    buffer_ptr += iov[1].iov_len;
     res = sendmsg(from->fd, &msg, 0);
-
-    if (res  < 0){
+    if (res < 0){
       int error = errno;
       fprintf(stderr,"net-helper: sendmsg failed errno %d: %s\n", error, strerror(error));
+
+      return -1;
+    }
+    sent += frag_size;
+  } while (sent < size);
+
+  return sent;
+}
+
+int send_to_peer(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+  struct iovec iov;
+
+  if (buffer_size <= 0) return -1;
+
+  /* iov_base is not const, but sendmsg() does not modify the data */
+  iov.iov_base = (void *)(uintptr_t)buffer_ptr;
+  iov.iov_len = buffer_size;
+
+  return send_to_peer_iov(from, to, &iov, 1);
+}
+
+/*
+ * Reassembly of fragmented messages.
+ *
+ * Fragments are stored in a reassembly slot identified by the sender and
+ * by the m_seq of the message, so fragments of different messages can be
+ * interleaved. Slots are kept in a list ordered by deadline: incomplete
+ * messages are dropped when they time out, when the memory limit is
+ * reached (the sender's own messages first), or when a peer has too many
+ * messages in flight. The memory of a slot is allocated one fragment at
+ * a time, so only the received data is accounted.
+ *
+ * The m_seq of the last messages completed by each peer is remembered for
+ * a timeout, so that late duplicated fragments are not taken for a new
+ * message. Peers are forgotten after being idle for FRAG_PEERS_IDLE
+ * timeouts, or as soon as possible when there are too many.
+ */
+struct frag_done {
+  uint8_t m_seq;
+  uint8_t frags;
+  struct timeval deadline;
+};
+
+struct frag_peer {
+  struct nodeID id;
+  struct nh_frag_stats stats;
+  struct timeval last;			/* last datagram received */
+  struct frag_done done[FRAG_DONE];	/* recently completed messages */
+  int done_next;
+  struct frag_peer *next;
+};
+
+struct reasm_slot {
+  struct frag_peer *peer;
+  uint8_t m_seq;
+  uint8_t frags;
+  uint8_t received;
+  int len;
+  uint8_t **frag;		/* received fragments, NULL if missing */
+  int mem;
+  struct timeval deadline;
+  struct reasm_slot *prev, *next;
+};
+
+static struct frag_peer *frag_peers[FRAG_PEERS_HASH];
+static int frag_peers_cnt;
+static struct timeval frag_peers_sweep;
+static struct reasm_slot *reasm_head, *reasm_tail;
+static int reasm_mem;
+
+/* Forget the peers with no pending messages, idle since before limit (all if NULL) */
+static void frag_peers_forget(const struct timeval *limit)
+{
+  int i;
+
+  for (i = 0; i < FRAG_PEERS_HASH; i++) {
+    struct frag_peer **pp = &frag_peers[i];
+
+    while (*pp) {
+      struct frag_peer *p = *pp;
+
+      if (p->stats.pending == 0 && (limit == NULL || timercmp(&p->last, limit, <))) {
+        *pp = p->next;
+        free(p);
+        frag_peers_cnt--;
+      } else {
+        pp = &p->next;
+      }
     }
-  } while (buffer_size > 0);
+  }
+}
+
+static struct frag_peer *frag_peer_get(const struct sockaddr_storage *addr, socklen_t len, int create)
+{
+  struct frag_peer *p;
+  struct nodeID id;
+  uint32_t h;
+
+  memset(&id, 0, sizeof(struct nodeID));
+  memcpy(&id.addr, addr, len);
+  id.fd = -1;
+  h = nodeid_hash(&id) % FRAG_PEERS_HASH;
+  for (p = frag_peers[h]; p; p = p->next) {
+    if (nodeid_equal(&p->id, &id)) {
+      return p;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+
+  if (frag_peers_cnt >= FRAG_PEERS_MAX) {
+    frag_peers_forget(NULL);
+  }
+  p = malloc(sizeof(struct frag_peer));
+  if (p == NULL) {
+    return NULL;
+  }
+  memset(p, 0, sizeof(struct frag_peer));
+  p->id = id;
+  p->next = frag_peers[h];
+  frag_peers[h] = p;
+  frag_peers_cnt++;
+
+  return p;
+}
+
+static void reasm_drop(struct reasm_slot *s, int lost)
+{
+  int i;
+
+  if (s->prev) {
+    s->prev->next = s->next;
+  } else {
+    reasm_head = s->next;
+  }
+  if (s->next) {
+    s->next->prev = s->prev;
+  } else {
+    reasm_tail = s->prev;
+  }
+  reasm_mem -= s->mem;
+  s->peer->stats.pending--;
+  if (lost) {
+    s->peer->stats.lost++;
+  }
+  for (i = 0; i < s->frags; i++) {
+    free(s->frag[i]);
+  }
+  free(s->frag);
+  free(s);
+}
+
+static void reasm_expire(const struct timeval *now)
+{
+  while (reasm_head && timercmp(&reasm_head->deadline, now, <)) {
+    reasm_drop(reasm_head, 1);
+  }
+  if (timercmp(&frag_peers_sweep, now, <)) {
+    struct timeval idle, limit;
+
+    idle.tv_sec = reasm_timeout * FRAG_PEERS_IDLE / 1000;
+    idle.tv_usec = (reasm_timeout * FRAG_PEERS_IDLE % 1000) * 1000;
+    timersub(now, &idle, &limit);
+    frag_peers_forget(&limit);
+    idle.tv_sec = reasm_timeout / 1000;
+    idle.tv_usec = (reasm_timeout % 1000) * 1000;
+    timeradd(now, &idle, &frag_peers_sweep);
+  }
+}
+
+/* Free memory for size more bytes, dropping the messages of p first (but not keep) */
+static void reasm_make_room(struct frag_peer *p, const struct reasm_slot *keep, int size)
+{
+  struct reasm_slot *s, *next;
+
+  for (s = reasm_head; s && reasm_mem + size > reasm_mem_max; s = next) {
+    next = s->next;
+    if (s->peer == p && s != keep) {
+      reasm_drop(s, 1);
+    }
+  }
+  for (s = reasm_head; s && reasm_mem + size > reasm_mem_max; s = next) {
+    next = s->next;
+    if (s != keep) {
+      reasm_drop(s, 1);
+    }
+  }
+}
+
+static struct reasm_slot *reasm_new(struct frag_peer *p, const struct my_hdr_t *h, const struct timeval *now)
+{
+  struct reasm_slot *s;
+  struct timeval tout;
+
+  if (h->frags * MAX_MSG_SIZE > reasm_mem_max) {
+    return NULL;
+  }
+  if (p->stats.pending && p->stats.pending >= reasm_inflight) {
+    for (s = reasm_head; s->peer != p; s = s->next);
+    reasm_drop(s, 1);
+  }
+
+  s = malloc(sizeof(struct reasm_slot));
+  if (s == NULL) {
+    return NULL;
+  }
+  s->frag = calloc(h->frags, sizeof(uint8_t *));
+  if (s->frag == NULL) {
+    free(s);
+
+    return NULL;
+  }
+  s->mem = 0;
+  s->peer = p;
+  s->m_seq = h->m_seq;
+  s->frags = h->frags;
+  s->received = 0;
+  s->len = 0;
+  tout.tv_sec = reasm_timeout / 1000;
+  tout.tv_usec = (reasm_timeout % 1000) * 1000;
+  timeradd(now, &tout, &s->deadline);
+
+  s->next = NULL;
+  s->prev = reasm_tail;
+  if (reasm_tail) {
+    reasm_tail->next = s;
+  } else {
+    reasm_head = s;
+  }
+  reasm_tail = s;
+  p->stats.pending++;
+
+  return s;
+}
+
+static int reasm_done(const struct frag_peer *p, const struct my_hdr_t *h, const struct timeval *now)
+{
+  int i;
+
+  for (i = 0; i < FRAG_DONE; i++) {
+    const struct frag_done *d = &p->done[i];
+
+    if (d->m_seq == h->m_seq && d->frags == h->frags && timercmp(now, &d->deadline, <)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Copy a completed message in buff; returns the number of bytes copied */
+static int reasm_copy(const struct reasm_slot *s, uint8_t *buff, int size)
+{
+  int i, len, res = 0;
+
+  for (i = 0; i < s->frags && res < size; i++) {
+    len = i == s->frags - 1 ? s->len - i * MAX_MSG_SIZE : MAX_MSG_SIZE;
+    if (len > size - res) {
+      len = size - res;
+    }
+    memcpy(buff + res, s->frag[i], len);
+    res += len;
+  }
 
   return res;
 }
 
+/*
+ * Store a fragment; returns the reassembly slot if the message is complete
+ * (the caller has to copy it with reasm_copy(), and drop it), NULL otherwise.
+ */
+static struct reasm_slot *reasm_add(struct frag_peer *p, const struct my_hdr_t *h, const uint8_t *data, int len, const struct timeval *now)
+{
+  struct reasm_slot *s;
+  struct frag_done *d;
+  struct timeval tout;
+  int i = h->frag_seq - 1;
+
+  if (h->frag_seq == 0 || h->frag_seq > h->frags || len > MAX_MSG_SIZE ||
+      (h->frag_seq < h->frags && len != MAX_MSG_SIZE)) {
+    return NULL;
+  }
+
+  for (s = reasm_head; s; s = s->next) {
+    if (s->peer == p && s->m_seq == h->m_seq) {
+      break;
+    }
+  }
+  if (s && s->frags != h->frags) {
+    /* m_seq wrapped around: the old message is not going to be completed */
+    reasm_drop(s, 1);
+    s = NULL;
+  }
+  if (s == NULL) {
+    if (reasm_done(p, h, now)) {
+      p->stats.dup_frags++;
+
+      return NULL;
+    }
+    s = reasm_new(p, h, now);
+    if (s == NULL) {
+      p->stats.lost++;
+
+      return NULL;
+    }
+  }
+  if (s->frag[i]) {
+    p->stats.dup_frags++;
+
+    return NULL;
+  }
+
+  reasm_make_room(p, s, len);
+  s->frag[i] = malloc(len ? len : 1);
+  if (s->frag[i] == NULL) {
+    reasm_drop(s, 1);
+
+    return NULL;
+  }
+  memcpy(s->frag[i], data, len);
+  s->mem += len;
+  reasm_mem += len;
+  s->received++;
+  if (h->frag_seq == h->frags) {
+    s->len = i * MAX_MSG_SIZE + len;
+  }
+  if (s->received < s->frags) {
+    return NULL;
+  }
+
+  d = &p->done[p->done_next];
+  p->done_next = (p->done_next + 1) % FRAG_DONE;
+  d->m_seq = s->m_seq;
+  d->frags = s->frags;
+  tout.tv_sec = reasm_timeout / 1000;
+  tout.tv_usec = (reasm_timeout % 1000) * 1000;
+  timeradd(now, &tout, &d->deadline);
+
+  return s;
+}
+
+int nh_frag_stats_get(const struct nodeID *remote, struct nh_frag_stats *stats)
+{
+  struct frag_peer *p;
+
+  p = frag_peer_get(&remote->addr, sizeof(struct sockaddr_storage), 0);
+  if (p == NULL) {
+    return -1;
+  }
+  *stats = p->stats;
+
+  return 0;
+}
+
 int recv_from_peer(const struct nodeID *local, struct nodeID **remote, uint8_t *buffer_ptr, int buffer_size)
 {
-  int res, recv, m_seq, frag_seq;
+  static uint8_t *scratch;
+  int res;
   struct sockaddr_storage raddr;
   struct msghdr msg = {0};
-  static struct my_hdr_t my_hdr;
+  struct my_hdr_t my_hdr;
   struct iovec iov[2];
-
+  struct frag_peer *peer;
+  struct reasm_slot *s;
+  struct timeval now;
+  uint8_t *data;
+
+  /* Fragments are always received in full */
+  data = buffer_ptr;
+  if (buffer_size < MAX_MSG_SIZE) {
+    if (scratch == NULL) {
+      scratch = malloc(MAX_MSG_SIZE);
+      if (scratch == NULL) {
+        return -1;
+      }
+    }
+    data = scratch;
+  }
   iov[0].iov_base = &my_hdr;
   iov[0].iov_len = sizeof(struct my_hdr_t);
+  iov[1].iov_base = data;
+  iov[1].iov_len = MAX_MSG_SIZE;
   msg.msg_name = &raddr;
-  msg.msg_namelen = sizeof(struct sockaddr_storage);
   msg.msg_iovlen = 2;
   msg.msg_iov = iov;
 
+  do {
+    msg.msg_namelen = sizeof(struct sockaddr_storage);
+    res = recvmsg(local->fd, &msg, 0);
+    if (res < (int)sizeof(struct my_hdr_t)) {
+      return -1;
+    }
+    res -= sizeof(struct my_hdr_t);
+    gettimeofday(&now, NULL);
+    reasm_expire(&now);
+    peer = frag_peer_get(&raddr, msg.msg_namelen, 1);
+    if (peer == NULL) {
+      return -1;
+    }
+    peer->stats.datagrams++;
+    peer->last = now;
+
+    if (my_hdr.frags <= 1) {
+      if (res > buffer_size) {
+        res = buffer_size;
+      }
+      if (data != buffer_ptr) {
+        memcpy(buffer_ptr, data, res);
+      }
+      s = NULL;
+      break;
+    }
+    s = reasm_add(peer, &my_hdr, data, res, &now);
+  } while (s == NULL);
+
+  if (s) {
+    res = reasm_copy(s, buffer_ptr, buffer_size);
+    peer->stats.reassembled++;
+    reasm_drop(s, 0);
+  }
+  peer->stats.msgs++;
+
   *remote = malloc(sizeof(struct nodeID));
   if (*remote == NULL) {
     return -1;
   }
+  memcpy(&(*remote)->addr, &raddr, msg.msg_namelen);
+  (*remote)->fd = -1;
+
+  return res;
+}
+
+static int send_queue_alloc(void)
+{
+  sq = malloc(sizeof(struct send_queue));
+  if (sq == NULL) {
+    return -1;
+  }
+  memset(sq, 0, sizeof(struct send_queue));
+  sq->fd = -1;
+  sq->arena = malloc(BATCH_ARENA_SIZE);
+  if (sq->arena == NULL) {
+    free(sq);
+    sq = NULL;
+
+    return -1;
+  }
+
+  return 0;
+}
+
+static int send_queue_do_flush(void)
+{
+  int sent, res;
+
+  sent = 0;
+  while (sent < sq->n_msgs) {
+    res = sendmmsg(sq->fd, sq->msgs + sent, sq->n_msgs - sent, 0);
+    if (res < 0) {
+      int error = errno;
+
+      fprintf(stderr,"net-helper: sendmmsg failed errno %d: %s\n", error, strerror(error));
+      /* Drop the datagram that caused the error, and go on with the others */
+      res = 1;
+    }
+    sent += res;
+  }
+  sq->n_msgs = 0;
+  sq->arena_used = 0;
+
+  return sent;
+}
+
+int send_queue_flush(const struct nodeID *from)
+{
+  if (sq == NULL || sq->n_msgs == 0) {
+    return 0;
+  }
+  if (from && from->fd != sq->fd) {
+    return -1;
+  }
+
+  return send_queue_do_flush();
+}
+
+int send_to_peer_queued(const struct nodeID *from, const struct nodeID *to, const uint8_t *buffer_ptr, int buffer_size)
+{
+  int frags, i, size;
+  uint8_t *p;
+
+  if (buffer_size <= 0) return -1;
+
+  if (sq == NULL && send_queue_alloc() < 0) {
+    return send_to_peer(from, to, buffer_ptr, buffer_size);
+  }
+  if (buffer_size > BATCH_ARENA_SIZE) {
+    /* Does not fit in the queue: keep the ordering, and send it directly */
+    if (sq->n_msgs) {
+      send_queue_do_flush();
+    }
+
+    return send_to_peer(from, to, buffer_ptr, buffer_size);
+  }
+
+  frags = FRAGS(buffer_size);
+  if (sq->fd != from->fd ||
+      sq->n_msgs + frags > BATCH_MAX ||
+      sq->arena_used + buffer_size > BATCH_ARENA_SIZE) {
+    if (sq->n_msgs) {
+      send_queue_do_flush();
+    }
+    sq->fd = from->fd;
+  }
+
+  p = sq->arena + sq->arena_used;
+  memcpy(p, buffer_ptr, buffer_size);
+  sq->arena_used += buffer_size;
+  send_m_seq++;
+  size = buffer_size;
+  for (i = 0; i < frags; i++) {
+    int j = sq->n_msgs++;
+    struct msghdr *msg = &sq->msgs[j].msg_hdr;
+
+    sq->hdr[j].m_seq = send_m_seq;
+    sq->hdr[j].frag_seq = i + 1;
+    sq->hdr[j].frags = frags;
+    memcpy(&sq->to[j], &to->addr, sizeof(struct sockaddr_storage));
+    sq->iov[j][0].iov_base = &sq->hdr[j];
+    sq->iov[j][0].iov_len = sizeof(struct my_hdr_t);
+    sq->iov[j][1].iov_base = p;
+    sq->iov[j][1].iov_len = size > MAX_MSG_SIZE ? MAX_MSG_SIZE : size;
+    p += sq->iov[j][1].iov_len;
+    size -= sq->iov[j][1].iov_len;
+
+    memset(msg, 0, sizeof(struct msghdr));
+    msg->msg_name = &sq->to[j];
+    msg->msg_namelen = sizeof(struct sockaddr_storage);
+    msg->msg_iov = sq->iov[j];
+    msg->msg_iovlen = 2;
+  }
+
+  return buffer_size;
+}
+
+static void nh_msg_swap(struct nh_msg *m1, struct nh_msg *m2)
+{
+  struct nh_msg tmp;
+
+  tmp = *m1;
+  *m1 = *m2;
+  *m2 = tmp;
+}
+
+int recv_from_peer_batch(const struct nodeID *local, struct nh_msg *msgs, int n)
+{
+  struct mmsghdr mmsgs[BATCH_MAX];
+  struct iovec iov[BATCH_MAX][2];
+  struct my_hdr_t hdr[BATCH_MAX];
+  struct sockaddr_storage raddr[BATCH_MAX];
+  int len[BATCH_MAX];
+  struct timeval now;
+  int i, res, done;
+
+  if (n <= 0) return -1;
+  if (n > BATCH_MAX) n = BATCH_MAX;
 
-  recv = 0;
-  m_seq = -1;
-  frag_seq = 0;
   do {
-    iov[1].iov_base = buffer_ptr;
-    if (buffer_size > MAX_MSG_SIZE) {
-      iov[1].iov_len = MAX_MSG_SIZE;
-    } else {
-      iov[1].iov_len = buffer_size;
+    memset(mmsgs, 0, sizeof(struct mmsghdr) * n);
+    for (i = 0; i < n; i++) {
+      iov[i][0].iov_base = &hdr[i];
+      iov[i][0].iov_len = sizeof(struct my_hdr_t);
+      iov[i][1].iov_base = msgs[i].buff;
+      iov[i][1].iov_len = msgs[i].len > MAX_MSG_SIZE ? MAX_MSG_SIZE : msgs[i].len;
+      mmsgs[i].msg_hdr.msg_name = &raddr[i];
+      mmsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+      mmsgs[i].msg_hdr.msg_iov = iov[i];
+      mmsgs[i].msg_hdr.msg_iovlen = 2;
     }
-    buffer_size -= iov[1].iov_len;
-    buffer_ptr += iov[1].iov_len;
-    res = recvmsg(local->fd, &msg, 0);
-    recv += (res - sizeof(struct my_hdr_t));
-    if (m_seq != -1 && my_hdr.m_seq != m_seq) {
+
+    res = recvmmsg(local->fd, mmsgs, n, MSG_WAITFORONE, NULL);
+    if (res <= 0) {
       return -1;
-    } else {
-      m_seq = my_hdr.m_seq;
     }
-    if (my_hdr.frag_seq != frag_seq + 1) {
-      return -1;
-    } else {
-     frag_seq++;
+    gettimeofday(&now, NULL);
+    reasm_expire(&now);
+
+    /* Complete messages are left in place; fragments go to the reassembly
+     * slots, and a completed message is copied in the buffer of its last
+     * received fragment.
+     */
+    for (i = 0; i < res; i++) {
+      struct frag_peer *peer;
+      struct reasm_slot *s;
+      int size;
+
+      len[i] = -1;
+      if (mmsgs[i].msg_len < sizeof(struct my_hdr_t)) continue;
+      size = mmsgs[i].msg_len - sizeof(struct my_hdr_t);
+      peer = frag_peer_get(&raddr[i], mmsgs[i].msg_hdr.msg_namelen, 1);
+      if (peer == NULL) continue;
+      peer->stats.datagrams++;
+      peer->last = now;
+      if (hdr[i].frags <= 1) {
+        len[i] = size;
+        peer->stats.msgs++;
+        continue;
+      }
+      if (mmsgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        /* The buffer is too small for a fragment: the message will time out */
+        continue;
+      }
+      s = reasm_add(peer, &hdr[i], msgs[i].buff, size, &now);
+      if (s) {
+        len[i] = reasm_copy(s, msgs[i].buff, msgs[i].len);
+        peer->stats.reassembled++;
+        peer->stats.msgs++;
+        reasm_drop(s, 0);
+      }
     }
-  } while ((my_hdr.frag_seq < my_hdr.frags) && (buffer_size > 0));
-  memcpy(&(*remote)->addr, &raddr, msg.msg_namelen);
-  (*remote)->fd = -1;
 
-  return recv;
+    /* Compact the received messages at the beginning of msgs */
+    done = 0;
+    for (i = 0; i < res; i++) {
+      struct nodeID *remote;
+
+      if (len[i] < 0) continue;
+      remote = malloc(sizeof(struct nodeID));
+      if (remote == NULL) continue;
+      memcpy(&remote->addr, &raddr[i], mmsgs[i].msg_hdr.msg_namelen);
+      remote->fd = -1;
+      if (done != i) {
+        nh_msg_swap(&msgs[done], &msgs[i]);
+      }
+      msgs[done].remote = remote;
+      msgs[done++].len = len[i];
+    }
+  } while (done == 0);
+
+  return done;
 }
 
 int node_addr(const struct nodeID *s, char *addr, int len)
@@ -419,36 +1443,67 @@ struct nodeID *nodeid_dup(const struct nodeID *s)
 
 int nodeid_equal(const struct nodeID *s1, const struct nodeID *s2)
 {
-	return (nodeid_cmp(s1,s2) == 0);
-//  return (memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_storage)) == 0);
+  return (nodeid_cmp(s1,s2) == 0);
+}
+
+static const uint8_t *node_addr_bytes(const struct nodeID *s, int *len, uint16_t *port)
+{
+  switch (s->addr.ss_family)
+  {
+    case AF_INET:
+      *len = sizeof(struct in_addr);
+      *port = ((const struct sockaddr_in *)&s->addr)->sin_port;
+      return (const uint8_t *)&((const struct sockaddr_in *)&s->addr)->sin_addr;
+    case AF_INET6:
+      *len = sizeof(struct in6_addr);
+      *port = ((const struct sockaddr_in6 *)&s->addr)->sin6_port;
+      return (const uint8_t *)&((const struct sockaddr_in6 *)&s->addr)->sin6_addr;
+    default:
+      *len = sizeof(struct sockaddr_storage);
+      *port = 0;
+      return (const uint8_t *)&s->addr;
+  }
 }
 
 int nodeid_cmp(const struct nodeID *s1, const struct nodeID *s2)
 {
-	char ip1[80], ip2[80];
-	int port1,port2,res;
+  const uint8_t *a1, *a2;
+  int len, res;
+  uint16_t port1, port2;
 
-  if(s1 && s2)
-  {
-    port1=node_port(s1);
-    port2=node_port(s2);
-    node_ip(s1,ip1,80);
-    node_ip(s2,ip2,80);
-
-  //	int res = (port1^port2)|strcmp(ip1,ip2);
-  //	fprintf(stderr,"Comparing %s:%d and %s:%d\n",ip1,port1,ip2,port2);
-  //	fprintf(stderr,"Result: %d\n",res);
-    res  = strcmp(ip1,ip2);
-    if (res!=0)
-      return res;
-    else
-      return port1-port2;
-  //		return port1 == port2 ? 0 : 1;
+  if (!s1 || !s2) {
+    return 0;
+  }
+  if (s1->addr.ss_family != s2->addr.ss_family) {
+    return s1->addr.ss_family < s2->addr.ss_family ? -1 : 1;
+  }
+  a1 = node_addr_bytes(s1, &len, &port1);
+  a2 = node_addr_bytes(s2, &len, &port2);
+  res = memcmp(a1, a2, len);
+  if (res) {
+    return res < 0 ? -1 : 1;
+  }
+  port1 = ntohs(port1);
+  port2 = ntohs(port2);
 
-  //  return memcmp(&s1->addr, &s2->addr, sizeof(struct sockaddr_storage));
+  return port1 == port2 ? 0 : (port1 < port2 ? -1 : 1);
+}
+
+uint32_t nodeid_hash(const struct nodeID *s)
+{
+  const uint8_t *a;
+  int i, len;
+  uint16_t port;
+  uint32_t h = 2166136261u;	/* FNV-1a */
+
+  a = node_addr_bytes(s, &len, &port);
+  for (i = 0; i < len; i++) {
+    h = (h ^ a[i]) * 16777619u;
   }
-  else
-    return 0;
+  h = (h ^ (port & 0xff)) * 16777619u;
+  h = (h ^ (port >> 8)) * 16777619u;
+
+  return h;
 }
 
 int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
@@ -460,10 +1515,84 @@ int nodeid_dump(uint8_t *b, const struct nodeID *s, size_t max_write_size)
   return sizeof(struct sockaddr_storage);
 }
 
-struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+/*
+ * Compact format: a tag byte (NODEID_COMPACT_TAG | version | address type),
+ * followed by the raw address and by the port (both in network order).
+ * The legacy format starts with the address family (or with sa_len on BSD
+ * systems), which never has the two most significant bits set, so the
+ * two formats can be distinguished by looking at the first byte.
+ */
+#define NODEID_COMPACT_TAG 0xC0
+#define NODEID_COMPACT_MASK 0xFC
+#define NODEID_COMPACT_V1 (1 << 2)
+#define NODEID_COMPACT_INET 0
+#define NODEID_COMPACT_INET6 1
+
+int nodeid_dump_compact(uint8_t *b, const struct nodeID *s, size_t max_write_size)
+{
+  const uint8_t *a;
+  int len;
+  uint16_t port;
+
+  if (s->addr.ss_family != AF_INET && s->addr.ss_family != AF_INET6) {
+    return nodeid_dump(b, s, max_write_size);
+  }
+  a = node_addr_bytes(s, &len, &port);
+  if (max_write_size < 1 + len + sizeof(port)) return -1;
+
+  b[0] = NODEID_COMPACT_TAG | NODEID_COMPACT_V1 |
+         (s->addr.ss_family == AF_INET ? NODEID_COMPACT_INET : NODEID_COMPACT_INET6);
+  memcpy(b + 1, a, len);
+  memcpy(b + 1 + len, &port, sizeof(port));
+
+  return 1 + len + sizeof(port);
+}
+
+int nodeid_is_compact(const uint8_t *b)
+{
+  return (b[0] & NODEID_COMPACT_MASK) == (NODEID_COMPACT_TAG | NODEID_COMPACT_V1);
+}
+
+struct nodeID *nodeid_undump_reuse(struct nodeID *s, const uint8_t *b, int *len)
 {
   struct nodeID *res;
-  res = malloc(sizeof(struct nodeID));
+
+  if (nodeid_is_compact(b)) {
+    struct sockaddr_in *in;
+    struct sockaddr_in6 *in6;
+
+    if ((b[0] & 0x03) != NODEID_COMPACT_INET && (b[0] & 0x03) != NODEID_COMPACT_INET6) {
+      fprintf(stderr, "Net-helper: unknown compact nodeID type %d\n", b[0] & 0x03);
+      *len = 0;
+
+      return NULL;
+    }
+    res = s ? s : malloc(sizeof(struct nodeID));
+    if (res == NULL) {
+      *len = 0;
+
+      return NULL;
+    }
+    memset(&res->addr, 0, sizeof(struct sockaddr_storage));
+    res->fd = -1;
+    if ((b[0] & 0x03) == NODEID_COMPACT_INET) {
+      in = (struct sockaddr_in *)&res->addr;
+      in->sin_family = AF_INET;
+      memcpy(&in->sin_addr, b + 1, sizeof(struct in_addr));
+      memcpy(&in->sin_port, b + 1 + sizeof(struct in_addr), sizeof(in->sin_port));
+      *len = 1 + sizeof(struct in_addr) + sizeof(in->sin_port);
+    } else {
+      in6 = (struct sockaddr_in6 *)&res->addr;
+      in6->sin6_family = AF_INET6;
+      memcpy(&in6->sin6_addr, b + 1, sizeof(struct in6_addr));
+      memcpy(&in6->sin6_port, b + 1 + sizeof(struct in6_addr), sizeof(in6->sin6_port));
+      *len = 1 + sizeof(struct in6_addr) + sizeof(in6->sin6_port);
+    }
+
+    return res;
+  }
+
+  res = s ? s : malloc(sizeof(struct nodeID));
   if (res != NULL) {
     memcpy(&res->addr, b, sizeof(struct sockaddr_storage));
     res->fd = -1;
@@ -473,6 +1602,11 @@ struct nodeID *nodeid_undump(const uint8_t *b, int *len)
   return res;
 }
 
+struct nodeID *nodeid_undump(const uint8_t *b, int *len)
+{
+  return nodeid_undump_reuse(NULL, b, len);
+}
+
 void nodeid_free(struct nodeID *s)
 {
   free(s);